@@ -1,8 +1,10 @@
 #include <stdlib.h>
+#include <math.h>
 #include <canutil/read.h>
 #include <pb_encode.h>
 #include "can/canread.h"
 #include "config.h"
+#include "payload/compact.h"
 #include "util/log.h"
 #include "util/timer.h"
 
@@ -11,15 +13,43 @@ using openxc::pipeline::MessageClass;
 using openxc::pipeline::Pipeline;
 using openxc::config::getConfiguration;
 using openxc::pipeline::publish;
+using openxc::payload::PayloadFormat;
 
 namespace pipeline = openxc::pipeline;
 namespace time = openxc::util::time;
 
+uint64_t openxc::can::read::loadPayload(const CanMessage* message) {
+    uint64_t payload = 0;
+    for(int i = 0; i < CAN_MESSAGE_SIZE; i++) {
+        payload = (payload << 8) | message->data[i];
+    }
+    return payload;
+}
+
+uint64_t openxc::can::read::extractSignalBitfield(const CanSignal* signal,
+        uint64_t payload) {
+    return (payload >> signal->bitShift) &
+            (~0ULL >> (CAN_PAYLOAD_BIT_SIZE - signal->bitSize));
+}
+
+/* Private: Parse a signal from a message whose payload word has already been
+ * loaded, falling back to the byte array if the signal isn't prepared.
+ */
+static float parseBitfield(CanSignal* signal, const CanMessage* message,
+        uint64_t payload) {
+    if(!signal->bitfieldPrepared) {
+        return bitfield_parse_float(message->data, CAN_MESSAGE_SIZE,
+                signal->bitPosition, signal->bitSize, signal->factor,
+                signal->offset);
+    }
+    return openxc::can::read::extractSignalBitfield(signal, payload) *
+            signal->factor + signal->offset;
+}
+
 float openxc::can::read::parseSignalBitfield(CanSignal* signal,
         const CanMessage* message) {
-    return bitfield_parse_float(message->data, CAN_MESSAGE_SIZE,
-            signal->bitPosition, signal->bitSize, signal->factor,
-            signal->offset);
+    return parseBitfield(signal, message,
+            signal->bitfieldPrepared ? loadPayload(message) : 0);
 }
 
 openxc_DynamicField openxc::can::read::noopDecoder(CanSignal* signal,
@@ -69,9 +99,26 @@ static void buildBaseSimpleVehicleMessage(openxc_VehicleMessage* message,
     strcpy(message->simple_message.name, name);
 }
 
+/* Private: Record the time a CAN message was received in a vehicle message
+ * translated from it. The pipeline always uses it to measure latency, but it's
+ * only included in the output if message timestamps are enabled.
+ */
+static void applyTimestamp(openxc_VehicleMessage* message,
+        uint64_t timestamp) {
+    message->timestamp = timestamp;
+    message->has_timestamp = getConfiguration()->messageTimestamps &&
+            timestamp != 0;
+}
+
 void openxc::can::read::publishVehicleMessage(const char* name,
         openxc_DynamicField* value, openxc_DynamicField* event,
         openxc::pipeline::Pipeline* pipeline) {
+    publishVehicleMessage(name, value, event, 0, pipeline);
+}
+
+void openxc::can::read::publishVehicleMessage(const char* name,
+        openxc_DynamicField* value, openxc_DynamicField* event,
+        uint64_t timestamp, openxc::pipeline::Pipeline* pipeline) {
     openxc_VehicleMessage message = {0};
     buildBaseSimpleVehicleMessage(&message, name);
 
@@ -85,6 +132,7 @@ void openxc::can::read::publishVehicleMessage(const char* name,
         message.simple_message.event = *event;
     }
 
+    applyTimestamp(&message, timestamp);
     pipeline::publish(&message, pipeline);
 }
 
@@ -135,7 +183,22 @@ void openxc::can::read::passthroughMessage(CanBus* bus, CanMessage* message,
 
     size_t adjustedSize = message->length == 0 ?
             CAN_MESSAGE_SIZE : message->length;
-    if(send) {
+    if(send && pipeline::formatInUse(pipeline, PayloadFormat::COMPACT)) {
+        // Loggers that want every raw frame get a packed record written
+        // straight from the CAN message, without building a vehicle message.
+        uint8_t record[COMPACT_MAX_CAN_FRAME_RECORD_SIZE];
+        int recordSize = payload::compact::serializeCanMessage(bus->address,
+                message, getConfiguration()->messageTimestamps, record,
+                sizeof(record));
+        if(recordSize > 0) {
+            pipeline::sendMessage(pipeline, record, recordSize,
+                    MessageClass::CAN, PayloadFormat::COMPACT,
+                    message->timestamp);
+        }
+    }
+
+    if(send && (pipeline::formatInUse(pipeline, PayloadFormat::JSON) ||
+                pipeline::formatInUse(pipeline, PayloadFormat::PROTOBUF))) {
         openxc_VehicleMessage vehicleMessage = {0};
         vehicleMessage.has_type = true;
         vehicleMessage.type = openxc_VehicleMessage_Type_CAN;
@@ -149,8 +212,9 @@ void openxc::can::read::passthroughMessage(CanBus* bus, CanMessage* message,
         vehicleMessage.can_message.data.size = adjustedSize;
         memcpy(vehicleMessage.can_message.data.bytes, message->data,
                 adjustedSize);
+        applyTimestamp(&vehicleMessage, message->timestamp);
 
-        pipeline::publish(&vehicleMessage, pipeline);
+        pipeline::publish(&vehicleMessage, pipeline, PayloadFormat::COMPACT);
     }
 
     if(messageDefinition != NULL) {
@@ -158,40 +222,150 @@ void openxc::can::read::passthroughMessage(CanBus* bus, CanMessage* message,
     }
 }
 
-void openxc::can::read::translateSignal(CanSignal* signal,
-        const CanMessage* message,
-        CanSignal* signals, int signalCount,
+/* Private: Determine if a signal should be sent, given whether or not its
+ * value has changed since it was last received.
+ */
+static bool shouldSend(CanSignal* signal, bool changed) {
+    bool send = true;
+    if(time::conditionalTick(&signal->frequencyClock) ||
+            (changed && signal->forceSendChanged)) {
+        if(signal->received && !signal->sendSame && !changed) {
+            send = false;
+        }
+    } else {
+        send = false;
+    }
+    return send;
+}
+
+/* Private: Powers of ten to round a signal's value to its precision, indexed by
+ * the number of decimal places. Rounding is done in single precision to match
+ * the float signal values and avoid double math on targets without an FPU.
+ */
+static const float PRECISION_SCALES[] = {1, 10, 100, 1000, 10000, 100000,
+        1000000};
+static const uint8_t MAX_SIGNAL_PRECISION = sizeof(PRECISION_SCALES) /
+        sizeof(PRECISION_SCALES[0]) - 1;
+
+/* Private: Round a value to the signal's precision, if it has one.
+ */
+static float roundToPrecision(const CanSignal* signal, float value) {
+    if(!signal->hasPrecision || signal->precision > MAX_SIGNAL_PRECISION) {
+        return value;
+    }
+
+    float scale = PRECISION_SCALES[signal->precision];
+    return floorf(value * scale + 0.5f) / scale;
+}
+
+/* Private: Round a decoded numeric value to the signal's precision, if it has
+ * one.
+ */
+static void applyPrecision(const CanSignal* signal,
+        openxc_DynamicField* value) {
+    if(signal->hasPrecision && value->has_numeric_value) {
+        value->numeric_value = roundToPrecision(signal,
+                value->numeric_value);
+    }
+}
+
+/* Private: Check if a signal can be translated from its raw integer value
+ * without the floating point factor and offset, i.e. integer decoding is
+ * enabled and the signal has a prepared bitfield that fits in 32 bits and uses
+ * the default decoder.
+ */
+static bool useIntegerDecoding(const CanSignal* signal) {
+    return getConfiguration()->integerDecoding && signal->decoder == NULL &&
+            signal->bitfieldPrepared && signal->bitSize <= 32;
+}
+
+/* Private: Translate a signal by comparing its raw integer value with the last
+ * one received, and only scale it to a floating point value (and round it to
+ * the signal's precision) when it changes. The scaled value is published the
+ * same as it would be by the default decoder.
+ */
+static void translateRawSignal(CanSignal* signal, uint64_t payload,
+        uint64_t timestamp, openxc::pipeline::Pipeline* pipeline) {
+    uint32_t rawValue = openxc::can::read::extractSignalBitfield(signal,
+            payload);
+    bool changed = !signal->received || rawValue != signal->lastRawValue;
+    if(changed) {
+        signal->lastValue = roundToPrecision(signal,
+                rawValue * signal->factor + signal->offset);
+        signal->lastRawValue = rawValue;
+    }
+
+    if(shouldSend(signal, changed)) {
+        openxc_DynamicField decodedValue = openxc::payload::wrapNumber(
+                signal->lastValue);
+        openxc::can::read::publishVehicleMessage(signal->genericName,
+                &decodedValue, NULL, timestamp, pipeline);
+    }
+    signal->received = true;
+}
+
+/* Private: Parse, decode, publish and record the value of a signal from a
+ * message whose payload word has already been loaded.
+ */
+static void translatePayload(CanSignal* signal, const CanMessage* message,
+        uint64_t payload, CanSignal* signals, int signalCount,
         openxc::pipeline::Pipeline* pipeline) {
-    if(signal == NULL || message == NULL) {
+    if(useIntegerDecoding(signal)) {
+        translateRawSignal(signal, payload, message->timestamp, pipeline);
         return;
     }
 
-    float value = parseSignalBitfield(signal, message);
-
+    float value = parseBitfield(signal, message, payload);
     bool send = true;
     // Must call the decoders every time, regardless of if we are going to
     // decide to send the signal or not.
     openxc_DynamicField decodedValue = openxc::can::read::decodeSignal(signal,
             value, signals, signalCount, &send);
-    if(send && shouldSend(signal, value)) {
-        openxc::can::read::publishVehicleMessage(signal->genericName, &decodedValue, pipeline);
+    if(send && openxc::can::read::shouldSend(signal, value)) {
+        applyPrecision(signal, &decodedValue);
+        openxc::can::read::publishVehicleMessage(signal->genericName,
+                &decodedValue, NULL, message->timestamp, pipeline);
     }
     signal->received = true;
     signal->lastValue = value;
 }
 
-bool openxc::can::read::shouldSend(CanSignal* signal, float value) {
-    bool send = true;
-    if(time::conditionalTick(&signal->frequencyClock) ||
-            (value != signal->lastValue && signal->forceSendChanged)) {
-        if(signal->received && !signal->sendSame
-                && value == signal->lastValue) {
-            send = false;
+void openxc::can::read::translateSignal(CanSignal* signal,
+        const CanMessage* message,
+        CanSignal* signals, int signalCount,
+        openxc::pipeline::Pipeline* pipeline) {
+    if(signal == NULL || message == NULL) {
+        return;
+    }
+
+    translatePayload(signal, message,
+            signal->bitfieldPrepared ? loadPayload(message) : 0,
+            signals, signalCount, pipeline);
+}
+
+bool openxc::can::read::decodeMessage(CanBus* bus, const CanMessage* message,
+        CanMessageDefinition* messages, int messageCount,
+        CanSignal* signals, int signalCount,
+        openxc::pipeline::Pipeline* pipeline) {
+    CanMessageDefinition* definition = lookupMessageDefinition(bus,
+            message->id, message->format, messages, messageCount);
+    if(definition == NULL) {
+        return false;
+    }
+
+    uint64_t payload = loadPayload(message);
+    for(int i = 0; i < definition->signalCount; i++) {
+        CanSignal* signal = &definition->signals[i];
+        if(signal->message == definition) {
+            translatePayload(signal, message, payload, signals, signalCount,
+                    pipeline);
         }
-    } else {
-        send = false;
     }
-    return send;
+    return true;
+}
+
+bool openxc::can::read::shouldSend(CanSignal* signal, float value) {
+    return ::shouldSend(signal, value != signal->lastValue);
 }
 
 openxc_DynamicField openxc::can::read::decodeSignal(CanSignal* signal,
@@ -25,11 +25,36 @@ namespace read {
  *
  * The decoder returns an openxc_DynamicField, which may contain a number,
  * string or boolean.
+ *
+ * If integer decoding is enabled in the configuration, a signal without a
+ * custom decoder is compared with its last raw integer value instead, and it's
+ * only scaled by its factor and offset when the value has changed.
  */
 void translateSignal(CanSignal* signal,
         const CanMessage* message, CanSignal* signals, int signalCount,
         openxc::pipeline::Pipeline* pipeline);
 
+/* Public: Translate all of the signals defined for a received CAN message and
+ * publish them to the pipeline.
+ *
+ * Only the signals indexed for the message's definition by indexSignals(...)
+ * are examined, so the cost doesn't grow with the total number of signals.
+ *
+ * bus - The CAN bus this message was received on.
+ * message - The received CAN message.
+ * messages - The list of all message definitions.
+ * messageCount - The length of the messages array.
+ * signals - An array of all active signals.
+ * signalCount - The length of the signals array.
+ * pipeline - The pipeline to publish the translated signals.
+ *
+ * Returns true if a definition for the message was found.
+ */
+bool decodeMessage(CanBus* bus, const CanMessage* message,
+        CanMessageDefinition* messages, int messageCount,
+        CanSignal* signals, int signalCount,
+        openxc::pipeline::Pipeline* pipeline);
+
 /* Public: Publish a CAN message to the pipeline without any parsing or
  * processing - just encapsulate it in a VehicleMessage.
  *
@@ -62,6 +87,20 @@ void passthroughMessage(CanBus* bus, CanMessage* message,
 void publishVehicleMessage(const char* name, openxc_DynamicField* value,
         openxc_DynamicField* event, openxc::pipeline::Pipeline* pipeline);
 
+/* Public: Publish a simple vehicle message translated from a received CAN
+ * message, including the time it was received if message timestamps are
+ * enabled in the configuration.
+ *
+ * This is the same as publishVehicleMessage(const char*, openxc_DynamicField*,
+ * openxc_DynamicField*, Pipeline) with the addition of:
+ *
+ * timestamp - The time the CAN message was received in microseconds, from the
+ *      CanMessage's timestamp field. If 0, no timestamp is published.
+ */
+void publishVehicleMessage(const char* name, openxc_DynamicField* value,
+        openxc_DynamicField* event, uint64_t timestamp,
+        openxc::pipeline::Pipeline* pipeline);
+
 /* Public: Publish a simple vehicle message to the pipeline with no event.
  *
  * This is a shortcut for publishVehicleMessage(const char*, openxc_DynamicField*,
@@ -186,15 +225,37 @@ openxc_DynamicField noopDecoder(CanSignal* signal, CanSignal* signals,
 /* Public: Parse the signal's bitfield from the given data and return the raw
  * value.
  *
+ * If the signal's bitfield was prepared with prepareSignalBitfield(...), the
+ * value is extracted with a single shift and mask of the payload word instead
+ * of being parsed byte by byte - the result is identical.
+ *
  * signal - The signal to parse from the data.
- * data - The data to parse the signal from.
- * length - The length of the data array.
+ * message - The message to parse the signal from.
  *
  * Returns the raw value of the signal parsed as a bitfield from the given byte
  * array.
  */
 float parseSignalBitfield(CanSignal* signal, const CanMessage* message);
 
+/* Public: Load the data of a CAN message into a 64-bit word, with the first
+ * byte of the message in the most significant byte.
+ *
+ * message - The message to load.
+ *
+ * Returns the payload as a big-endian 64-bit word.
+ */
+uint64_t loadPayload(const CanMessage* message);
+
+/* Public: Extract the integer value of a signal from a message payload, using
+ * the signal's precomputed bitShift and a mask of its bitSize.
+ *
+ * signal - The signal to extract, which must have its bitfield prepared.
+ * payload - The message payload, from loadPayload(...).
+ *
+ * Returns the unscaled value of the signal's bitfield.
+ */
+uint64_t extractSignalBitfield(const CanSignal* signal, uint64_t payload);
+
 /* Public: Parse a signal from a CAN message and apply any required
  * transforations to get a human readable value.
  *
@@ -2,6 +2,7 @@
 #include "can/canwrite.h"
 #include "util/log.h"
 #include "config.h"
+#include "platform/platform.h"
 
 #define BUS_STATS_LOG_FREQUENCY_S 15
 #define CAN_MESSAGE_TOTAL_BIT_SIZE 128
@@ -9,15 +10,24 @@
 namespace time = openxc::util::time;
 namespace statistics = openxc::util::statistics;
 namespace config = openxc::config;
+namespace platform = openxc::platform;
 
 using openxc::util::log::debug;
 using openxc::util::statistics::DeltaStatistic;
 
+#define CAN_RING_MASK (CAN_QUEUE_MAX_LENGTH - 1)
+
+/* Private: A full compiler and hardware memory barrier, so a message copied in
+ * or out of a CanMessageRing is never reordered with the index update that
+ * hands its slot to the other side.
+ */
+#define MEMORY_BARRIER() __sync_synchronize()
+
 const int openxc::can::CAN_ACTIVE_TIMEOUT_S = 5;
 
 void openxc::can::initializeCommon(CanBus* bus) {
     debug("Initializing CAN node %d...", bus->address);
-    QUEUE_INIT(CanMessage, &bus->receiveQueue);
+    ring::initialize(&bus->receiveQueue);
     QUEUE_INIT(CanMessage, &bus->sendQueue);
 
     LIST_INIT(&bus->acceptanceFilters);
@@ -26,15 +36,23 @@ void openxc::can::initializeCommon(CanBus* bus) {
         LIST_INSERT_HEAD(&bus->freeAcceptanceFilters,
                 &bus->acceptanceFilterEntries[i], entries);
     }
+    memset(bus->standardFilterIndex, 0, sizeof(bus->standardFilterIndex));
+    bus->extendedFilterCount = 0;
 
     bus->writeHandler = openxc::can::write::sendMessage;
     bus->lastMessageReceived = 0;
+    bus->receiveQueueHighWaterMark = 0;
+    bus->sendQueueHighWaterMark = 0;
     LIST_INIT(&bus->dynamicMessages);
     LIST_INIT(&bus->freeMessageDefinitions);
     for(size_t i = 0; i < MAX_DYNAMIC_MESSAGE_COUNT; i++) {
         LIST_INSERT_HEAD(&bus->freeMessageDefinitions,
                 &bus->definitionEntries[i], entries);
     }
+    bus->messageIndexCount = 0;
+    bus->messageIndexOverflow = 0;
+    bus->indexedMessages = NULL;
+    bus->indexedMessageCount = 0;
 
     statistics::initialize(&bus->totalMessageStats);
     statistics::initialize(&bus->droppedMessageStats);
@@ -42,11 +60,102 @@ void openxc::can::initializeCommon(CanBus* bus) {
     statistics::initialize(&bus->receivedDataStats);
     statistics::initialize(&bus->sendQueueStats);
     statistics::initialize(&bus->receiveQueueStats);
+    statistics::initialize(&bus->receiveBatchStats);
+    statistics::initialize(&bus->decodeLatency);
+    statistics::initialize(&bus->publishLatency);
 }
 
 void openxc::can::destroy(CanBus* bus) {
 }
 
+int openxc::can::receiveBatchSize(CanBus* bus) {
+    return bus->receiveBatchSize > 0 ? bus->receiveBatchSize :
+            DEFAULT_CAN_RECEIVE_BATCH_SIZE;
+}
+
+unsigned int openxc::can::receiveTimeBudget(CanBus* bus) {
+    return bus->receiveTimeBudget > 0 ? bus->receiveTimeBudget :
+            DEFAULT_CAN_RECEIVE_TIME_BUDGET_MS;
+}
+
+static int queueCapacity(unsigned short size) {
+    return size > 0 && size < CAN_QUEUE_MAX_LENGTH ? size :
+            CAN_QUEUE_MAX_LENGTH;
+}
+
+void openxc::can::ring::initialize(CanMessageRing* ring) {
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+bool openxc::can::ring::push(CanMessageRing* ring, const CanMessage* message) {
+    const unsigned int head = ring->head;
+    if(head - ring->tail >= CAN_QUEUE_MAX_LENGTH) {
+        return false;
+    }
+
+    ring->elements[head & CAN_RING_MASK] = *message;
+    // Finish writing the element before the consumer can see it
+    MEMORY_BARRIER();
+    ring->head = head + 1;
+    return true;
+}
+
+bool openxc::can::ring::pop(CanMessageRing* ring, CanMessage* message) {
+    return popBulk(ring, message, 1) == 1;
+}
+
+int openxc::can::ring::popBulk(CanMessageRing* ring, CanMessage messages[],
+        int maxCount) {
+    const unsigned int tail = ring->tail;
+    const unsigned int available = ring->head - tail;
+    // Read the head before any of the elements it published
+    MEMORY_BARRIER();
+
+    int count = 0;
+    if(maxCount > 0) {
+        count = available < (unsigned int) maxCount ? available : maxCount;
+    }
+    for(int i = 0; i < count; i++) {
+        messages[i] = ring->elements[(tail + i) & CAN_RING_MASK];
+    }
+
+    // Finish reading the elements before the producer can reuse their slots
+    MEMORY_BARRIER();
+    ring->tail = tail + count;
+    return count;
+}
+
+int openxc::can::ring::length(CanMessageRing* ring) {
+    const unsigned int tail = ring->tail;
+    return ring->head - tail;
+}
+
+bool openxc::can::ring::empty(CanMessageRing* ring) {
+    return length(ring) == 0;
+}
+
+int openxc::can::receiveQueueCapacity(CanBus* bus) {
+    return queueCapacity(bus->receiveQueueSize);
+}
+
+int openxc::can::sendQueueCapacity(CanBus* bus) {
+    return queueCapacity(bus->sendQueueSize);
+}
+
+bool openxc::can::queueReceivedMessage(CanBus* bus, const CanMessage* message) {
+    int length = ring::length(&bus->receiveQueue);
+    if(length >= receiveQueueCapacity(bus) ||
+            !ring::push(&bus->receiveQueue, message)) {
+        return false;
+    }
+
+    if(length + 1 > bus->receiveQueueHighWaterMark) {
+        bus->receiveQueueHighWaterMark = (unsigned short)(length + 1);
+    }
+    return true;
+}
+
 bool openxc::can::busActive(CanBus* bus) {
     return bus->lastMessageReceived != 0 &&
         time::systemTimeMs() - bus->lastMessageReceived <
@@ -123,6 +232,51 @@ CanSignal* openxc::can::lookupSignal(const char* name, CanSignal* signals,
     return lookupSignal(name, signals, signalCount, false);
 }
 
+CanSignal* openxc::can::lookupSignal(CanSignalReference* reference,
+        CanSignal* signals, int signalCount) {
+    if(reference->signals != signals) {
+        reference->signal = lookupSignal(reference->genericName, signals,
+                signalCount);
+        reference->signals = signals;
+    }
+    return reference->signal;
+}
+
+void openxc::can::prepareSignalBitfield(CanSignal* signal) {
+    signal->bitShift = 0;
+    signal->bitfieldPrepared = signal->bitSize > 0 &&
+            signal->bitPosition + signal->bitSize <= CAN_PAYLOAD_BIT_SIZE;
+    if(signal->bitfieldPrepared) {
+        signal->bitShift = CAN_PAYLOAD_BIT_SIZE - signal->bitPosition -
+                signal->bitSize;
+    }
+}
+
+void openxc::can::indexSignals(CanMessageDefinition* messages,
+        int messageCount, CanSignal* signals, int signalCount) {
+    for(int i = 0; i < messageCount; i++) {
+        messages[i].signals = NULL;
+        messages[i].signalCount = 0;
+    }
+
+    for(int i = 0; i < signalCount; i++) {
+        prepareSignalBitfield(&signals[i]);
+
+        CanMessageDefinition* message = signals[i].message;
+        if(message == NULL || message < messages ||
+                message >= &messages[messageCount]) {
+            continue;
+        }
+
+        if(message->signals == NULL) {
+            message->signals = &signals[i];
+        }
+        // Signals are in ascending order, so this always extends the range to
+        // the end of the current signal
+        message->signalCount = &signals[i] - message->signals + 1;
+    }
+}
+
 static bool commandComparator(void* name, int index, void* commands) {
     return !strcmp((const char*)name,
             ((CanCommand*)commands)[index].genericName);
@@ -144,6 +298,7 @@ CanCommand* openxc::can::lookupCommand(const char* name, CanCommand* commands,
  *
  * bus - The CanBus to search for the message.
  * id - The ID of the CAN message.
+ * format - The format of the ID of the message.
  * messages - The list of CAN messages to search.
  * messageCount - The length of the messages array.
  *
@@ -152,28 +307,157 @@ CanCommand* openxc::can::lookupCommand(const char* name, CanCommand* commands,
 static CanMessageDefinition* lookupMessage(CanBus* bus, uint32_t id,
         CanMessageFormat format,
         CanMessageDefinition* messages, int messageCount) {
-    CanMessageDefinition* message = NULL;
     for(int i = 0; i < messageCount; i++) {
-        if(messages[i].bus == bus && messages[i].id == id) {
-            message = &messages[i];
+        if(messages[i].bus == bus && messages[i].id == id &&
+                messages[i].format == format) {
+            return &messages[i];
         }
     }
-    return message;
+    return NULL;
+}
+
+/* Private: Search the dynamically registered messages on the bus for one
+ * matching the given ID and format.
+ */
+static CanMessageDefinitionListEntry* lookupDynamicMessage(CanBus* bus,
+        uint32_t id, CanMessageFormat format) {
+    CanMessageDefinitionListEntry* entry;
+    LIST_FOREACH(entry, &bus->dynamicMessages, entries) {
+        if(entry->definition.id == id && entry->definition.format == format) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Private: Compare a message ID and format with a message definition, in the
+ * order used by the message index (all standard IDs before extended).
+ *
+ * Returns a negative number if the ID comes before the definition, 0 if they
+ * match and a positive number if it comes after.
+ */
+static int compareMessageKey(uint32_t id, CanMessageFormat format,
+        const CanMessageDefinition* definition) {
+    if(format != definition->format) {
+        return format < definition->format ? -1 : 1;
+    }
+    if(id != definition->id) {
+        return id < definition->id ? -1 : 1;
+    }
+    return 0;
+}
+
+/* Private: Find the first position in the bus's message index not before the
+ * given ID and format, or after it if 'after' is true.
+ */
+static int findIndexPosition(CanBus* bus, uint32_t id, CanMessageFormat format,
+        bool after) {
+    int low = 0;
+    int high = bus->messageIndexCount;
+    while(low < high) {
+        int middle = (low + high) / 2;
+        int comparison = compareMessageKey(id, format,
+                bus->messageIndex[middle]);
+        if(comparison > 0 || (after && comparison == 0)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/* Private: Insert a message definition into the bus's message index, after any
+ * existing definitions with the same key so predefined messages are always
+ * found first.
+ */
+static void addToMessageIndex(CanBus* bus, CanMessageDefinition* definition) {
+    if(bus->messageIndexCount >= MAX_MESSAGE_INDEX_SIZE) {
+        ++bus->messageIndexOverflow;
+        return;
+    }
+
+    int position = findIndexPosition(bus, definition->id, definition->format,
+            true);
+    memmove(&bus->messageIndex[position + 1], &bus->messageIndex[position],
+            (bus->messageIndexCount - position) *
+                sizeof(CanMessageDefinition*));
+    bus->messageIndex[position] = definition;
+    ++bus->messageIndexCount;
+}
+
+static void removeFromMessageIndex(CanBus* bus,
+        CanMessageDefinition* definition) {
+    for(int i = findIndexPosition(bus, definition->id, definition->format,
+                false); i < bus->messageIndexCount &&
+            compareMessageKey(definition->id, definition->format,
+                bus->messageIndex[i]) == 0; i++) {
+        if(bus->messageIndex[i] == definition) {
+            --bus->messageIndexCount;
+            memmove(&bus->messageIndex[i], &bus->messageIndex[i + 1],
+                    (bus->messageIndexCount - i) *
+                        sizeof(CanMessageDefinition*));
+            return;
+        }
+    }
+
+    // It must have been one of the definitions that didn't fit
+    if(bus->messageIndexOverflow > 0) {
+        --bus->messageIndexOverflow;
+    }
+}
+
+void openxc::can::indexMessageDefinitions(CanBus* bus,
+        CanMessageDefinition* messages, int messageCount) {
+    bus->messageIndexCount = 0;
+    bus->messageIndexOverflow = 0;
+    bus->indexedMessages = messages;
+    bus->indexedMessageCount = messageCount;
+
+    for(int i = 0; i < messageCount; i++) {
+        if(messages[i].bus == bus) {
+            addToMessageIndex(bus, &messages[i]);
+        }
+    }
+
+    CanMessageDefinitionListEntry* entry;
+    LIST_FOREACH(entry, &bus->dynamicMessages, entries) {
+        addToMessageIndex(bus, &entry->definition);
+    }
+
+    if(bus->messageIndexOverflow > 0) {
+        debug("%d messages on bus %d didn't fit in the index, lookups for "
+                "them will be slower", bus->messageIndexOverflow,
+                bus->address);
+    }
 }
 
 CanMessageDefinition* openxc::can::lookupMessageDefinition(CanBus* bus,
         uint32_t id, CanMessageFormat format,
         CanMessageDefinition* predefinedMessages,
         int predefinedMessageCount) {
+    if(bus->indexedMessages != NULL &&
+            bus->indexedMessages == predefinedMessages &&
+            bus->indexedMessageCount == predefinedMessageCount) {
+        int position = findIndexPosition(bus, id, format, false);
+        if(position < bus->messageIndexCount &&
+                compareMessageKey(id, format,
+                    bus->messageIndex[position]) == 0) {
+            return bus->messageIndex[position];
+        }
+
+        if(bus->messageIndexOverflow == 0) {
+            return NULL;
+        }
+    }
+
     CanMessageDefinition* message = lookupMessage(bus, id, format,
             predefinedMessages, predefinedMessageCount);
     if(message == NULL) {
-        CanMessageDefinitionListEntry* entry;
-        LIST_FOREACH(entry, &bus->dynamicMessages, entries) {
-            if(entry->definition.id == id) {
-                message = &entry->definition;
-                break;
-            }
+        CanMessageDefinitionListEntry* entry = lookupDynamicMessage(bus, id,
+                format);
+        if(entry != NULL) {
+            message = &entry->definition;
         }
     }
     return message;
@@ -201,28 +485,27 @@ bool openxc::can::registerMessageDefinition(CanBus* bus, uint32_t id,
         LIST_REMOVE(entry, entries);
         entry->definition.bus = bus;
         entry->definition.id = id;
+        entry->definition.format = format;
         entry->definition.frequencyClock = {bus->maxMessageFrequency};
         entry->definition.forceSendChanged = true;
 
         LIST_INSERT_HEAD(&bus->dynamicMessages, entry, entries);
         message = &entry->definition;
+        if(bus->indexedMessages != NULL) {
+            addToMessageIndex(bus, message);
+        }
     }
     return message != NULL;
 }
 
 bool openxc::can::unregisterMessageDefinition(CanBus* bus, uint32_t id,
         CanMessageFormat format) {
-    CanMessageDefinitionListEntry* entry, *match = NULL;
-    LIST_FOREACH(entry, &bus->dynamicMessages, entries) {
-        if(entry->definition.id == id) {
-            match = entry;
-            break;
-        }
-    }
-
+    CanMessageDefinitionListEntry* match = lookupDynamicMessage(bus, id,
+            format);
     if(match != NULL) {
-        LIST_REMOVE(entry, entries);
-        LIST_INSERT_HEAD(&bus->freeMessageDefinitions, entry, entries);
+        removeFromMessageIndex(bus, &match->definition);
+        LIST_REMOVE(match, entries);
+        LIST_INSERT_HEAD(&bus->freeMessageDefinitions, match, entries);
         return true;
     }
     return false;
@@ -277,21 +560,34 @@ void openxc::can::logBusStatistics(CanBus* buses, const int busCount) {
             statistics::update(&bus->sendQueueStats,
                     QUEUE_LENGTH(CanMessage, &bus->sendQueue));
             statistics::update(&bus->receiveQueueStats,
-                    QUEUE_LENGTH(CanMessage, &bus->receiveQueue));
+                    ring::length(&bus->receiveQueue));
 
             if(bus->totalMessageStats.total > 0) {
-                debug("CAN%d Rx queue length: %d, avg: %f percent",
+                debug("CAN%d Rx queue length: %d / %d, avg: %f percent, "
+                        "high-water mark: %d",
                         bus->address,
-                        QUEUE_LENGTH(CanMessage, &bus->receiveQueue),
+                        ring::length(&bus->receiveQueue),
+                        receiveQueueCapacity(bus),
                         statistics::exponentialMovingAverage(
                             &bus->receiveQueueStats) /
-                                QUEUE_MAX_LENGTH(CanMessage) * 100);
-                debug("CAN%d Tx queue length: %d, avg: %f percent",
+                                receiveQueueCapacity(bus) * 100,
+                        bus->receiveQueueHighWaterMark);
+                debug("CAN%d Tx queue length: %d / %d, avg: %f percent, "
+                        "high-water mark: %d",
                         bus->address,
                         QUEUE_LENGTH(CanMessage, &bus->sendQueue),
+                        sendQueueCapacity(bus),
                         statistics::exponentialMovingAverage(
                             &bus->sendQueueStats) /
-                                QUEUE_MAX_LENGTH(CanMessage) * 100);
+                                sendQueueCapacity(bus) * 100,
+                        bus->sendQueueHighWaterMark);
+                debug("CAN%d Rx batch budget: %d msgs / %dms, "
+                        "batch size avg: %f, max: %d",
+                        bus->address, receiveBatchSize(bus),
+                        receiveTimeBudget(bus),
+                        statistics::exponentialMovingAverage(
+                            &bus->receiveBatchStats),
+                        statistics::maximum(&bus->receiveBatchStats));
                 debug("CAN%d msgs Rx: %d (%dKB)",
                         bus->address, bus->receivedMessageStats.total,
                         bus->receivedDataStats.total);
@@ -336,8 +632,8 @@ void openxc::can::logBusStatistics(CanBus* buses, const int busCount) {
         lastTimeLogged = time::systemTimeMs();
 
         for(int i = 0; i < busCount; i++) {
-            if(QUEUE_LENGTH(CanMessage, &buses[i].receiveQueue) ==
-                    QUEUE_MAX_LENGTH(CanMessage)) {
+            if(ring::length(&buses[i].receiveQueue) >=
+                    receiveQueueCapacity(&buses[i])) {
                 debug("Dropped CAN messages while running stats on bus %d", i);
             }
         }
@@ -380,11 +676,76 @@ static AcceptanceFilterListEntry* popListEntry(AcceptanceFilterList* list) {
     return result;
 }
 
+/* Private: Find the position of an extended ID in the bus's sorted extended
+ * filter index with a binary search.
+ *
+ * Returns the index of the ID if it's in the index, otherwise the position
+ * where it would have to be inserted to keep the array sorted.
+ */
+static int findExtendedFilter(CanBus* bus, uint32_t id) {
+    int low = 0;
+    int high = bus->extendedFilterCount;
+    while(low < high) {
+        int middle = (low + high) / 2;
+        if(bus->extendedFilterIndex[middle] < id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/* Private: Add or remove an ID from the bus's acceptance filter index, used by
+ * shouldAcceptMessage(...). This must be called whenever a filter is added to
+ * or removed from the acceptanceFilters list.
+ *
+ * The main loop is the only writer and the CAN interrupt handler the only
+ * reader. Standard IDs are a single bit flip; extended IDs are kept sorted,
+ * so insertion and removal shift entries towards or away from the end of the
+ * array. The array is briefly inconsistent while that happens, so interrupts
+ * are disabled for it.
+ */
+static void updateFilterIndex(CanBus* bus, uint32_t id,
+        CanMessageFormat format, bool active) {
+    if(format == CanMessageFormat::STANDARD) {
+        if(id < STANDARD_CAN_ID_COUNT) {
+            if(active) {
+                bus->standardFilterIndex[id / 32] |= 1UL << (id % 32);
+            } else {
+                bus->standardFilterIndex[id / 32] &= ~(1UL << (id % 32));
+            }
+        }
+        return;
+    }
+
+    int position = findExtendedFilter(bus, id);
+    bool indexed = position < bus->extendedFilterCount &&
+            bus->extendedFilterIndex[position] == id;
+    if(active && !indexed &&
+            bus->extendedFilterCount < MAX_ACCEPTANCE_FILTERS) {
+        unsigned int interruptState = platform::disableInterrupts();
+        memmove(&bus->extendedFilterIndex[position + 1],
+                &bus->extendedFilterIndex[position],
+                (bus->extendedFilterCount - position) * sizeof(uint32_t));
+        bus->extendedFilterIndex[position] = id;
+        ++bus->extendedFilterCount;
+        platform::restoreInterrupts(interruptState);
+    } else if(!active && indexed) {
+        unsigned int interruptState = platform::disableInterrupts();
+        --bus->extendedFilterCount;
+        memmove(&bus->extendedFilterIndex[position],
+                &bus->extendedFilterIndex[position + 1],
+                (bus->extendedFilterCount - position) * sizeof(uint32_t));
+        platform::restoreInterrupts(interruptState);
+    }
+}
+
 bool openxc::can::addAcceptanceFilter(CanBus* bus, uint32_t id,
         CanMessageFormat format, CanBus* buses, int busCount) {
     AcceptanceFilterListEntry* entry;
     LIST_FOREACH(entry, &bus->acceptanceFilters, entries) {
-        if(entry->filter == id) {
+        if(entry->filter == id && entry->format == format) {
             ++entry->activeUserCount;
             debug("Filter for 0x%x already exists -- bumped user count to %d",
                     id, entry->activeUserCount);
@@ -407,7 +768,9 @@ bool openxc::can::addAcceptanceFilter(CanBus* bus, uint32_t id,
     debug("Added acceptance filter for 0x%x on bus %d", availableFilter->filter,
             bus->address);
     bool status = updateAcceptanceFilterTable(buses, busCount);
-    if(!status) {
+    if(status) {
+        updateFilterIndex(bus, id, format, true);
+    } else {
         debug("Unable to update AF table after adding filter for 0x%x on bus %d",
                 availableFilter->filter, bus->address);
         LIST_REMOVE(availableFilter, entries);
@@ -420,7 +783,7 @@ void openxc::can::removeAcceptanceFilter(CanBus* bus, uint32_t id,
         CanMessageFormat format, CanBus* buses, const int busCount) {
     AcceptanceFilterListEntry* entry;
     LIST_FOREACH(entry, &bus->acceptanceFilters, entries) {
-        if(entry->filter == id) {
+        if(entry->filter == id && entry->format == format) {
             break;
         }
     }
@@ -433,6 +796,7 @@ void openxc::can::removeAcceptanceFilter(CanBus* bus, uint32_t id,
             debug("No active users - disabling filter");
             LIST_REMOVE(entry, entries);
             LIST_INSERT_HEAD(&bus->freeAcceptanceFilters, entry, entries);
+            updateFilterIndex(bus, entry->filter, entry->format, false);
             updateAcceptanceFilterTable(buses, busCount);
         }
     }
@@ -446,16 +810,19 @@ bool openxc::can::setAcceptanceFilterStatus(CanBus* bus, bool enabled,
     return updateAcceptanceFilterTable(buses, busCount);
 }
 
-bool openxc::can::shouldAcceptMessage(CanBus* bus, uint32_t messageId) {
-    bool acceptMessage = bus->bypassFilters;
-    if(!acceptMessage) {
-        AcceptanceFilterListEntry* entry;
-        LIST_FOREACH(entry, &bus->acceptanceFilters, entries) {
-            if(entry->filter == messageId) {
-                acceptMessage = true;
-                break;
-            }
-        }
+bool openxc::can::shouldAcceptMessage(CanBus* bus, uint32_t messageId,
+        CanMessageFormat format) {
+    if(bus->bypassFilters) {
+        return true;
+    }
+
+    if(format == CanMessageFormat::STANDARD) {
+        return messageId < STANDARD_CAN_ID_COUNT &&
+            (bus->standardFilterIndex[messageId / 32] &
+                (1UL << (messageId % 32))) != 0;
     }
-    return acceptMessage;
+
+    int position = findExtendedFilter(bus, messageId);
+    return position < bus->extendedFilterCount &&
+            bus->extendedFilterIndex[position] == messageId;
 }
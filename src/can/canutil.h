@@ -16,8 +16,19 @@
 #define MAX_ACCEPTANCE_FILTERS 24
 // TODO this takes up a ton of memory
 #define MAX_DYNAMIC_MESSAGE_COUNT 12
+// The maximum number of predefined and dynamic message definitions that can be
+// indexed for fast lookup on each bus. Lookups for IDs not in the index fall
+// back to a linear search while some definitions didn't fit.
+#ifndef MAX_MESSAGE_INDEX_SIZE
+#define MAX_MESSAGE_INDEX_SIZE 128
+#endif
 
 #define CAN_MESSAGE_SIZE 8
+#define CAN_PAYLOAD_BIT_SIZE (CAN_MESSAGE_SIZE * 8)
+
+// One bit for each of the 2048 possible standard 11-bit CAN IDs
+#define STANDARD_CAN_ID_COUNT 2048
+#define STANDARD_FILTER_INDEX_SIZE (STANDARD_CAN_ID_COUNT / 32)
 
 /* Public: The type signature for a CAN signal decoder.
  *
@@ -108,7 +119,26 @@ typedef struct CanSignalState CanSignalState;
  *                is used.
  * received    - True if this signal has ever been received.
  * lastValue   - The last received value of the signal. If 'received' is false,
- *      this value is undefined.
+ *      this value is undefined. For signals translated with integer decoding,
+ *      this is already rounded to the signal's precision.
+ * bitShift    - The number of bits to shift a message's payload, loaded as a
+ *      big-endian 64-bit word, to the right to align this signal with bit 0.
+ *      This is computed by prepareSignalBitfield(...) and doesn't need to be
+ *      defined.
+ * bitfieldPrepared - True if bitShift has been computed and the signal can be
+ *      extracted from the payload word, masking it to bitSize bits. If false,
+ *      the bitfield hasn't been prepared (or isn't valid) and the signal is
+ *      parsed byte by byte instead.
+ * lastRawValue - The last received value of the signal before applying the
+ *      factor and offset, when integer decoding is enabled in the
+ *      configuration. If 'received' is false, this value is undefined.
+ * precision   - The number of digits after the decimal point to round the
+ *      signal's numeric value to before it's published, which also shortens
+ *      the JSON output. Only used if hasPrecision is true; 0 publishes whole
+ *      numbers. Values above 6 aren't rounded, since JSON output never has
+ *      more than 6 decimal places.
+ * hasPrecision - True if the signal's value should be rounded to 'precision'
+ *      decimal places. Defaults to false, and then the value isn't rounded.
  */
 struct CanSignal {
     struct CanMessageDefinition* message;
@@ -129,6 +159,11 @@ struct CanSignal {
     SignalEncoder encoder;
     bool received;
     float lastValue;
+    uint8_t bitShift;
+    bool bitfieldPrepared;
+    uint32_t lastRawValue;
+    uint8_t precision;
+    bool hasPrecision;
 };
 typedef struct CanSignal CanSignal;
 
@@ -147,6 +182,12 @@ typedef struct CanSignal CanSignal;
  * lastValue - The last received value of the message. Defaults to undefined.
  *      This is required for the forceSendChanged functionality, as the stack
  *      needs to compare an incoming CAN message with the previous frame.
+ * signals - The first signal in this message, in the array of all signals. This
+ *      is filled in by indexSignals(...) and doesn't need to be defined.
+ * signalCount - The length of the range of the signals array starting at
+ *      'signals' that covers all of the signals in this message. If the
+ *      signals for the message aren't contiguous, the range will include other
+ *      messages' signals as well.
  */
 struct CanMessageDefinition {
     struct CanBus* bus;
@@ -155,6 +196,8 @@ struct CanMessageDefinition {
     openxc::util::time::FrequencyClock frequencyClock;
     bool forceSendChanged;
     uint8_t lastValue[CAN_MESSAGE_SIZE];
+    struct CanSignal* signals;
+    uint16_t signalCount;
 };
 typedef struct CanMessageDefinition CanMessageDefinition;
 
@@ -165,16 +208,45 @@ typedef struct CanMessageDefinition CanMessageDefinition;
  * format - the format of the message's ID.
  * data  - The message's data field.
  * length - the length of the data array (max 8).
+ * timestamp - the time in microseconds since startup (see systemTimeUs()) when
+ *      the message was received, captured in the interrupt handler, or 0 if
+ *      it's unknown.
  */
 struct CanMessage {
     uint32_t id;
     CanMessageFormat format;
     uint8_t data[CAN_MESSAGE_SIZE];
     uint8_t length;
+    uint64_t timestamp;
 };
 typedef struct CanMessage CanMessage;
 
-QUEUE_DECLARE(CanMessage, 8);
+QUEUE_DECLARE(CanMessage, CAN_QUEUE_MAX_LENGTH);
+
+#if (CAN_QUEUE_MAX_LENGTH & (CAN_QUEUE_MAX_LENGTH - 1)) != 0
+#error "CAN_QUEUE_MAX_LENGTH must be a power of two"
+#endif
+
+/* Public: A ring buffer of CanMessage objects for passing received messages
+ * from a CAN interrupt handler (the only producer) to the main loop (the only
+ * consumer) without disabling interrupts.
+ *
+ * The head and tail are free-running counters. Only the producer writes the
+ * head and only the consumer writes the tail, so neither needs a lock - the
+ * slot for each is found by masking the counter with the capacity, which is
+ * why CAN_QUEUE_MAX_LENGTH must be a power of two. Use the functions in
+ * openxc::can::ring to access it.
+ *
+ * head - The total number of messages ever pushed.
+ * tail - The total number of messages ever popped.
+ * elements - Storage for the queued messages.
+ */
+struct CanMessageRing {
+    volatile unsigned int head;
+    volatile unsigned int tail;
+    CanMessage elements[CAN_QUEUE_MAX_LENGTH];
+};
+typedef struct CanMessageRing CanMessageRing;
 
 /* Private: An entry in the list of acceptance filters for each CanBus.
  *
@@ -228,17 +300,45 @@ LIST_HEAD(CanMessageDefinitionList, CanMessageDefinitionListEntry);
  *      are no acceptance filters configured.
  * loopback - True if the controller should be configured in loopback mode, so
  *         all sent messages are received immediately on that same controller.
+ * receiveBatchSize - The maximum number of messages to drain from the receive
+ *      queue and translate each time through the main loop. If 0, the
+ *      DEFAULT_CAN_RECEIVE_BATCH_SIZE from the build configuration is used.
+ * receiveTimeBudget - The maximum time in milliseconds to spend translating
+ *      received messages each time through the main loop, even if the batch
+ *      size hasn't been reached. If 0, the DEFAULT_CAN_RECEIVE_TIME_BUDGET_MS
+ *      from the build configuration is used.
+ * receiveQueueSize - The maximum number of received messages to buffer for this
+ *      bus before dropping new ones. If 0 or larger than the
+ *      CAN_QUEUE_MAX_LENGTH from the build configuration, the full queue is
+ *      used.
+ * sendQueueSize - The maximum number of outgoing messages to buffer for this
+ *      bus, with the same defaults as receiveQueueSize.
  *
  * acceptanceFilters - a list of active acceptance filters for this bus.
  * freeAcceptanceFilters - a list of available slots for acceptance filters.
  * acceptanceFilterEntries - static memory allocated for entires in the
  *      acceptanceFilters and freeAcceptanceFilters list.
+ * standardFilterIndex - a bitmap of all standard IDs with an active acceptance
+ *      filter, kept in sync with the acceptanceFilters list so software
+ *      filtering in an interrupt handler doesn't have to walk the list.
+ * extendedFilterIndex - a sorted array of all extended IDs with an active
+ *      acceptance filter, for binary search.
+ * extendedFilterCount - the number of valid entries in extendedFilterIndex.
  * dynamicMessages - a list of CAN message IDs ever received on this bus. This
  *      is used for message frequency control and metrics.
  * freeMessageDefinitions - a list of available slots for dynamic message
  *      definitions.
  * definitionEntries - static memory allocated for entires in the
  *      dynamicMessages and freeMessageDefinitions list.
+ * messageIndex - the predefined and dynamic message definitions for this bus,
+ *      sorted by format and ID for binary search.
+ * messageIndexCount - the number of valid entries in messageIndex.
+ * messageIndexOverflow - the number of definitions that didn't fit in the
+ *      messageIndex. While this is more than 0, lookups for IDs that aren't in
+ *      the index fall back to a linear search.
+ * indexedMessages - the array of predefined messages that was used to build the
+ *      messageIndex, or NULL if no index has been built.
+ * indexedMessageCount - the length of the indexedMessages array.
  * writeHandler - a function that actually writes out a CanMessage object to the
  *      CAN interface (implementation is platform specific);
  * lastMessageReceived - the time (in ms) when the last CAN message was
@@ -247,9 +347,20 @@ LIST_HEAD(CanMessageDefinitionList, CanMessageDefinitionListEntry);
  * messagesDropped - A count of the number of CAN messages we knowingly dropped
  * - i.e. we received an interrupt with a new CAN message but the incoming CAN
  *   message queue was full.
+ * receiveQueueHighWaterMark - The largest number of messages ever waiting in
+ *      the receiveQueue at once, for sizing receiveQueueSize.
+ * sendQueueHighWaterMark - The largest number of messages ever waiting in the
+ *      sendQueue at once.
+ * receiveBatchStats - The number of messages actually drained from the receive
+ *      queue each time through the main loop that any were waiting.
+ * decodeLatency - The time in microseconds from when each message was received
+ *      in the interrupt handler to when it started to be translated.
+ * publishLatency - The time in microseconds from when each message was
+ *      received in the interrupt handler to when everything translated from it
+ *      was published to the output pipeline.
  * sendQueue - a queue of CanMessage instances that need to be written to CAN.
- * receiveQueue - a queue of messages received from CAN that have yet to be
- *      translated.
+ * receiveQueue - a ring of messages received from CAN in an interrupt handler
+ *      that have yet to be translated in the main loop.
  */
 struct CanBus {
     unsigned int speed;
@@ -259,18 +370,32 @@ struct CanBus {
     bool passthroughCanMessages;
     bool bypassFilters;
     bool loopback;
+    unsigned short receiveBatchSize;
+    unsigned short receiveTimeBudget;
+    unsigned short receiveQueueSize;
+    unsigned short sendQueueSize;
 
     // Private
     AcceptanceFilterList acceptanceFilters;
     AcceptanceFilterList freeAcceptanceFilters;
     AcceptanceFilterListEntry acceptanceFilterEntries[MAX_ACCEPTANCE_FILTERS];
+    uint32_t standardFilterIndex[STANDARD_FILTER_INDEX_SIZE];
+    uint32_t extendedFilterIndex[MAX_ACCEPTANCE_FILTERS];
+    uint8_t extendedFilterCount;
     CanMessageDefinitionList dynamicMessages;
     CanMessageDefinitionList freeMessageDefinitions;
     CanMessageDefinitionListEntry definitionEntries[MAX_DYNAMIC_MESSAGE_COUNT];
+    CanMessageDefinition* messageIndex[MAX_MESSAGE_INDEX_SIZE];
+    uint16_t messageIndexCount;
+    uint16_t messageIndexOverflow;
+    const CanMessageDefinition* indexedMessages;
+    int indexedMessageCount;
     bool (*writeHandler)(const CanBus*, const CanMessage*);
     unsigned long lastMessageReceived;
     unsigned int messagesReceived;
     unsigned int messagesDropped;
+    unsigned short receiveQueueHighWaterMark;
+    unsigned short sendQueueHighWaterMark;
 
     // TODO These are unnecessary if you aren't calculating metrics, and they do
     // take up a bit of memory.
@@ -280,12 +405,34 @@ struct CanBus {
     openxc::util::statistics::DeltaStatistic receivedDataStats;
     openxc::util::statistics::Statistic sendQueueStats;
     openxc::util::statistics::Statistic receiveQueueStats;
+    openxc::util::statistics::Statistic receiveBatchStats;
+    openxc::util::statistics::Histogram decodeLatency;
+    openxc::util::statistics::Histogram publishLatency;
 
     QUEUE_TYPE(CanMessage) sendQueue;
-    QUEUE_TYPE(CanMessage) receiveQueue;
+    CanMessageRing receiveQueue;
 };
 typedef struct CanBus CanBus;
 
+/* Public: A reference to a CanSignal by its generic name that is resolved
+ * only once, for handlers that need to find other signals each time a message
+ * is received. Define it with just the name, e.g.
+ *
+ *      static CanSignalReference sign = {"steering_wheel_angle_sign"};
+ *
+ * and then retrieve the signal with lookupSignal(&sign, signals, signalCount).
+ *
+ * genericName - The name of the signal.
+ * signal - The resolved signal, or NULL if it wasn't found.
+ * signals - The signals array the reference was resolved against, or NULL if
+ *      it hasn't been resolved yet.
+ */
+typedef struct {
+    const char* genericName;
+    CanSignal* signal;
+    const CanSignal* signals;
+} CanSignalReference;
+
 /** Public: A parent wrapper for a particular set of CAN messages and associated
  *  CAN buses(e.g. a vehicle or program).
  *
@@ -311,6 +458,50 @@ typedef struct {
 namespace openxc {
 namespace can {
 
+namespace ring {
+
+/* Public: Empty the ring. This must not be called while a producer or
+ * consumer is using it.
+ */
+void initialize(CanMessageRing* ring);
+
+/* Public: Add a message to the ring. Only call this from the producer.
+ *
+ * Returns true if the message was added, false if the ring is full.
+ */
+bool push(CanMessageRing* ring, const CanMessage* message);
+
+/* Public: Remove the oldest message from the ring. Only call this from the
+ * consumer.
+ *
+ * message - A CanMessage to fill with the removed message.
+ *
+ * Returns true if a message was removed, false if the ring is empty.
+ */
+bool pop(CanMessageRing* ring, CanMessage* message);
+
+/* Public: Remove up to a number of the oldest messages from the ring at once,
+ * publishing the new tail to the producer only after all are copied. Only call
+ * this from the consumer.
+ *
+ * messages - An array to fill with the removed messages, oldest first.
+ * maxCount - The length of the messages array.
+ *
+ * Returns the number of messages removed.
+ */
+int popBulk(CanMessageRing* ring, CanMessage messages[], int maxCount);
+
+/* Public: Returns the number of messages in the ring. This is safe to call
+ * from either side, but the producer may add more at any time.
+ */
+int length(CanMessageRing* ring);
+
+/* Public: Returns true if there are no messages in the ring.
+ */
+bool empty(CanMessageRing* ring);
+
+} // namespace ring
+
 extern const int CAN_ACTIVE_TIMEOUT_S;
 
 /* Public: The type signature for a function to handle a custom OpenXC command.
@@ -381,6 +572,50 @@ void deinitialize(CanBus* bus);
  */
 void initializeCommon(CanBus* bus);
 
+/* Public: Determine the maximum number of received messages to process from
+ * the bus in a single pass through the main loop.
+ *
+ * Returns the bus's receiveBatchSize, or DEFAULT_CAN_RECEIVE_BATCH_SIZE if it
+ * isn't set.
+ */
+int receiveBatchSize(CanBus* bus);
+
+/* Public: Determine the maximum time to spend processing received messages
+ * from the bus in a single pass through the main loop.
+ *
+ * Returns the bus's receiveTimeBudget in milliseconds, or
+ * DEFAULT_CAN_RECEIVE_TIME_BUDGET_MS if it isn't set.
+ */
+unsigned int receiveTimeBudget(CanBus* bus);
+
+/* Public: Determine the number of received messages that may be buffered for
+ * the bus.
+ *
+ * Returns the bus's receiveQueueSize, limited to CAN_QUEUE_MAX_LENGTH, or
+ * CAN_QUEUE_MAX_LENGTH if it isn't set.
+ */
+int receiveQueueCapacity(CanBus* bus);
+
+/* Public: Determine the number of outgoing messages that may be buffered for
+ * the bus.
+ *
+ * Returns the bus's sendQueueSize, limited to CAN_QUEUE_MAX_LENGTH, or
+ * CAN_QUEUE_MAX_LENGTH if it isn't set.
+ */
+int sendQueueCapacity(CanBus* bus);
+
+/* Public: Add a message received from the bus to its receive queue, respecting
+ * the bus's receive queue capacity and updating the high-water mark. This is
+ * safe to call from an interrupt handler.
+ *
+ * bus - The bus the message was received on.
+ * message - The received message.
+ *
+ * Returns true if the message was queued, false if the queue was full and the
+ * message was dropped.
+ */
+bool queueReceivedMessage(CanBus* bus, const CanMessage* message);
+
 /* Public: Check if the device is connected to an active CAN bus, i.e. it's
  * received a message in the recent past.
  *
@@ -414,6 +649,43 @@ CanSignal* lookupSignal(const char* name, CanSignal* signals, int signalCount);
 CanSignal* lookupSignal(const char* name, CanSignal* signals, int signalCount,
         bool writable);
 
+/* Public: Resolve a CanSignalReference, searching the signals array by name
+ * only the first time it's used with that array.
+ *
+ * reference - The reference to resolve.
+ * signals - The list of all signals.
+ * signalCount - The length of the signals array.
+ *
+ * Returns a pointer to the CanSignal if found, otherwise NULL.
+ */
+CanSignal* lookupSignal(CanSignalReference* reference, CanSignal* signals,
+        int signalCount);
+
+/* Public: Precompute the bitShift for a signal, so it can be extracted from a
+ * message payload with a single shift and mask instead of being parsed byte by
+ * byte.
+ *
+ * If the signal's bit position and size don't fit within a CAN message, the
+ * signal's bitfieldPrepared is left false.
+ *
+ * signal - The signal to prepare.
+ */
+void prepareSignalBitfield(CanSignal* signal);
+
+/* Public: Record the range of the signals array that belongs to each message
+ * definition (in CanMessageDefinition.signals and signalCount), so a received
+ * message can be decoded without looking at every signal, and prepare the
+ * bitfield of every signal with prepareSignalBitfield(...). Call this once
+ * after the active message set is loaded.
+ *
+ * messages - The list of all message definitions.
+ * messageCount - The length of the messages array.
+ * signals - The list of all signals.
+ * signalCount - The length of the signals array.
+ */
+void indexSignals(CanMessageDefinition* messages, int messageCount,
+        CanSignal* signals, int signalCount);
+
 /* Public: Look up the CanCommand representation of a command based on its
  * generic name.
  *
@@ -449,9 +721,25 @@ const CanSignalState* lookupSignalState(const char* name, const CanSignal* signa
  */
 const CanSignalState* lookupSignalState(int value, const CanSignal* signal);
 
+/* Public: Build an index of the predefined CAN messages on the given bus, so
+ * lookupMessageDefinition(...) can find a message by ID with a binary search
+ * instead of scanning every definition. Dynamic message definitions are added
+ * to and removed from the index as they are registered and unregistered.
+ *
+ * bus - The CanBus to index messages for.
+ * messages - The list of predefined CAN messages. Only those on the bus are
+ *      indexed.
+ * messageCount - The length of the messages array.
+ */
+void indexMessageDefinitions(CanBus* bus, CanMessageDefinition* messages,
+        int messageCount);
+
 /* Public: Search all predefined and dynamically configured CAN messages for one
  * matching the given ID.
  *
+ * If an index was built with indexMessageDefinitions(...) for the same
+ * predefinedMessages array, it is used instead of a linear search.
+ *
  * bus - The CanBus to search for the message.
  * id - The ID of the CAN message.
  * format - The format of the ID of the message.
@@ -622,12 +910,19 @@ void logBusStatistics(CanBus* buses, const int busCount);
  * bus has the AF off but we still want to filter on the other, we use this to
  * do software filtering based on the registered CAN messages.
  *
+ * The check uses an index of the active filters (a bitmap for standard IDs and
+ * a sorted array for extended IDs) instead of walking the filter list, so it's
+ * cheap enough to call from an interrupt handler regardless of the number of
+ * filters.
+ *
  * bus - The bus the message was received on.
  * messageId - the ID of the message.
+ * format - the format of the message's ID.
  *
  * Returns true if the message should be accepted.
  */
-bool shouldAcceptMessage(CanBus* bus, uint32_t messageId);
+bool shouldAcceptMessage(CanBus* bus, uint32_t messageId,
+        CanMessageFormat format);
 
 } // can
 } // openxc
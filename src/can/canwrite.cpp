@@ -51,7 +51,18 @@ void openxc::can::write::enqueueMessage(CanBus* bus, CanMessage* message) {
     memcpy(outgoingMessage.data, message->data, CAN_MESSAGE_SIZE);
     outgoingMessage.length = (uint8_t)(message->length == 0 ?
             CAN_MESSAGE_SIZE : message->length);
-    QUEUE_PUSH(CanMessage, &bus->sendQueue, outgoingMessage);
+
+    int length = QUEUE_LENGTH(CanMessage, &bus->sendQueue);
+    if(length >= sendQueueCapacity(bus) ||
+            !QUEUE_PUSH(CanMessage, &bus->sendQueue, outgoingMessage)) {
+        debug("Dropped outgoing CAN message with ID 0x%x -- queue is full",
+                message->id);
+        return;
+    }
+
+    if(length + 1 > bus->sendQueueHighWaterMark) {
+        bus->sendQueueHighWaterMark = (unsigned short)(length + 1);
+    }
 }
 
 uint64_t openxc::can::write::encodeDynamicField(const CanSignal* signal,
@@ -142,6 +142,9 @@ bool encodeAndSendNumericSignal(CanSignal* signal, float value, bool force);
  * assumed to be 8 (i.e. it will use the entire contents of the 'data' field, so
  * make sure it's all valid or zereod out!).
  *
+ * If the bus's send queue is already at its sendQueueCapacity, the message is
+ * dropped.
+ *
  * bus - the bus to send the message.
  * message - the CAN message this data should be sent in. The byte order of the
  *      data will be reversed.
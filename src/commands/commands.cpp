@@ -15,13 +15,39 @@
 #include "commands/af_bypass_command.h"
 #include "commands/payload_format_command.h"
 #include "commands/predefined_obd2_command.h"
+#include "commands/latency_command.h"
+#include "commands/signal_dictionary_command.h"
 
 using openxc::util::log::debug;
 using openxc::config::getConfiguration;
 using openxc::payload::PayloadFormat;
 using openxc::interface::InterfaceType;
 
-static bool handleComplexCommand(openxc_VehicleMessage* message) {
+/* Private: Handle a control command with one of the firmware-local types,
+ * which can't be listed as cases in a switch on openxc_ControlCommand_Type.
+ */
+static bool handleLocalCommand(openxc_ControlCommand* command) {
+    bool status = false;
+    if(command->type == openxc::commands::LATENCY_COMMAND_TYPE) {
+        status = openxc::commands::handleLatencyCommand();
+    } else if(command->type ==
+            openxc::commands::SIGNAL_DICTIONARY_COMMAND_TYPE) {
+        status = openxc::commands::handleSignalDictionaryCommand();
+    }
+    return status;
+}
+
+/* Private: Validate a control command with one of the firmware-local types.
+ */
+static bool validateLocalCommand(openxc_VehicleMessage* message) {
+    return message->control_command.type ==
+            openxc::commands::LATENCY_COMMAND_TYPE ||
+        message->control_command.type ==
+            openxc::commands::SIGNAL_DICTIONARY_COMMAND_TYPE;
+}
+
+static bool handleComplexCommand(openxc_VehicleMessage* message,
+        openxc::interface::InterfaceDescriptor* sourceInterfaceDescriptor) {
     bool status = true;
     if(message != NULL && message->has_control_command) {
         openxc_ControlCommand* command = &message->control_command;
@@ -45,10 +71,11 @@ static bool handleComplexCommand(openxc_VehicleMessage* message) {
             status = openxc::commands::handleFilterBypassCommand(command);
             break;
         case openxc_ControlCommand_Type_PAYLOAD_FORMAT:
-            status = openxc::commands::handlePayloadFormatCommand(command);
+            status = openxc::commands::handlePayloadFormatCommand(command,
+                    sourceInterfaceDescriptor);
             break;
         default:
-            status = false;
+            status = handleLocalCommand(command);
             break;
         }
     }
@@ -63,7 +90,8 @@ size_t openxc::commands::handleIncomingMessage(uint8_t payload[], size_t length,
     // TODO Not attempting to deserialize binary messages via UART,
     // see https://github.com/openxc/vi-firmware/issues/313
     if(sourceInterfaceDescriptor->type == InterfaceType::UART &&
-            getConfiguration()->payloadFormat == PayloadFormat::PROTOBUF) {
+            sourceInterfaceDescriptor->payloadFormat ==
+                PayloadFormat::PROTOBUF) {
         return 0;
     }
 
@@ -71,7 +99,7 @@ size_t openxc::commands::handleIncomingMessage(uint8_t payload[], size_t length,
     // wait for more to come in before trying to parse it
     if(length > 2) {
         if((bytesRead = openxc::payload::deserialize(payload, length,
-                getConfiguration()->payloadFormat, &message)) > 0) {
+                sourceInterfaceDescriptor->payloadFormat, &message)) > 0) {
             if(validate(&message)) {
                 switch(message.type) {
                 case openxc_VehicleMessage_Type_CAN:
@@ -81,7 +109,7 @@ size_t openxc::commands::handleIncomingMessage(uint8_t payload[], size_t length,
                     handleSimple(&message);
                     break;
                 case openxc_VehicleMessage_Type_CONTROL_COMMAND:
-                    handleComplexCommand(&message);
+                    handleComplexCommand(&message, sourceInterfaceDescriptor);
                     break;
                 default:
                     debug("Incoming message had unrecognized type: %d", message.type);
@@ -95,7 +123,7 @@ size_t openxc::commands::handleIncomingMessage(uint8_t payload[], size_t length,
             // in a couple or bursts and is passed to this function when
             // incomplete.
             // debug("Unable to deserialize a %s message from the payload",
-                 // getConfiguration()->payloadFormat == PayloadFormat::JSON ?
+                 // sourceInterfaceDescriptor->payloadFormat == PayloadFormat::JSON ?
                      // "JSON" : "Protobuf");
         }
     }
@@ -129,7 +157,7 @@ static bool validateControlCommand(openxc_VehicleMessage* message) {
             valid =  true;
             break;
         default:
-            valid = false;
+            valid = validateLocalCommand(message);
             break;
         }
     }
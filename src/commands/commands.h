@@ -12,14 +12,29 @@ namespace commands {
 
 #define CONTROL_COMMAND_REQUEST_ID 0x83
 
+/* Public: Control command types handled by this firmware that aren't (yet)
+ * part of the OpenXC message format. They're numbered well above the types in
+ * openxc_ControlCommand_Type so they won't collide with future additions.
+ */
+const openxc_ControlCommand_Type LATENCY_COMMAND_TYPE =
+        (openxc_ControlCommand_Type) 128;
+const openxc_ControlCommand_Type SIGNAL_DICTIONARY_COMMAND_TYPE =
+        (openxc_ControlCommand_Type) 129;
+
+/* Public: The payload format command value selecting the compact format, which
+ * isn't part of the OpenXC message format either.
+ */
+const openxc_PayloadFormatCommand_PayloadFormat COMPACT_PAYLOAD_FORMAT =
+        (openxc_PayloadFormatCommand_PayloadFormat) 128;
+
 /* Public: Handle a new command received on an I/O interface.
  *
  * This as an implementation of
  * openxc::util::bytebuffer::IncomingMessageCallback so it can be directly
  * passed to any module using that interface (e.g. both USB and UART). It will
- * attempt to deserialize a command from the payload using the currently
- * configured payload format and perform the desired action, if recognized and
- * allowed.
+ * attempt to deserialize a command from the payload using the payload format
+ * of the interface it was received on and perform the desired action, if
+ * recognized and allowed.
  *
  * The complete definition for all of the command is in the OpenXC Message
  * Format (https://github.com/openxc/openxc-message-format).
@@ -0,0 +1,60 @@
+#include "commands/latency_command.h"
+
+#include "commands/commands.h"
+#include "interface/interface.h"
+#include "pipeline.h"
+#include "signals.h"
+#include "util/statistics.h"
+#include <can/canutil.h>
+#include <stdio.h>
+
+using openxc::signals::getCanBuses;
+using openxc::signals::getCanBusCount;
+using openxc::util::statistics::Histogram;
+using openxc::interface::InterfaceDescriptor;
+using openxc::interface::InterfaceType;
+
+namespace statistics = openxc::util::statistics;
+namespace pipeline = openxc::pipeline;
+
+#define LATENCY_INTERFACE_COUNT 3
+
+static void sendLatencyResponse(const char* name, const Histogram* first,
+        const char* firstLabel, const Histogram* second,
+        const char* secondLabel) {
+    char response[128];
+    int length = snprintf(response, sizeof(response), "%s %s %u/%u/%u",
+            name, firstLabel, statistics::percentile(first, 50),
+            statistics::percentile(first, 99), statistics::maximum(first));
+    if(second != NULL && length > 0 && length < (int)sizeof(response)) {
+        length += snprintf(response + length, sizeof(response) - length,
+                " %s %u/%u/%u", secondLabel,
+                statistics::percentile(second, 50),
+                statistics::percentile(second, 99),
+                statistics::maximum(second));
+    }
+    openxc::commands::sendCommandResponse(
+            openxc::commands::LATENCY_COMMAND_TYPE, true, response,
+            sizeof(response));
+}
+
+bool openxc::commands::handleLatencyCommand() {
+    for(int i = 0; i < getCanBusCount(); i++) {
+        CanBus* bus = &getCanBuses()[i];
+        char name[8];
+        snprintf(name, sizeof(name), "can%d", bus->address);
+        sendLatencyResponse(name, &bus->decodeLatency, "decode",
+                &bus->publishLatency, "publish");
+    }
+
+    for(int i = 0; i < LATENCY_INTERFACE_COUNT; i++) {
+        Histogram* flushLatency = pipeline::getFlushLatency((InterfaceType) i);
+        if(flushLatency->count > 0) {
+            InterfaceDescriptor descriptor;
+            descriptor.type = (InterfaceType) i;
+            sendLatencyResponse(descriptorToString(&descriptor), flushLatency,
+                    "flush", NULL, NULL);
+        }
+    }
+    return true;
+}
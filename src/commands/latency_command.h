@@ -0,0 +1,19 @@
+#ifndef __LATENCY_COMMAND_H__
+#define __LATENCY_COMMAND_H__
+
+namespace openxc {
+namespace commands {
+
+/* Public: Respond with the p50, p99 and maximum latency in microseconds
+ * measured for each CAN bus (from the receive interrupt to decode and to
+ * publish) and each output interface (from the receive interrupt to flush).
+ *
+ * The results don't fit in a single command response, so one response is sent
+ * for each bus and for each interface that has recorded any samples.
+ */
+bool handleLatencyCommand();
+
+} // namespace commands
+} // namespace openxc
+
+#endif // __LATENCY_COMMAND_H__
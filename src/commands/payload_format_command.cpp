@@ -1,6 +1,7 @@
 #include "payload_format_command.h"
 
 #include "config.h"
+#include "commands/commands.h"
 #include "util/log.h"
 #include "config.h"
 #include "signals.h"
@@ -27,13 +28,15 @@ bool openxc::commands::validatePayloadFormatCommand(openxc_VehicleMessage* messa
     return valid;
 }
 
-bool openxc::commands::handlePayloadFormatCommand(openxc_ControlCommand* command) {
+bool openxc::commands::handlePayloadFormatCommand(openxc_ControlCommand* command,
+        openxc::interface::InterfaceDescriptor* sourceInterfaceDescriptor) {
     bool status = false;
     PayloadFormat format;
     if(command->has_payload_format_command) {
         openxc_PayloadFormatCommand* messageFormatCommand =
                 &command->payload_format_command;
         if(messageFormatCommand->has_format) {
+            status = true;
             switch(messageFormatCommand->format) {
                 case openxc_PayloadFormatCommand_PayloadFormat_JSON:
                     format = PayloadFormat::JSON;
@@ -41,9 +44,13 @@ bool openxc::commands::handlePayloadFormatCommand(openxc_ControlCommand* command
                 case openxc_PayloadFormatCommand_PayloadFormat_PROTOBUF:
                     format = PayloadFormat::PROTOBUF;
                     break;
+                default:
+                    // The compact format isn't in the message format's enum
+                    format = PayloadFormat::COMPACT;
+                    status = messageFormatCommand->format ==
+                            COMPACT_PAYLOAD_FORMAT;
+                    break;
             }
-
-            status = true;
         }
     }
 
@@ -51,9 +58,11 @@ bool openxc::commands::handlePayloadFormatCommand(openxc_ControlCommand* command
 
     if(status) {
         // Don't change format until we've sent the response
-        getConfiguration()->payloadFormat = format;
-        debug("Set message format to %s",
-                format == PayloadFormat::JSON ? "JSON" : "binary" );
+        sourceInterfaceDescriptor->payloadFormat = format;
+        debug("Set %s message format to %s",
+                openxc::interface::descriptorToString(sourceInterfaceDescriptor),
+                format == PayloadFormat::JSON ? "JSON" :
+                    (format == PayloadFormat::PROTOBUF ? "binary" : "compact"));
     }
 
     return status;
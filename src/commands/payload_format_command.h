@@ -2,13 +2,18 @@
 #define __PAYLOAD_FORMAT_COMMAND_H__
 
 #include "openxc.pb.h"
+#include "interface/interface.h"
 
 namespace openxc {
 namespace commands {
 
 bool validatePayloadFormatCommand(openxc_VehicleMessage* message);
 
-bool handlePayloadFormatCommand(openxc_ControlCommand* command);
+/* Public: Change the payload format of the interface the command was received
+ * on. Other interfaces keep their own format.
+ */
+bool handlePayloadFormatCommand(openxc_ControlCommand* command,
+        openxc::interface::InterfaceDescriptor* sourceInterfaceDescriptor);
 
 } // namespace commands
 } // namespace openxc
@@ -0,0 +1,47 @@
+#include "commands/signal_dictionary_command.h"
+
+#include "commands/commands.h"
+#include "signals.h"
+#include <can/canutil.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+
+using openxc::signals::getSignals;
+using openxc::signals::getSignalCount;
+
+#define SIGNAL_DICTIONARY_RESPONSE_SIZE 128
+
+static void sendDictionaryResponse(char* response, int length) {
+    openxc::commands::sendCommandResponse(
+            openxc::commands::SIGNAL_DICTIONARY_COMMAND_TYPE, true, response,
+            length);
+}
+
+bool openxc::commands::handleSignalDictionaryCommand() {
+    for(int i = 0; i < getSignalCount(); i++) {
+        CanSignal* signal = &getSignals()[i];
+        char response[SIGNAL_DICTIONARY_RESPONSE_SIZE];
+        int prefixLength = snprintf(response, sizeof(response), "%d %s", i,
+                signal->genericName);
+        if(prefixLength < 0 || prefixLength >= (int)sizeof(response)) {
+            continue;
+        }
+
+        int length = prefixLength;
+        for(int j = 0; j < signal->stateCount; j++) {
+            int stateLength = strlen(signal->states[j].name) + 1;
+            if(length + stateLength >= (int)sizeof(response) &&
+                    length > prefixLength) {
+                sendDictionaryResponse(response, length);
+                length = prefixLength;
+            }
+
+            length += snprintf(response + length, sizeof(response) - length,
+                    " %s", signal->states[j].name);
+            length = MIN(length, (int)sizeof(response) - 1);
+        }
+        sendDictionaryResponse(response, length);
+    }
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef __SIGNAL_DICTIONARY_COMMAND_H__
+#define __SIGNAL_DICTIONARY_COMMAND_H__
+
+namespace openxc {
+namespace commands {
+
+/* Public: Respond with the index, name and states of every signal in the active
+ * message set, so a host can decode the compact payload format.
+ *
+ * One response is sent per signal, with the message "<index> <name>" followed
+ * by the signal's states separated by spaces, in the order of their indexes.
+ * If the states don't all fit in one response, the rest are sent in more
+ * responses starting with the same index and name.
+ */
+bool handleSignalDictionaryCommand();
+
+} // namespace commands
+} // namespace openxc
+
+#endif // __SIGNAL_DICTIONARY_COMMAND_H__
@@ -4,6 +4,7 @@
 using openxc::pipeline::Pipeline;
 using openxc::interface::uart::UartDevice;
 using openxc::payload::PayloadFormat;
+using openxc::interface::OverflowPolicy;
 
 namespace usb = openxc::interface::usb;
 
@@ -24,31 +25,39 @@ openxc::config::Configuration* openxc::config::getConfiguration() {
     static openxc::config::Configuration CONFIG = {
         messageSetIndex: 0,
         version: "7.0.1-dev",
-        payloadFormat: PayloadFormat::DEFAULT_OUTPUT_FORMAT,
         recurringObd2Requests: DEFAULT_RECURRING_OBD2_REQUESTS_STATUS,
+        adaptiveObd2Requests: DEFAULT_ADAPTIVE_OBD2_REQUESTS_STATUS,
         obd2BusAddress: DEFAULT_OBD2_BUS,
         powerManagement: PowerManagement::DEFAULT_POWER_MANAGEMENT,
         sendCanAcks: DEFAULT_CAN_ACK_STATUS,
         emulatedData: DEFAULT_EMULATED_DATA_STATUS,
         loggingOutput: DEFAULT_LOGGING_OUTPUT,
         calculateMetrics: DEFAULT_METRICS_STATUS,
+        integerDecoding: DEFAULT_INTEGER_DECODE_STATUS,
+        messageTimestamps: DEFAULT_MESSAGE_TIMESTAMP_STATUS,
         desiredRunLevel: RunLevel::CAN_ONLY,
         initialized: false,
         runLevel: RunLevel::NOT_RUNNING,
         uart: {
             descriptor: {
-                allowRawWrites: DEFAULT_ALLOW_RAW_WRITE_UART
+                allowRawWrites: DEFAULT_ALLOW_RAW_WRITE_UART,
+                overflowPolicy: OverflowPolicy::DEFAULT_OVERFLOW_POLICY_UART,
+                payloadFormat: PayloadFormat::DEFAULT_OUTPUT_FORMAT_UART
             },
             baudRate: UART_BAUD_RATE
         },
         network: {
             descriptor: {
-                allowRawWrites: DEFAULT_ALLOW_RAW_WRITE_NETWORK
+                allowRawWrites: DEFAULT_ALLOW_RAW_WRITE_NETWORK,
+                overflowPolicy: OverflowPolicy::DEFAULT_OVERFLOW_POLICY_NETWORK,
+                payloadFormat: PayloadFormat::DEFAULT_OUTPUT_FORMAT_NETWORK
             }
         },
         usb: {
             descriptor: {
-                allowRawWrites: DEFAULT_ALLOW_RAW_WRITE_USB
+                allowRawWrites: DEFAULT_ALLOW_RAW_WRITE_USB,
+                overflowPolicy: OverflowPolicy::DEFAULT_OVERFLOW_POLICY_USB,
+                payloadFormat: PayloadFormat::DEFAULT_OUTPUT_FORMAT_USB
             },
             endpoints: {
                 {IN_ENDPOINT_NUMBER, DATA_ENDPOINT_SIZE,
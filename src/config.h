@@ -75,11 +75,12 @@ typedef enum {
  * messageSetIndex - The index of the currently active message set from the
  *      signals module.
  * version - A string describing the firmware version.
- * payloadFormat - The currently active payload format, from the payload module.
- *      This is used for both input and output.
  * recurringObd2Requests - True if the VI should automatically query for
  * supported OBD-II pids and request them at a pre-defined frequency (in the
  *      diagnostics::obd2 module).
+ * adaptiveObd2Requests - True if the automatic OBD-II requests should be sent
+ *      more often while their values are changing and less often while they
+ *      are steady, instead of always at their pre-defined frequency.
  * obd2BusAddress - If 0, OBD-II requests will not be sent. Otherwise, they will
  *      be sent on the bus with this controller address (i.e. 1 or 2).
  * powerManagement - The active power management mode.
@@ -92,6 +93,12 @@ typedef enum {
  * calculateMetrics - If true, metrics on CAN bus and I/O activity will be
  *      calculated and logged. This has serious performance implications at the
  *      moment.
+ * integerDecoding - If true, signals without a custom decoder are compared
+ *      with their previous value as raw integers, and only scaled by their
+ *      factor and offset when the value changes, to avoid floating point math
+ *      for every received message. See the can::read module.
+ * messageTimestamps - If true, messages translated from a received CAN message
+ *      include the time it was received, in microseconds since startup.
  * desiredRunLevel - The desired run level. If this is different from the
  *      current run level, the main loop will make the changes necessary.
  *
@@ -107,14 +114,16 @@ typedef enum {
 typedef struct {
     int messageSetIndex;
     const char* version;
-    openxc::payload::PayloadFormat payloadFormat;
     bool recurringObd2Requests;
+    bool adaptiveObd2Requests;
     uint8_t obd2BusAddress;
     PowerManagement powerManagement;
     bool sendCanAcks;
     bool emulatedData;
     LoggingOutputInterface loggingOutput;
     bool calculateMetrics;
+    bool integerDecoding;
+    bool messageTimestamps;
     RunLevel desiredRunLevel;
     bool initialized;
     RunLevel runLevel;
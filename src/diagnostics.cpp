@@ -5,17 +5,31 @@
 #include "util/log.h"
 #include "util/timer.h"
 #include "obd2.h"
+#include "config.h"
 #include <bitfield/bitfield.h>
 #include <limits.h>
 
 #define MAX_RECURRING_DIAGNOSTIC_FREQUENCY_HZ 10
 #define DIAGNOSTIC_RESPONSE_ARBITRATION_ID_OFFSET 0x8
+#define DIAGNOSTIC_STATS_LOG_FREQUENCY_S 15
+#define MS_PER_SECOND 1000
+// The allowance in a DiagnosticSchedule is kept in thousandths of a request, so
+// it can be topped up every millisecond without rounding away.
+#define REQUEST_ALLOWANCE_UNIT 1000
+// How long to wait for a response from a module we don't know anything about,
+// and for responses to requests that may get more than one.
+#define DIAGNOSTIC_INITIAL_TIMEOUT_MS 100
+#define UDS_READ_DATA_BY_IDENTIFIER_MODE 0x22
 
 using openxc::diagnostics::ActiveDiagnosticRequest;
+using openxc::diagnostics::DiagnosticSchedule;
+using openxc::diagnostics::DiagnosticLatency;
+using openxc::diagnostics::DiagnosticValue;
 using openxc::diagnostics::DiagnosticsManager;
 using openxc::diagnostics::DiagnosticResponseDecoder;
 using openxc::diagnostics::DiagnosticResponseCallback;
 using openxc::diagnostics::passthroughDecoder;
+using openxc::diagnostics::responseTimeout;
 using openxc::util::log::debug;
 using openxc::can::lookupBus;
 using openxc::can::addAcceptanceFilter;
@@ -26,12 +40,13 @@ using openxc::signals::getCanBuses;
 using openxc::signals::getCanBusCount;
 
 namespace time = openxc::util::time;
+namespace statistics = openxc::util::statistics;
 namespace pipeline = openxc::pipeline;
 namespace obd2 = openxc::diagnostics::obd2;
 
 static bool timedOut(ActiveDiagnosticRequest* request) {
-    // don't use staggered start with the timeout clock
-    return time::elapsed(&request->timeoutClock, false);
+    return time::systemTimeMs() - request->timeoutClock.lastTick >=
+            request->timeout;
 }
 
 /* Private: Returns true if a sufficient response has been received for a
@@ -39,7 +54,7 @@ static bool timedOut(ActiveDiagnosticRequest* request) {
  *
  * This is true when at least one response has been received and the request is
  * configured to not wait for multiple responses. Functional broadcast requests
- * may often wish to wait the full 100ms for modules to respond.
+ * may often wish to wait the full timeout for modules to respond.
  */
 static bool responseReceived(ActiveDiagnosticRequest* request) {
     return !request->waitForMultipleResponses &&
@@ -54,11 +69,252 @@ static bool requestCompleted(ActiveDiagnosticRequest* request) {
             timedOut(request) && diagnostic_request_sent(&request->handle));
 }
 
+static bool isFunctionalResponse(uint32_t arbitrationId) {
+    return arbitrationId >= OBD2_FUNCTIONAL_RESPONSE_START &&
+            arbitrationId < OBD2_FUNCTIONAL_RESPONSE_START +
+                OBD2_FUNCTIONAL_RESPONSE_COUNT;
+}
+
+/* Private: Return the list of in-flight requests on the bus that a response with
+ * this arbitration ID could be for, other than functional broadcast requests,
+ * or NULL if the bus isn't one the manager has shims for.
+ */
+static DiagnosticRequestList* lookupInFlightBucket(DiagnosticsManager* manager,
+        const CanBus* bus, uint32_t responseArbitrationId) {
+    if(bus->address < 1 || bus->address > MAX_SHIM_COUNT) {
+        return NULL;
+    }
+    return &manager->inFlightRequests[bus->address - 1][
+            responseArbitrationId % DIAGNOSTIC_RESPONSE_BUCKET_COUNT];
+}
+
+/* Private: Mark the request as in flight and add it to the index the response
+ * will be looked up in.
+ */
+static void markInFlight(DiagnosticsManager* manager,
+        ActiveDiagnosticRequest* entry) {
+    DiagnosticRequestList* list = NULL;
+    if(entry->arbitration_id == OBD2_FUNCTIONAL_BROADCAST_ID) {
+        if(entry->bus->address >= 1 && entry->bus->address <= MAX_SHIM_COUNT) {
+            list = &manager->inFlightFunctionalRequests[
+                    entry->bus->address - 1];
+        }
+    } else {
+        list = lookupInFlightBucket(manager, entry->bus,
+                entry->arbitration_id +
+                    DIAGNOSTIC_RESPONSE_ARBITRATION_ID_OFFSET);
+    }
+
+    if(list != NULL) {
+        LIST_INSERT_HEAD(list, entry, responseEntries);
+        entry->inFlight = true;
+    }
+}
+
+/* Private: If the request is in flight, stop waiting for its response.
+ */
+static void clearInFlight(ActiveDiagnosticRequest* entry) {
+    if(entry->inFlight) {
+        LIST_REMOVE(entry, responseEntries);
+        entry->inFlight = false;
+    }
+}
+
+/* Private: Return the schedule for recurring requests on the bus, or NULL if the
+ * bus isn't one the manager has shims for.
+ */
+static DiagnosticSchedule* lookupSchedule(DiagnosticsManager* manager,
+        const CanBus* bus) {
+    if(bus->address < 1 || bus->address > MAX_SHIM_COUNT) {
+        return NULL;
+    }
+    return &manager->schedules[bus->address - 1];
+}
+
+static void swapScheduled(DiagnosticSchedule* schedule, int first,
+        int second) {
+    ActiveDiagnosticRequest* entry = schedule->requests[first];
+    schedule->requests[first] = schedule->requests[second];
+    schedule->requests[second] = entry;
+    schedule->requests[first]->scheduleIndex = first;
+    schedule->requests[second]->scheduleIndex = second;
+}
+
+static bool dueBefore(const ActiveDiagnosticRequest* entry,
+        const ActiveDiagnosticRequest* other) {
+    return entry->nextSendTime < other->nextSendTime;
+}
+
+static void siftUp(DiagnosticSchedule* schedule, int index) {
+    while(index > 0) {
+        int parent = (index - 1) / 2;
+        if(!dueBefore(schedule->requests[index], schedule->requests[parent])) {
+            break;
+        }
+        swapScheduled(schedule, index, parent);
+        index = parent;
+    }
+}
+
+static void siftDown(DiagnosticSchedule* schedule, int index) {
+    while(true) {
+        int earliest = index;
+        int left = index * 2 + 1;
+        int right = left + 1;
+        if(left < schedule->size && dueBefore(schedule->requests[left],
+                    schedule->requests[earliest])) {
+            earliest = left;
+        }
+        if(right < schedule->size && dueBefore(schedule->requests[right],
+                    schedule->requests[earliest])) {
+            earliest = right;
+        }
+        if(earliest == index) {
+            break;
+        }
+        swapScheduled(schedule, index, earliest);
+        index = earliest;
+    }
+}
+
+static void scheduleRequest(DiagnosticsManager* manager,
+        ActiveDiagnosticRequest* entry) {
+    DiagnosticSchedule* schedule = lookupSchedule(manager, entry->bus);
+    if(schedule != NULL && schedule->size < MAX_SIMULTANEOUS_DIAG_REQUESTS) {
+        entry->scheduleIndex = schedule->size++;
+        schedule->requests[entry->scheduleIndex] = entry;
+        siftUp(schedule, entry->scheduleIndex);
+    }
+}
+
+static void unscheduleRequest(DiagnosticsManager* manager,
+        ActiveDiagnosticRequest* entry) {
+    DiagnosticSchedule* schedule = lookupSchedule(manager, entry->bus);
+    if(schedule != NULL && entry->scheduleIndex >= 0) {
+        int index = entry->scheduleIndex;
+        schedule->size--;
+        if(index != schedule->size) {
+            swapScheduled(schedule, index, schedule->size);
+            siftDown(schedule, index);
+            siftUp(schedule, index);
+        }
+        entry->scheduleIndex = -1;
+    }
+}
+
+/* Private: Return the number of requests per second the schedule's bus may
+ * carry.
+ */
+static unsigned int requestBudget(const DiagnosticSchedule* schedule) {
+    return schedule->requestsPerSecond > 0 ? schedule->requestsPerSecond :
+            DEFAULT_DIAGNOSTIC_REQUEST_BUDGET;
+}
+
+/* Private: Top up the schedule's allowance for the time since it was last
+ * checked, and return true if there is enough left to send a request.
+ */
+static bool budgetAvailable(DiagnosticSchedule* schedule) {
+    unsigned long now = time::systemTimeMs();
+    unsigned long capacity = requestBudget(schedule) * REQUEST_ALLOWANCE_UNIT;
+    if(schedule->allowance < capacity) {
+        // Each millisecond adds a thousandth of the per-second budget, which
+        // is the budget itself in thousandths of a request.
+        unsigned long refill = (now - schedule->lastRefill) *
+                requestBudget(schedule);
+        schedule->allowance = refill >= capacity - schedule->allowance ?
+                capacity : schedule->allowance + refill;
+    } else {
+        schedule->allowance = capacity;
+    }
+    schedule->lastRefill = now;
+    return schedule->allowance >= REQUEST_ALLOWANCE_UNIT;
+}
+
+/* Private: Return true if the request's timeout is a window to collect
+ * responses from any number of modules in, rather than how long to wait for the
+ * one module it was sent to.
+ */
+static bool collectsResponses(const ActiveDiagnosticRequest* request) {
+    return request->waitForMultipleResponses ||
+            request->arbitration_id == OBD2_FUNCTIONAL_BROADCAST_ID;
+}
+
+/* Private: Return the response time estimate slot for the module the request
+ * is sent to, or NULL if the bus isn't one the manager has shims for. The slot
+ * may belong to another module if their arbitration IDs collide.
+ */
+static DiagnosticLatency* lookupLatency(DiagnosticsManager* manager,
+        const ActiveDiagnosticRequest* request) {
+    if(request->bus->address < 1 || request->bus->address > MAX_SHIM_COUNT) {
+        return NULL;
+    }
+    return &manager->latencies[request->bus->address - 1][
+            request->arbitration_id % DIAGNOSTIC_LATENCY_SLOT_COUNT];
+}
+
+static unsigned int limitTimeout(float timeout) {
+    if(timeout < DEFAULT_DIAGNOSTIC_TIMEOUT_FLOOR_MS) {
+        return DEFAULT_DIAGNOSTIC_TIMEOUT_FLOOR_MS;
+    } else if(timeout > DEFAULT_DIAGNOSTIC_TIMEOUT_CEILING_MS) {
+        return DEFAULT_DIAGNOSTIC_TIMEOUT_CEILING_MS;
+    }
+    return timeout;
+}
+
+/* Private: Update the response time estimate for the request's module with the
+ * time since the request was sent.
+ */
+static void recordResponseTime(DiagnosticsManager* manager,
+        ActiveDiagnosticRequest* request) {
+    DiagnosticLatency* latency = lookupLatency(manager, request);
+    if(latency == NULL || collectsResponses(request)) {
+        return;
+    }
+
+    float responseTime = time::systemTimeMs() -
+            request->timeoutClock.lastTick;
+    if(latency->arbitrationId != request->arbitration_id || (
+                latency->smoothedResponseTime == 0 &&
+                latency->responseTimeVariation == 0)) {
+        latency->arbitrationId = request->arbitration_id;
+        latency->smoothedResponseTime = responseTime;
+        latency->responseTimeVariation = responseTime / 2;
+    } else {
+        float deviation = latency->smoothedResponseTime - responseTime;
+        latency->responseTimeVariation = .75 *
+                latency->responseTimeVariation +
+                .25 * (deviation < 0 ? -deviation : deviation);
+        latency->smoothedResponseTime = .875 * latency->smoothedResponseTime +
+                .125 * responseTime;
+    }
+    latency->timeout = limitTimeout(latency->smoothedResponseTime +
+            4 * latency->responseTimeVariation);
+}
+
+/* Private: Back off the timeout for the request's module after a request to it
+ * got no response at all, in case it's just slower than we thought.
+ */
+static void recordTimeout(DiagnosticsManager* manager,
+        ActiveDiagnosticRequest* request) {
+    DiagnosticLatency* latency = lookupLatency(manager, request);
+    if(latency != NULL && !collectsResponses(request)) {
+        unsigned int timeout = responseTimeout(manager, request);
+        if(latency->arbitrationId != request->arbitration_id) {
+            latency->arbitrationId = request->arbitration_id;
+            latency->smoothedResponseTime = 0;
+            latency->responseTimeVariation = 0;
+        }
+        latency->timeout = limitTimeout(timeout * 2);
+    }
+}
+
 /* Private: Move the entry to the free list and decrement the lock count for any
  * CAN filters it used.
  */
 static void cancelRequest(DiagnosticsManager* manager,
         ActiveDiagnosticRequest* entry) {
+    clearInFlight(entry);
+    unscheduleRequest(manager, entry);
     LIST_INSERT_HEAD(&manager->freeRequestEntries, entry, listEntries);
     if(entry->arbitration_id == OBD2_FUNCTIONAL_BROADCAST_ID) {
         for(uint32_t filter = OBD2_FUNCTIONAL_RESPONSE_START;
@@ -80,20 +336,20 @@ static void cancelRequest(DiagnosticsManager* manager,
 static void cleanupRequest(DiagnosticsManager* manager,
         ActiveDiagnosticRequest* entry, bool force) {
     if(force || (entry->inFlight && requestCompleted(entry))) {
-        entry->inFlight = false;
+        if(!force && !entry->handle.completed) {
+            recordTimeout(manager, entry);
+        }
+        clearInFlight(entry);
 
         char request_string[128] = {0};
         diagnostic_request_to_string(&entry->handle.request,
                 request_string, sizeof(request_string));
         if(entry->recurring) {
-            TAILQ_REMOVE(&manager->recurringRequests, entry, queueEntries);
             if(force) {
+                TAILQ_REMOVE(&manager->recurringRequests, entry, queueEntries);
                 cancelRequest(manager, entry);
             } else {
-                debug("Moving completed recurring request to the back "
-                        "of the queue: %s", request_string);
-                TAILQ_INSERT_TAIL(&manager->recurringRequests, entry,
-                        queueEntries);
+                debug("Completed recurring request: %s", request_string);
             }
         } else {
             debug("Cancelling completed, non-recurring request: %s",
@@ -154,6 +410,20 @@ void openxc::diagnostics::reset(DiagnosticsManager* manager) {
     TAILQ_INIT(&manager->recurringRequests);
     LIST_INIT(&manager->nonrecurringRequests);
     LIST_INIT(&manager->freeRequestEntries);
+    for(int bus = 0; bus < MAX_SHIM_COUNT; bus++) {
+        for(int bucket = 0; bucket < DIAGNOSTIC_RESPONSE_BUCKET_COUNT;
+                bucket++) {
+            LIST_INIT(&manager->inFlightRequests[bus][bucket]);
+        }
+        LIST_INIT(&manager->inFlightFunctionalRequests[bus]);
+
+        DiagnosticSchedule* schedule = &manager->schedules[bus];
+        schedule->size = 0;
+        // Start with a full allowance - budgetAvailable(...) caps it to the
+        // bus's budget.
+        schedule->allowance = ULONG_MAX;
+        schedule->lastRefill = time::systemTimeMs();
+    }
 
     for(int i = 0; i < MAX_SIMULTANEOUS_DIAG_REQUESTS; i++) {
         LIST_INSERT_HEAD(&manager->freeRequestEntries,
@@ -173,6 +443,7 @@ void openxc::diagnostics::initialize(DiagnosticsManager* manager, CanBus* buses,
         }
     }
 
+    memset(manager->latencies, 0, sizeof(manager->latencies));
     reset(manager);
     manager->initialized = true;
 
@@ -181,56 +452,75 @@ void openxc::diagnostics::initialize(DiagnosticsManager* manager, CanBus* buses,
     debug("Initialized diagnostics");
 }
 
-static inline bool conflicting(ActiveDiagnosticRequest* request,
-        ActiveDiagnosticRequest* candidate) {
-    return (candidate->inFlight && candidate != request &&
-            candidate->bus == request->bus &&
-            candidate->arbitration_id == request->arbitration_id);
-}
-
-
-/* Private: Returns true if there are no other active requests to the same arb
- * ID.
+/* Private: Returns true if there are no other requests to the same arb ID in
+ * flight on the request's bus.
  */
-static inline bool clearToSend(DiagnosticsManager* manager,
+static bool clearToSend(DiagnosticsManager* manager,
         ActiveDiagnosticRequest* request) {
-    ActiveDiagnosticRequest* entry;
-    LIST_FOREACH(entry, &manager->nonrecurringRequests, listEntries) {
-        if(conflicting(request, entry)) {
-            return false;
-        }
+    if(request->arbitration_id == OBD2_FUNCTIONAL_BROADCAST_ID) {
+        return request->bus->address < 1 ||
+                request->bus->address > MAX_SHIM_COUNT ||
+                LIST_EMPTY(&manager->inFlightFunctionalRequests[
+                    request->bus->address - 1]);
     }
 
-    TAILQ_FOREACH(entry, &manager->recurringRequests, queueEntries) {
-        if(conflicting(request, entry)) {
-            return false;
+    DiagnosticRequestList* bucket = lookupInFlightBucket(manager,
+            request->bus, request->arbitration_id +
+                DIAGNOSTIC_RESPONSE_ARBITRATION_ID_OFFSET);
+    if(bucket != NULL) {
+        ActiveDiagnosticRequest* entry;
+        LIST_FOREACH(entry, bucket, responseEntries) {
+            if(entry != request &&
+                    entry->arbitration_id == request->arbitration_id) {
+                return false;
+            }
         }
     }
     return true;
 }
 
 static inline bool shouldSend(ActiveDiagnosticRequest* request) {
-    return !request->inFlight && (
-            (!request->recurring && !requestCompleted(request)) ||
-            (request->recurring && time::elapsed(&request->frequencyClock,
-                                                 true)));
+    return !request->inFlight && !requestCompleted(request);
+}
+
+/* Private: Return the time in milliseconds between sends of a request at the
+ * frequency, at least 1 so it can be used as a divisor.
+ */
+static unsigned long sendPeriod(float frequencyHz) {
+    unsigned long period = MS_PER_SECOND / frequencyHz;
+    return period > 0 ? period : 1;
+}
+
+/* Private: Return the time a recurring request that was sent now is next due.
+ *
+ * Sends are kept on the request's original cadence unless it has fallen a whole
+ * period behind, in which case it starts again from now rather than sending a
+ * burst to catch up.
+ */
+static unsigned long nextSendTime(ActiveDiagnosticRequest* request,
+        unsigned long now) {
+    unsigned long period = sendPeriod(request->frequencyClock.frequency);
+    unsigned long next = request->nextSendTime + period;
+    return next > now ? next : now + period;
 }
 
 static void sendRequest(DiagnosticsManager* manager, CanBus* bus,
-        ActiveDiagnosticRequest* request) {
-    if(request->bus == bus && shouldSend(request) &&
-            clearToSend(manager, request)) {
-        time::tick(&request->frequencyClock);
-        start_diagnostic_request(&manager->shims[bus->address - 1],
-                &request->handle);
-        if(request->handle.completed && !request->handle.success) {
-            debug("Fatal error sending diagnostic request");
-        } else {
-            request->timeoutClock = {0};
-            request->timeoutClock.frequency = 10;
-            time::tick(&request->timeoutClock);
-            request->inFlight = true;
-        }
+        DiagnosticSchedule* schedule, ActiveDiagnosticRequest* request) {
+    if(request->recurring && request->frequencyClock.lastTick != 0) {
+        statistics::update(&request->sendPeriodStats,
+                time::systemTimeMs() - request->frequencyClock.lastTick);
+    }
+    time::tick(&request->frequencyClock);
+    start_diagnostic_request(&manager->shims[bus->address - 1],
+            &request->handle);
+    if(request->handle.completed && !request->handle.success) {
+        debug("Fatal error sending diagnostic request");
+    } else {
+        schedule->allowance -= REQUEST_ALLOWANCE_UNIT;
+        request->timeoutClock = {0};
+        request->timeout = responseTimeout(manager, request);
+        time::tick(&request->timeoutClock);
+        markInFlight(manager, request);
     }
 }
 
@@ -238,18 +528,46 @@ void openxc::diagnostics::sendRequests(DiagnosticsManager* manager,
         CanBus* bus) {
     cleanupActiveRequests(manager, false);
 
+    DiagnosticSchedule* schedule = lookupSchedule(manager, bus);
+    if(schedule == NULL) {
+        return;
+    }
+
     ActiveDiagnosticRequest* entry;
     LIST_FOREACH(entry, &manager->nonrecurringRequests, listEntries) {
-        sendRequest(manager, bus, entry);
+        if(entry->bus == bus && shouldSend(entry) &&
+                clearToSend(manager, entry) && budgetAvailable(schedule)) {
+            sendRequest(manager, bus, schedule, entry);
+        }
     }
 
-    TAILQ_FOREACH(entry, &manager->recurringRequests, queueEntries) {
-        sendRequest(manager, bus, entry);
+    // Requests that are due but can't go out yet because their ECU is busy are
+    // set aside, and go back in the schedule with the same due time so they
+    // are first in line next time.
+    ActiveDiagnosticRequest* deferred[MAX_SIMULTANEOUS_DIAG_REQUESTS];
+    int deferredCount = 0;
+    unsigned long now = time::systemTimeMs();
+    while(schedule->size > 0 && schedule->requests[0]->nextSendTime <= now &&
+            budgetAvailable(schedule)) {
+        entry = schedule->requests[0];
+        unscheduleRequest(manager, entry);
+        if(!entry->inFlight && clearToSend(manager, entry)) {
+            sendRequest(manager, bus, schedule, entry);
+            entry->nextSendTime = nextSendTime(entry, now);
+            scheduleRequest(manager, entry);
+        } else {
+            deferred[deferredCount++] = entry;
+        }
+    }
+
+    for(int i = 0; i < deferredCount; i++) {
+        scheduleRequest(manager, deferred[i]);
     }
 }
 
 static openxc_VehicleMessage wrapDiagnosticResponseWithSabot(CanBus* bus,
         const ActiveDiagnosticRequest* request,
+        const DiagnosticResponseDecoder decoder,
         const DiagnosticResponse* response, float parsedValue) {
     openxc_VehicleMessage message = {0};
     message.has_type = true;
@@ -283,7 +601,7 @@ static openxc_VehicleMessage wrapDiagnosticResponseWithSabot(CanBus* bus,
             response->negative_response_code;
 
     if(response->payload_length > 0) {
-        if(request->decoder != NULL)  {
+        if(decoder != NULL)  {
             message.diagnostic_response.has_value = true;
             message.diagnostic_response.value = parsedValue;
         } else {
@@ -297,25 +615,30 @@ static openxc_VehicleMessage wrapDiagnosticResponseWithSabot(CanBus* bus,
     return message;
 }
 
-static void relayDiagnosticResponse(DiagnosticsManager* manager,
-        ActiveDiagnosticRequest* request,
+/* Private: Publish a response (or one value of a grouped response) with the
+ * given name and decoder, and pass it on to the request's callback.
+ */
+static void relayValue(DiagnosticsManager* manager,
+        ActiveDiagnosticRequest* request, const char* name,
+        const DiagnosticResponseDecoder decoder,
         const DiagnosticResponse* response, Pipeline* pipeline) {
     float value = diagnostic_payload_to_integer(response);
-    if(request->decoder != NULL) {
-        value = request->decoder(response, value);
+    if(decoder != NULL) {
+        value = decoder(response, value);
     }
 
-    if(response->success && strnlen(request->name, sizeof(request->name)) > 0) {
+    if(response->success && name != NULL &&
+            strnlen(name, MAX_GENERIC_NAME_LENGTH) > 0) {
         // If name, include 'value' instead of payload, and leave of response
         // details.
-        publishNumericalMessage(request->name, value, pipeline);
+        publishNumericalMessage(name, value, pipeline);
     } else {
         // If no name, send full details of response but still include 'value'
         // instead of 'payload' if they provided a decoder. The one case you
         // can't get is the full detailed response with 'value'. We could add
         // another parameter for that but it's onerous to carry that around.
         openxc_VehicleMessage message = wrapDiagnosticResponseWithSabot(
-                request->bus, request, response, value);
+                request->bus, request, decoder, response, value);
         pipeline::publish(&message, pipeline);
     }
 
@@ -324,6 +647,78 @@ static void relayDiagnosticResponse(DiagnosticsManager* manager,
     }
 }
 
+static const DiagnosticValue* lookupValue(
+        const ActiveDiagnosticRequest* request, uint16_t identifier) {
+    for(int i = 0; i < request->valueCount; i++) {
+        if(request->values[i].identifier == identifier) {
+            return &request->values[i];
+        }
+    }
+    return NULL;
+}
+
+/* Private: Split a successful response to a grouped request into its values
+ * and relay each one as if it were the response to a single PID request, then
+ * notify the request's grouped callback.
+ *
+ * The response's PID is the first identifier, and the payload has that
+ * value's data followed by each of the other identifiers and their data, in
+ * whatever order the module chose.
+ */
+static void relayGroupedResponse(DiagnosticsManager* manager,
+        ActiveDiagnosticRequest* request,
+        const DiagnosticResponse* response, Pipeline* pipeline) {
+    uint8_t identifierLength = request->handle.request.pid_length;
+    uint16_t identifier = response->pid;
+    int position = 0;
+    while(true) {
+        const DiagnosticValue* value = lookupValue(request, identifier);
+        if(value == NULL ||
+                position + value->length > response->payload_length) {
+            debug("Unexpected PID 0x%x in grouped diagnostic response",
+                    identifier);
+            break;
+        }
+
+        DiagnosticResponse valueResponse = *response;
+        valueResponse.pid = identifier;
+        memcpy(valueResponse.payload, &response->payload[position],
+                value->length);
+        valueResponse.payload_length = value->length;
+        relayValue(manager, request, value->name, value->decoder,
+                &valueResponse, pipeline);
+
+        position += value->length;
+        if(position + identifierLength > response->payload_length) {
+            break;
+        }
+
+        identifier = 0;
+        for(int i = 0; i < identifierLength; i++) {
+            identifier = (identifier << CHAR_BIT) |
+                    response->payload[position++];
+        }
+    }
+
+    if(request->groupedCallback != NULL) {
+        request->groupedCallback(manager, request, response);
+    }
+}
+
+static void relayDiagnosticResponse(DiagnosticsManager* manager,
+        ActiveDiagnosticRequest* request,
+        const DiagnosticResponse* response, Pipeline* pipeline) {
+    if(request->valueCount > 0 && response->success) {
+        relayGroupedResponse(manager, request, response, pipeline);
+    } else {
+        relayValue(manager, request, request->name, request->decoder,
+                response, pipeline);
+    }
+}
+
+/* Private: Pass a received CAN message to an in-flight request, and clean up
+ * the request if that completed it.
+ */
 static void receiveCanMessage(DiagnosticsManager* manager,
         CanBus* bus,
         ActiveDiagnosticRequest* entry,
@@ -334,6 +729,10 @@ static void receiveCanMessage(DiagnosticsManager* manager,
                 // coupled?
                 &manager->shims[bus->address - 1],
                 &entry->handle, message->id, message->data, message->length);
+        if(response.completed) {
+            recordResponseTime(manager, entry);
+        }
+
         if(response.completed && entry->handle.completed) {
             if(entry->handle.success) {
                 relayDiagnosticResponse(manager, entry, &response,
@@ -341,21 +740,34 @@ static void receiveCanMessage(DiagnosticsManager* manager,
             } else {
                 debug("Fatal error sending or receiving diagnostic request");
             }
+            cleanupRequest(manager, entry, false);
         }
     }
 }
 
 void openxc::diagnostics::receiveCanMessage(DiagnosticsManager* manager,
         CanBus* bus, CanMessage* message, Pipeline* pipeline) {
-    ActiveDiagnosticRequest* entry;
-    TAILQ_FOREACH(entry, &manager->recurringRequests, queueEntries) {
-        receiveCanMessage(manager, bus, entry, message, pipeline);
+    DiagnosticRequestList* bucket = lookupInFlightBucket(manager, bus,
+            message->id);
+    if(bucket == NULL) {
+        return;
     }
 
-    LIST_FOREACH(entry, &manager->nonrecurringRequests, listEntries) {
-        receiveCanMessage(manager, bus, entry, message, pipeline);
+    ActiveDiagnosticRequest* entry, *tmp;
+    LIST_FOREACH_SAFE(entry, bucket, responseEntries, tmp) {
+        if(entry->arbitration_id + DIAGNOSTIC_RESPONSE_ARBITRATION_ID_OFFSET ==
+                message->id) {
+            receiveCanMessage(manager, bus, entry, message, pipeline);
+        }
+    }
+
+    if(isFunctionalResponse(message->id)) {
+        LIST_FOREACH_SAFE(entry,
+                &manager->inFlightFunctionalRequests[bus->address - 1],
+                responseEntries, tmp) {
+            receiveCanMessage(manager, bus, entry, message, pipeline);
+        }
     }
-    cleanupActiveRequests(manager, false);
 }
 
 /* Note that this pops it off of whichver list it was on and returns it, so make
@@ -445,9 +857,19 @@ static void updateDiagnosticRequestEntry(ActiveDiagnosticRequest* entry,
     entry->recurring = frequencyHz != 0;
     entry->frequencyClock = {0};
     entry->frequencyClock.frequency = entry->recurring ? frequencyHz : 0;
-    // time out after 100ms
+    entry->scheduleIndex = -1;
+    statistics::initialize(&entry->sendPeriodStats);
+    if(entry->recurring) {
+        // Stagger the first send by up to one period, so requests added at the
+        // same time don't all come due at once.
+        unsigned long period = sendPeriod(frequencyHz);
+        entry->nextSendTime = time::systemTimeMs() + period - (rand() % period);
+    }
+    // the timeout is set from the module's response time when it's sent
     entry->timeoutClock = {0};
-    entry->timeoutClock.frequency = 10;
+    entry->timeout = DIAGNOSTIC_INITIAL_TIMEOUT_MS;
+    entry->valueCount = 0;
+    entry->groupedCallback = NULL;
     entry->inFlight = false;
 }
 
@@ -483,8 +905,14 @@ bool openxc::diagnostics::addRequest(DiagnosticsManager* manager,
 }
 
 static bool validateOptionalRequestAttributes(float frequencyHz) {
+    if(frequencyHz < 0) {
+        debug("Requested recurring diagnostic frequency %f is negative",
+                frequencyHz);
+        return false;
+    }
+
     if(frequencyHz > MAX_RECURRING_DIAGNOSTIC_FREQUENCY_HZ) {
-        debug("Requested recurring diagnostic frequency %d is higher "
+        debug("Requested recurring diagnostic frequency %f is higher "
                 "than maximum of %d", frequencyHz,
                 MAX_RECURRING_DIAGNOSTIC_FREQUENCY_HZ);
         return false;
@@ -492,20 +920,48 @@ static bool validateOptionalRequestAttributes(float frequencyHz) {
     return true;
 }
 
-bool openxc::diagnostics::addRecurringRequest(DiagnosticsManager* manager,
+bool openxc::diagnostics::setRecurringFrequency(DiagnosticsManager* manager,
+        const ActiveDiagnosticRequest* request, float frequencyHz) {
+    if(frequencyHz <= 0 || !validateOptionalRequestAttributes(frequencyHz)) {
+        return false;
+    }
+
+    ActiveDiagnosticRequest* entry;
+    TAILQ_FOREACH(entry, &manager->recurringRequests, queueEntries) {
+        if(entry == request) {
+            entry->frequencyClock.frequency = frequencyHz;
+            if(entry->scheduleIndex >= 0 &&
+                    entry->frequencyClock.lastTick != 0) {
+                unscheduleRequest(manager, entry);
+                entry->nextSendTime = entry->frequencyClock.lastTick +
+                        sendPeriod(frequencyHz);
+                scheduleRequest(manager, entry);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Private: Add a new recurring request, returning the active request entry or
+ * NULL if it couldn't be added.
+ */
+static ActiveDiagnosticRequest* addRecurringEntry(DiagnosticsManager* manager,
         CanBus* bus, DiagnosticRequest* request, const char* name,
         bool waitForMultipleResponses, const DiagnosticResponseDecoder decoder,
         const DiagnosticResponseCallback callback, float frequencyHz) {
 
     if(!validateOptionalRequestAttributes(frequencyHz)) {
-        return false;
+        return NULL;
     }
 
     cleanupActiveRequests(manager, false);
 
-    bool added = true;
-    if(lookupRecurringRequest(manager, bus, request) == NULL) {
-        ActiveDiagnosticRequest* entry = getFreeEntry(manager);
+    ActiveDiagnosticRequest* entry = NULL;
+    ActiveDiagnosticRequest* existingEntry = lookupRecurringRequest(manager,
+            bus, request);
+    if(existingEntry == NULL) {
+        entry = getFreeEntry(manager);
         if(entry != NULL) {
             if(updateRequiredAcceptanceFilters(bus, request)) {
                 updateDiagnosticRequestEntry(entry, manager, bus, request, name,
@@ -520,17 +976,96 @@ bool openxc::diagnostics::addRecurringRequest(DiagnosticsManager* manager,
                         frequencyHz, bus->address, request_string);
 
                 TAILQ_INSERT_HEAD(&manager->recurringRequests, entry, queueEntries);
+                scheduleRequest(manager, entry);
             } else {
-                added = false;
+                entry = NULL;
             }
-        } else {
-            added = false;
         }
     } else {
+        // The lookup popped the existing request off the queue
+        TAILQ_INSERT_TAIL(&manager->recurringRequests, existingEntry,
+                queueEntries);
         debug("Can't add request, one already exists with same key");
-        added = false;
     }
-    return added;
+    return entry;
+}
+
+bool openxc::diagnostics::addRecurringRequest(DiagnosticsManager* manager,
+        CanBus* bus, DiagnosticRequest* request, const char* name,
+        bool waitForMultipleResponses, const DiagnosticResponseDecoder decoder,
+        const DiagnosticResponseCallback callback, float frequencyHz) {
+    return addRecurringEntry(manager, bus, request, name,
+            waitForMultipleResponses, decoder, callback, frequencyHz) != NULL;
+}
+
+/* Private: Return the number of bytes in each PID or DID of the request.
+ */
+static uint8_t identifierLength(const DiagnosticRequest* request) {
+    if(request->pid_length > 0) {
+        return request->pid_length;
+    }
+    return request->mode == UDS_READ_DATA_BY_IDENTIFIER_MODE ? 2 : 1;
+}
+
+/* Private: Fill in the PID and payload of the request with the identifiers of
+ * the values, checking that the request and its response will each fit in a
+ * single CAN frame.
+ */
+static bool buildGroupedRequest(DiagnosticRequest* request,
+        const DiagnosticValue values[], int valueCount) {
+    if(valueCount < 1 || valueCount > MAX_DIAGNOSTIC_REQUEST_VALUES) {
+        debug("Grouped diagnostic requests need 1 to %d values",
+                MAX_DIAGNOSTIC_REQUEST_VALUES);
+        return false;
+    }
+
+    uint8_t length = identifierLength(request);
+    int requestLength = 1 + length * valueCount;
+    int responseLength = 1;
+    for(int i = 0; i < valueCount; i++) {
+        responseLength += length + values[i].length;
+    }
+
+    if(requestLength > DIAGNOSTIC_SINGLE_FRAME_PAYLOAD_LENGTH ||
+            responseLength > DIAGNOSTIC_SINGLE_FRAME_PAYLOAD_LENGTH) {
+        debug("Grouped diagnostic request (%d bytes) or response (%d bytes) "
+                "is too long for a single frame", requestLength,
+                responseLength);
+        return false;
+    }
+
+    request->has_pid = true;
+    request->pid = values[0].identifier;
+    request->pid_length = length;
+    request->payload_length = 0;
+    for(int i = 1; i < valueCount; i++) {
+        for(int byte = length - 1; byte >= 0; byte--) {
+            request->payload[request->payload_length++] =
+                    values[i].identifier >> (byte * CHAR_BIT);
+        }
+    }
+    return true;
+}
+
+bool openxc::diagnostics::addRecurringGroupedRequest(
+        DiagnosticsManager* manager, CanBus* bus, DiagnosticRequest* request,
+        const DiagnosticValue values[], int valueCount,
+        const DiagnosticResponseCallback callback,
+        const DiagnosticGroupedResponseCallback groupedCallback,
+        float frequencyHz) {
+    DiagnosticRequest groupedRequest = *request;
+    if(!buildGroupedRequest(&groupedRequest, values, valueCount)) {
+        return false;
+    }
+
+    ActiveDiagnosticRequest* entry = addRecurringEntry(manager, bus,
+            &groupedRequest, NULL, false, NULL, callback, frequencyHz);
+    if(entry != NULL) {
+        memcpy(entry->values, values, sizeof(DiagnosticValue) * valueCount);
+        entry->valueCount = valueCount;
+        entry->groupedCallback = groupedCallback;
+    }
+    return entry != NULL;
 }
 
 bool openxc::diagnostics::addRecurringRequest(DiagnosticsManager* manager,
@@ -663,6 +1198,66 @@ bool openxc::diagnostics::handleDiagnosticCommand(
     return status;
 }
 
+unsigned int openxc::diagnostics::responseTimeout(DiagnosticsManager* manager,
+        const ActiveDiagnosticRequest* request) {
+    if(collectsResponses(request)) {
+        return DIAGNOSTIC_INITIAL_TIMEOUT_MS;
+    }
+
+    DiagnosticLatency* latency = lookupLatency(manager, request);
+    if(latency == NULL || latency->timeout == 0 ||
+            latency->arbitrationId != request->arbitration_id) {
+        return limitTimeout(DIAGNOSTIC_INITIAL_TIMEOUT_MS);
+    }
+    return latency->timeout;
+}
+
+float openxc::diagnostics::achievedFrequency(
+        const ActiveDiagnosticRequest* request) {
+    float period = statistics::exponentialMovingAverage(
+            &request->sendPeriodStats);
+    return period > 0 ? MS_PER_SECOND / period : 0;
+}
+
+void openxc::diagnostics::logStatistics(DiagnosticsManager* manager) {
+    if(!openxc::config::getConfiguration()->calculateMetrics) {
+        return;
+    }
+
+    static unsigned long lastTimeLogged;
+    if(time::systemTimeMs() - lastTimeLogged >
+            DIAGNOSTIC_STATS_LOG_FREQUENCY_S * 1000) {
+        ActiveDiagnosticRequest* entry;
+        TAILQ_FOREACH(entry, &manager->recurringRequests, queueEntries) {
+            char request_string[128] = {0};
+            diagnostic_request_to_string(&entry->handle.request,
+                    request_string, sizeof(request_string));
+            debug("Diagnostic request on bus %d requested at %f Hz, "
+                    "achieved %f Hz, timeout %d ms: %s", entry->bus->address,
+                    entry->frequencyClock.frequency, achievedFrequency(entry),
+                    responseTimeout(manager, entry), request_string);
+        }
+
+        for(int i = 0; i < MAX_SHIM_COUNT; i++) {
+            float requestedRate = 0;
+            float achievedRate = 0;
+            TAILQ_FOREACH(entry, &manager->recurringRequests, queueEntries) {
+                if(entry->bus->address - 1 == i) {
+                    requestedRate += entry->frequencyClock.frequency;
+                    achievedRate += achievedFrequency(entry);
+                }
+            }
+
+            if(requestedRate > 0) {
+                debug("CAN%d diagnostic request rate: %f/s requested, "
+                        "%f/s achieved, budget %d/s", i + 1, requestedRate,
+                        achievedRate, requestBudget(&manager->schedules[i]));
+            }
+        }
+        lastTimeLogged = time::systemTimeMs();
+    }
+}
+
 float openxc::diagnostics::passthroughDecoder(
         const DiagnosticResponse* response, float parsed_payload) {
     return parsed_payload;
@@ -8,6 +8,7 @@
 #include "bsd_queue_patch.h"
 #include "pipeline.h"
 #include "can/canutil.h"
+#include "util/statistics.h"
 #include <uds/uds.h>
 #include "openxc.pb.h"
 
@@ -26,6 +27,30 @@
  */
 #define MAX_SHIM_COUNT 2
 
+/* Private: The number of buckets in each bus's index of in-flight requests by
+ * response arbitration ID.
+ */
+#define DIAGNOSTIC_RESPONSE_BUCKET_COUNT 16
+
+/* Private: The number of modules on each bus whose response times are tracked.
+ * Modules share a slot if their arbitration IDs are equal modulo this count.
+ */
+#define DIAGNOSTIC_LATENCY_SLOT_COUNT 16
+
+/* Private: The most bytes a request or response can have after its ISO-TP
+ * header and still fit in a single CAN frame. Grouped requests are limited to
+ * this, as responses spanning multiple frames aren't received.
+ */
+#define DIAGNOSTIC_SINGLE_FRAME_PAYLOAD_LENGTH 7
+
+/* Public: The maximum number of PIDs or DIDs in one grouped diagnostic request.
+ * After the mode, each value in a single frame response takes at least a 1
+ * byte identifier and 1 byte of data, so at most 3 OBD-II mode 1 PIDs (or 2
+ * DIDs) fit, even though SAE J1979 allows 6 PIDs in a request.
+ */
+#define MAX_DIAGNOSTIC_REQUEST_VALUES \
+        ((DIAGNOSTIC_SINGLE_FRAME_PAYLOAD_LENGTH - 1) / 2)
+
 namespace openxc {
 namespace diagnostics {
 
@@ -54,6 +79,38 @@ typedef void (*DiagnosticResponseCallback)(
         const DiagnosticResponse* response,
         float parsed_payload);
 
+/* Public: The signature for an optional function to be notified once every
+ * value in a response to a grouped request has been published and passed to
+ * the request's DiagnosticResponseCallback.
+ *
+ * manager - The DiagnosticsManager providing this response.
+ * request - The original grouped diagnostic request.
+ * response - The whole response, before it was split into values.
+ */
+typedef void (*DiagnosticGroupedResponseCallback)(
+        struct DiagnosticsManager* manager,
+        const struct ActiveDiagnosticRequest* request,
+        const DiagnosticResponse* response);
+
+/* Public: One of the values requested by a grouped diagnostic request, e.g. one
+ * PID of a multi-PID OBD-II request or one DID of a UDS read data by
+ * identifier (0x22) request.
+ *
+ * identifier - The PID or DID of the value.
+ * length - The number of data bytes the module responds with for this value.
+ * name - An optional human readable name to publish the value with. This must
+ *      remain in memory as long as the request is active (e.g. a string
+ *      literal). If NULL, the published output will use the raw diagnostic
+ *      response format, with the response trimmed to this value.
+ * decoder - An optional DiagnosticResponseDecoder to parse the value's data.
+ */
+typedef struct {
+    uint16_t identifier;
+    uint8_t length;
+    const char* name;
+    DiagnosticResponseDecoder decoder;
+} DiagnosticValue;
+
 /* Private: An active diagnostic request, either recurring or one-time.
  *
  * bus - The CAN bus this request should be made on, or is currently in flight
@@ -91,6 +148,24 @@ typedef void (*DiagnosticResponseCallback)(
  *      the recurring requests queue.
  * listEntries - Internal data structure reference for when this request is in
  *      the non-recurring requests list or free list.
+ * responseEntries - Internal data structure reference for when this request is
+ *      in flight, in the manager's index of requests waiting for a response.
+ * nextSendTime - The time in milliseconds when a recurring request is next due
+ *      to be sent.
+ * scheduleIndex - The position of a recurring request in its bus's
+ *      DiagnosticSchedule, or -1 if it isn't scheduled.
+ * sendPeriodStats - The time in milliseconds between each send of a recurring
+ *      request, to compare the achieved frequency with the requested one.
+ * timeout - The time in milliseconds to wait for a response after the request
+ *      was sent, set from the response time of the module when it's sent.
+ * values - For a grouped request, the values requested. A response is split
+ *      into these values, and each is published and passed to the callback
+ *      separately.
+ * valueCount - The number of values in a grouped request, or 0 if this is not
+ *      a grouped request.
+ * groupedCallback - An optional DiagnosticGroupedResponseCallback to be
+ *      notified after all of the values in a response to a grouped request
+ *      have been relayed.
  */
 struct ActiveDiagnosticRequest {
     CanBus* bus;
@@ -107,12 +182,66 @@ struct ActiveDiagnosticRequest {
 
     TAILQ_ENTRY(ActiveDiagnosticRequest) queueEntries;
     LIST_ENTRY(ActiveDiagnosticRequest) listEntries;
+    LIST_ENTRY(ActiveDiagnosticRequest) responseEntries;
+    unsigned long nextSendTime;
+    int scheduleIndex;
+    openxc::util::statistics::Statistic sendPeriodStats;
+    unsigned int timeout;
+    DiagnosticValue values[MAX_DIAGNOSTIC_REQUEST_VALUES];
+    uint8_t valueCount;
+    DiagnosticGroupedResponseCallback groupedCallback;
 };
 typedef struct ActiveDiagnosticRequest ActiveDiagnosticRequest;
 
 LIST_HEAD(DiagnosticRequestList, ActiveDiagnosticRequest);
 TAILQ_HEAD(DiagnosticRequestQueue, ActiveDiagnosticRequest);
 
+/* Private: The response time measured for requests to one module, used to
+ * decide how long to wait for a response before giving up.
+ *
+ * The estimate is smoothed the same way as a TCP retransmission timeout (RFC
+ * 6298).
+ *
+ * arbitrationId - The arbitration ID of the requests to the module.
+ * smoothedResponseTime - The smoothed time in milliseconds from sending a
+ *      request to receiving a response.
+ * responseTimeVariation - The smoothed variation in the response time, in
+ *      milliseconds.
+ * timeout - The time in milliseconds to wait for a response, or 0 if nothing
+ *      is known about the module yet.
+ */
+typedef struct {
+    uint32_t arbitrationId;
+    float smoothedResponseTime;
+    float responseTimeVariation;
+    unsigned int timeout;
+} DiagnosticLatency;
+
+/* Public: The recurring requests for one CAN bus, ordered by when they are next
+ * due, and the share of the bus that diagnostic requests may use.
+ *
+ * requestsPerSecond - The maximum sustained rate of diagnostic requests to send
+ *      on the bus. Up to one second's worth can be sent in a burst after the
+ *      bus has been quiet. If 0, DEFAULT_DIAGNOSTIC_REQUEST_BUDGET from the
+ *      build configuration is used.
+ *
+ * Private:
+ *
+ * requests - A binary min-heap of the recurring requests on the bus, keyed by
+ *      their nextSendTime.
+ * size - The number of requests in the heap.
+ * allowance - The number of requests that can be sent right now, in
+ *      thousandths of a request.
+ * lastRefill - The time in milliseconds when the allowance was last topped up.
+ */
+typedef struct {
+    unsigned int requestsPerSecond;
+    ActiveDiagnosticRequest* requests[MAX_SIMULTANEOUS_DIAG_REQUESTS];
+    int size;
+    unsigned long allowance;
+    unsigned long lastRefill;
+} DiagnosticSchedule;
+
 /* Public: The core structure for running the diagnostics module on the VI.
  *
  * This stores details about the active requests and shims required to connect
@@ -126,9 +255,8 @@ TAILQ_HEAD(DiagnosticRequestQueue, ActiveDiagnosticRequest);
  *
  * Private:
  *
- * recurringRequests - A queue of active, recurring diagnostic requests. When a
- *      response is received for a recurring request or it times out, it is
- *      popped from the queue and pushed onto the back.
+ * recurringRequests - A queue of active, recurring diagnostic requests. The
+ *      order they are sent in is kept by the schedules, not this queue.
  * nonrecurringRequests - A list of active one-time diagnostic requests. When a
  *      response is received for a non-recurring request or it times out, it is
  *      removed from this list and placed back in the free list.
@@ -136,6 +264,17 @@ TAILQ_HEAD(DiagnosticRequestQueue, ActiveDiagnosticRequest);
  *      requests. This free list is backed by statically allocated entries in
  *      the requestListEntries attribute.
  * requestListEntries - Static allocation for all active diagnostic requests.
+ * inFlightRequests - For each bus, the in-flight requests to a single module,
+ *      hashed by the arbitration ID their response will have. A received CAN
+ *      message is only given to the requests in its bucket.
+ * inFlightFunctionalRequests - For each bus, the in-flight functional
+ *      broadcast requests, which can receive responses on any of the functional
+ *      response IDs.
+ * schedules - For each bus, the recurring requests ordered by when they are
+ *      next due and the bus's diagnostic request budget.
+ * latencies - For each bus, the measured response times of the modules that
+ *      requests have been sent to, indexed by arbitration ID. These are kept
+ *      when the manager is reset.
  * initialized - True if the DiagnosticsManager has been initialized.
  */
 struct DiagnosticsManager {
@@ -145,6 +284,11 @@ struct DiagnosticsManager {
     DiagnosticRequestList nonrecurringRequests;
     DiagnosticRequestList freeRequestEntries;
     ActiveDiagnosticRequest requestListEntries[MAX_SIMULTANEOUS_DIAG_REQUESTS];
+    DiagnosticRequestList inFlightRequests[MAX_SHIM_COUNT][
+            DIAGNOSTIC_RESPONSE_BUCKET_COUNT];
+    DiagnosticRequestList inFlightFunctionalRequests[MAX_SHIM_COUNT];
+    DiagnosticSchedule schedules[MAX_SHIM_COUNT];
+    DiagnosticLatency latencies[MAX_SHIM_COUNT][DIAGNOSTIC_LATENCY_SLOT_COUNT];
     bool initialized;
 };
 typedef struct DiagnosticsManager DiagnosticsManager;
@@ -226,6 +370,55 @@ bool addRecurringRequest(DiagnosticsManager* manager,
         bool waitForMultipleResponses, const DiagnosticResponseDecoder decoder,
         const DiagnosticResponseCallback callback, float frequencyHz);
 
+/* Public: Add a recurring diagnostic request for several values at once, for
+ * modules that support more than one PID or DID in a single request.
+ *
+ * The identifiers of the values are added to the request after its mode, so
+ * the request's own PID and payload are ignored. Each value in a response is
+ * published with its own name and decoder, and passed to the callback as a
+ * response of its own.
+ *
+ * Example:
+ *
+ *     // Request engine speed and vehicle speed together at 5Hz
+ *     DiagnosticRequest request = {
+ *         arbitration_id: 0x7e0,
+ *         mode: 1
+ *     };
+ *     DiagnosticValue values[] = {
+ *         { identifier: 0xc, length: 2, name: "engine_speed",
+ *             decoder: obd2::handleObd2Pid },
+ *         { identifier: 0xd, length: 1, name: "vehicle_speed",
+ *             decoder: obd2::handleObd2Pid }
+ *     };
+ *     addRecurringGroupedRequest(&getConfiguration()->diagnosticsManager,
+ *          canBus, &request, values, 2, NULL, NULL, 5);
+ *
+ * manager - The manager to manage this request.
+ * bus - The bus to send the request.
+ * request - The arbitration ID, mode and (optionally) PID length of the
+ *      request. If the PID length is 0, DIDs are 2 bytes for mode 0x22 and
+ *      PIDs are 1 byte for any other mode.
+ * values - The values to request, which are copied.
+ * valueCount - The length of the values array, at most
+ *      MAX_DIAGNOSTIC_REQUEST_VALUES.
+ * callback - An optional DiagnosticResponseCallback to be notified of each
+ *      value received.
+ * groupedCallback - An optional DiagnosticGroupedResponseCallback to be
+ *      notified once all of the values in a response have been received, in
+ *      whatever order the module sent them.
+ * frequencyHz - The frequency (in Hz) to send the request.
+ *
+ * Returns true if the request was added successfully. Returns false if the
+ * request or its response wouldn't fit in a single CAN frame, or for any of
+ * the reasons addRecurringRequest would.
+ */
+bool addRecurringGroupedRequest(DiagnosticsManager* manager, CanBus* bus,
+        DiagnosticRequest* request, const DiagnosticValue values[],
+        int valueCount, const DiagnosticResponseCallback callback,
+        const DiagnosticGroupedResponseCallback groupedCallback,
+        float frequencyHz);
+
 /* Public: Add and send a new one-time diagnostic request.
  *
  * A one-time (aka non-recurring) request can existing in parallel with a
@@ -300,6 +493,22 @@ bool addRequest(DiagnosticsManager* manager, CanBus* bus,
 bool cancelRecurringRequest(DiagnosticsManager* manager, CanBus* bus,
         DiagnosticRequest* request);
 
+/* Public: Change how often an active recurring diagnostic request is sent,
+ * e.g. from the request's callback.
+ *
+ * If the request has already been sent, its next send is moved to one new
+ * period after the last one, so a higher frequency takes effect right away.
+ *
+ * manager - The manager the request is active on.
+ * request - The active recurring request to change.
+ * frequencyHz - The new frequency, which must be greater than 0 and no higher
+ *      than the maximum frequency for recurring requests.
+ *
+ * Returns true if the request was found and its frequency changed.
+ */
+bool setRecurringFrequency(DiagnosticsManager* manager,
+        const ActiveDiagnosticRequest* request, float frequencyHz);
+
 /* Public: Handle a newly received CAN message, checking to see if it is a
  *      response to an active requests.
  *
@@ -307,6 +516,10 @@ bool cancelRecurringRequest(DiagnosticsManager* manager, CanBus* bus,
  * it to any existing requests, relay the response and perform any necessary
  * callbacks.
  *
+ * Only the in-flight requests expecting a response with the message's
+ * arbitration ID are checked, so a message that can't be a diagnostic response
+ * returns after a single bucket lookup.
+ *
  * manager - The manager that should receive the CAN message.
  * bus - The bus this message was received from.
  * message - The message received.
@@ -321,6 +534,11 @@ void receiveCanMessage(DiagnosticsManager* manager, CanBus* bus,
  * This should be called from the main loop of the firmware in order to handle
  * multi-frame requests as quickly as possible.
  *
+ * One-time requests are sent first, then recurring requests in the order they
+ * became due. Only one request to each arbitration ID is in flight at a time,
+ * and no more requests are sent once the bus's budget is used up - a request
+ * that can't be sent yet keeps its place at the front of the schedule.
+ *
  * manager - The manager to send the requests for.
  * bus - The bus to send the requests on.
  */
@@ -342,6 +560,32 @@ void sendRequests(DiagnosticsManager* manager, CanBus* bus);
 bool handleDiagnosticCommand(DiagnosticsManager* manager,
         openxc_ControlCommand* command);
 
+/* Public: Return the time in milliseconds to wait for a response to the request
+ * before giving up on it.
+ *
+ * This is derived from the response times measured for the module the request
+ * is sent to, limited to between DEFAULT_DIAGNOSTIC_TIMEOUT_FLOOR_MS and
+ * DEFAULT_DIAGNOSTIC_TIMEOUT_CEILING_MS. Until a response has been received
+ * from the module the timeout is 100ms, and each time a request to the module
+ * gets no response at all the timeout is doubled.
+ *
+ * Functional broadcast requests and requests waiting for multiple responses
+ * always wait 100ms, since that's the window for collecting responses from
+ * every module that answers, not a measure of one module's speed.
+ */
+unsigned int responseTimeout(DiagnosticsManager* manager,
+        const ActiveDiagnosticRequest* request);
+
+/* Public: Return the frequency in Hz that a recurring request has actually been
+ * sent at recently, or 0 if it hasn't been sent more than once.
+ */
+float achievedFrequency(const ActiveDiagnosticRequest* request);
+
+/* Public: Log the requested and achieved frequency of each recurring
+ * diagnostic request to the debug log, if metrics are enabled.
+ */
+void logStatistics(DiagnosticsManager* manager);
+
 /* Public: A no-op decoder for the payload of a diagnostic response.
  *
  * This is an implementation of DiagnosticResponseDecoder.
@@ -1,6 +1,8 @@
 #ifndef __INTERFACE_H__
 #define __INTERFACE_H__
 
+#include "payload/payload.h"
+
 namespace openxc {
 namespace interface {
 
@@ -10,15 +12,37 @@ typedef enum {
     NETWORK = 2
 } InterfaceType;
 
+/* Public: What to do with a new message for an interface when its send queue
+ * is full.
+ *
+ * DROP_NEWEST - Drop the new message.
+ * DROP_OLDEST - Drop the oldest messages still waiting in the queue (except one
+ *      the interface has already started sending) to make room for the new one.
+ * COALESCE - Once the queue is mostly full, hold only the latest value of each
+ *      signal in a small table until there's room again. Other messages are
+ *      dropped if they don't fit, as with DROP_NEWEST.
+ */
+typedef enum {
+    DROP_NEWEST,
+    DROP_OLDEST,
+    COALESCE
+} OverflowPolicy;
+
 /* Public:
  *
  * type - The type of this interface, one of InterfaceType.
  * allowRawWrites - if raw CAN messages writes are enabled for a bus and this is
  *      true, accept raw write requests from the USB interface.
+ * overflowPolicy - How to handle a message for this interface when its send
+ *      queue is full. Command responses always wait for room instead.
+ * payloadFormat - The format of the messages sent and received on this
+ *      interface.
  */
 typedef struct {
     bool allowRawWrites;
     InterfaceType type;
+    OverflowPolicy overflowPolicy;
+    openxc::payload::PayloadFormat payloadFormat;
 } InterfaceDescriptor;
 
 const char* descriptorToString(InterfaceDescriptor* descriptor);
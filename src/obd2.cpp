@@ -5,12 +5,15 @@
 #include "shared_handlers.h"
 #include "config.h"
 #include <limits.h>
+#include <string.h>
+#include <math.h>
 
 namespace time = openxc::util::time;
 
 using openxc::util::log::debug;
 using openxc::diagnostics::DiagnosticsManager;
 using openxc::diagnostics::ActiveDiagnosticRequest;
+using openxc::diagnostics::DiagnosticValue;
 using openxc::config::getConfiguration;
 using openxc::config::PowerManagement;
 using openxc::config::RunLevel;
@@ -18,8 +21,14 @@ using openxc::config::RunLevel;
 #define ENGINE_SPEED_PID 0xc
 #define VEHICLE_SPEED_PID 0xd
 
+// A value is considered to be changing if it moves by more than this fraction
+// of its previous value between two responses.
+#define ADAPTIVE_OBD2_CHANGE_THRESHOLD .01
+
 static bool ENGINE_STARTED = false;
 static bool VEHICLE_IN_MOTION = false;
+static bool PID_SUPPORT_QUERIED = false;
+static bool SENT_FINAL_IGNITION_CHECK = false;
 
 static openxc::util::time::FrequencyClock IGNITION_STATUS_TIMER = {0.5};
 
@@ -29,35 +38,77 @@ static openxc::util::time::FrequencyClock IGNITION_STATUS_TIMER = {0.5};
  * name - A human readable name to use for this PID when published.
  * frequency - The frequency to request this PID if supported by the vehicle
  *      when automatic, recurring OBD-II requests are enabled.
+ * length - The number of data bytes in a response for this PID, from SAE J1979.
  */
 typedef struct {
     uint8_t pid;
     const char* name;
     float frequency;
+    uint8_t length;
 } Obd2Pid;
 
 /* Private: Pre-defined OBD-II PIDs to query for if supported by the vehicle.
  */
 const Obd2Pid OBD2_PIDS[] = {
-    { pid: ENGINE_SPEED_PID, name: "engine_speed", frequency: 5 },
-    { pid: VEHICLE_SPEED_PID, name: "vehicle_speed", frequency: 5 },
-    { pid: 0x4, name: "engine_load", frequency: 5 },
-    { pid: 0x5, name: "engine_coolant_temperature", frequency: 1 },
-    { pid: 0x33, name: "barometric_pressure", frequency: 1 },
-    { pid: 0x4c, name: "commanded_throttle_position", frequency: 1 },
-    { pid: 0x27, name: "fuel_level", frequency: 1 },
-    { pid: 0xf, name: "intake_air_temperature", frequency: 1 },
-    { pid: 0xb, name: "intake_manifold_pressure", frequency: 1 },
-    { pid: 0x1f, name: "running_time", frequency: 1 },
-    { pid: 0x11, name: "throttle_position", frequency: 5 },
-    { pid: 0xa, name: "fuel_pressure", frequency: 1 },
-    { pid: 0x10, name: "mass_airflow", frequency: 5 },
-    { pid: 0x5a, name: "accelerator_pedal_position", frequency: 5 },
-    { pid: 0x52, name: "ethanol_fuel_percentage", frequency: 1 },
-    { pid: 0x5c, name: "engine_oil_temperature", frequency: 1 },
-    { pid: 0x63, name: "engine_torque", frequency: 1 },
+    { pid: ENGINE_SPEED_PID, name: "engine_speed", frequency: 5, length: 2 },
+    { pid: VEHICLE_SPEED_PID, name: "vehicle_speed", frequency: 5, length: 1 },
+    { pid: 0x4, name: "engine_load", frequency: 5, length: 1 },
+    { pid: 0x5, name: "engine_coolant_temperature", frequency: 1, length: 1 },
+    { pid: 0x33, name: "barometric_pressure", frequency: 1, length: 1 },
+    { pid: 0x4c, name: "commanded_throttle_position", frequency: 1, length: 1 },
+    { pid: 0x27, name: "fuel_level", frequency: 1, length: 4 },
+    { pid: 0xf, name: "intake_air_temperature", frequency: 1, length: 1 },
+    { pid: 0xb, name: "intake_manifold_pressure", frequency: 1, length: 1 },
+    { pid: 0x1f, name: "running_time", frequency: 1, length: 2 },
+    { pid: 0x11, name: "throttle_position", frequency: 5, length: 1 },
+    { pid: 0xa, name: "fuel_pressure", frequency: 1, length: 1 },
+    { pid: 0x10, name: "mass_airflow", frequency: 5, length: 2 },
+    { pid: 0x5a, name: "accelerator_pedal_position", frequency: 5, length: 1 },
+    { pid: 0x52, name: "ethanol_fuel_percentage", frequency: 1, length: 1 },
+    { pid: 0x5c, name: "engine_oil_temperature", frequency: 1, length: 1 },
+    { pid: 0x63, name: "engine_torque", frequency: 1, length: 2 },
 };
 
+#define OBD2_PID_COUNT (sizeof(OBD2_PIDS) / sizeof(Obd2Pid))
+
+/* Private: A multi-PID request being put together from the supported PIDs
+ * with the same frequency.
+ *
+ * values - The PIDs in the request.
+ * pidIndexes - The index in OBD2_PIDS of each PID in the request.
+ * count - The number of PIDs in the request.
+ * responseLength - The number of bytes in a response to the request.
+ * frequency - The frequency of all of the PIDs in the request.
+ */
+typedef struct {
+    DiagnosticValue values[MAX_DIAGNOSTIC_REQUEST_VALUES];
+    size_t pidIndexes[MAX_DIAGNOSTIC_REQUEST_VALUES];
+    int count;
+    int responseLength;
+    float frequency;
+} Obd2PidGroup;
+
+/* Private: The state of the recurring request for one of the OBD2_PIDS.
+ *
+ * requested - True if the PID already has a recurring request, so a PID
+ *      reported as supported by more than one module is only requested once.
+ * hasValue - True if a value has been received for the PID.
+ * compared - True if the last value received for the PID had one before it to
+ *      compare with.
+ * changed - True if the last value received for the PID was different from
+ *      the one before it.
+ * lastValue - The last value received for the PID.
+ */
+typedef struct {
+    bool requested;
+    bool hasValue;
+    bool compared;
+    bool changed;
+    float lastValue;
+} Obd2PidState;
+
+static Obd2PidState PID_STATES[OBD2_PID_COUNT];
+
 static void checkIgnitionStatus(DiagnosticsManager* manager,
         const ActiveDiagnosticRequest* request,
         const DiagnosticResponse* response,
@@ -74,6 +125,83 @@ static void checkIgnitionStatus(DiagnosticsManager* manager,
     }
 }
 
+static Obd2PidState* lookupPidState(uint16_t pid) {
+    for(size_t i = 0; i < OBD2_PID_COUNT; i++) {
+        if(OBD2_PIDS[i].pid == pid) {
+            return &PID_STATES[i];
+        }
+    }
+    return NULL;
+}
+
+/* Private: Record a value received for a PID, and whether it changed
+ * noticeably since the last one.
+ */
+static void recordPidValue(uint16_t pid, float value) {
+    Obd2PidState* state = lookupPidState(pid);
+    if(state == NULL) {
+        return;
+    }
+
+    state->compared = state->hasValue;
+    state->changed = state->compared && fabs(value - state->lastValue)
+            > ADAPTIVE_OBD2_CHANGE_THRESHOLD * fmax(fabs(state->lastValue), 1);
+    state->lastValue = value;
+    state->hasValue = true;
+}
+
+/* Private: Once all of the values in a response to an automatic request have
+ * been recorded, double the request's frequency if any of them changed
+ * noticeably since the last response, or halve it if they were all steady,
+ * within the configured bounds.
+ */
+static void adaptFrequency(DiagnosticsManager* manager,
+        const ActiveDiagnosticRequest* request) {
+    bool changed = false;
+    int valueCount = request->valueCount > 0 ? request->valueCount : 1;
+    for(int i = 0; i < valueCount; i++) {
+        Obd2PidState* state = lookupPidState(request->valueCount > 0 ?
+                request->values[i].identifier : request->handle.request.pid);
+        if(state == NULL || !state->compared) {
+            return;
+        }
+        changed = changed || state->changed;
+    }
+
+    float frequency = request->frequencyClock.frequency;
+    if(changed) {
+        frequency = fmin(frequency * 2, DEFAULT_ADAPTIVE_OBD2_MAX_FREQUENCY_HZ);
+    } else {
+        frequency = fmax(frequency / 2, DEFAULT_ADAPTIVE_OBD2_MIN_FREQUENCY_HZ);
+    }
+
+    if(frequency != request->frequencyClock.frequency) {
+        setRecurringFrequency(manager, request, frequency);
+    }
+}
+
+static void handlePidResponse(DiagnosticsManager* manager,
+        const ActiveDiagnosticRequest* request,
+        const DiagnosticResponse* response,
+        float parsedPayload) {
+    checkIgnitionStatus(manager, request, response, parsedPayload);
+    if(getConfiguration()->adaptiveObd2Requests && response->success) {
+        recordPidValue(response->pid, parsedPayload);
+        // A grouped request adapts once all of its values have been recorded
+        if(request->valueCount == 0) {
+            adaptFrequency(manager, request);
+        }
+    }
+}
+
+static void handleGroupedPidResponse(DiagnosticsManager* manager,
+        const ActiveDiagnosticRequest* request,
+        const DiagnosticResponse* response) {
+    if(getConfiguration()->adaptiveObd2Requests && response->success) {
+        adaptFrequency(manager, request);
+    }
+}
+
 static void requestIgnitionStatus(DiagnosticsManager* manager) {
     if(manager->obd2Bus != NULL && (getConfiguration()->powerManagement ==
                 PowerManagement::OBD2_IGNITION_CHECK ||
@@ -91,6 +219,72 @@ static void requestIgnitionStatus(DiagnosticsManager* manager) {
     }
 }
 
+/* Private: Add the PID to the first group with the same frequency that has
+ * room for it, or start a new group.
+ */
+static void addToGroup(Obd2PidGroup groups[], int* groupCount,
+        size_t pidIndex) {
+    const Obd2Pid* pid = &OBD2_PIDS[pidIndex];
+    // The PID itself is echoed back before its data
+    int length = 1 + pid->length;
+
+    Obd2PidGroup* group = NULL;
+    for(int i = 0; i < *groupCount; i++) {
+        if(groups[i].frequency == pid->frequency &&
+                groups[i].count < MAX_DIAGNOSTIC_REQUEST_VALUES &&
+                groups[i].responseLength + length <=
+                    DIAGNOSTIC_SINGLE_FRAME_PAYLOAD_LENGTH) {
+            group = &groups[i];
+            break;
+        }
+    }
+
+    if(group == NULL) {
+        group = &groups[(*groupCount)++];
+        group->count = 0;
+        // The mode of the response comes first
+        group->responseLength = 1;
+        group->frequency = pid->frequency;
+    }
+
+    DiagnosticValue* value = &group->values[group->count];
+    value->identifier = pid->pid;
+    value->length = pid->length;
+    value->name = pid->name;
+    value->decoder = openxc::diagnostics::obd2::handleObd2Pid;
+    group->pidIndexes[group->count++] = pidIndex;
+    group->responseLength += length;
+}
+
+static void addPidGroup(DiagnosticsManager* manager, Obd2PidGroup* group) {
+    DiagnosticRequest request = {
+            arbitration_id: OBD2_FUNCTIONAL_BROADCAST_ID,
+            mode: 0x1};
+    bool added;
+    if(group->count == 1) {
+        debug("Automatically adding recurring request for PID 0x%x",
+                group->values[0].identifier);
+        request.has_pid = true;
+        request.pid = group->values[0].identifier;
+        added = addRecurringRequest(manager, manager->obd2Bus, &request,
+                group->values[0].name, false,
+                openxc::diagnostics::obd2::handleObd2Pid,
+                handlePidResponse, group->frequency);
+    } else {
+        debug("Automatically adding recurring request for %d PIDs starting "
+                "with 0x%x", group->count, group->values[0].identifier);
+        added = addRecurringGroupedRequest(manager, manager->obd2Bus, &request,
+                group->values, group->count, handlePidResponse,
+                handleGroupedPidResponse, group->frequency);
+    }
+
+    if(added) {
+        for(int i = 0; i < group->count; i++) {
+            PID_STATES[group->pidIndexes[i]].requested = true;
+        }
+    }
+}
+
 static void checkSupportedPids(DiagnosticsManager* manager,
         const ActiveDiagnosticRequest* request,
         const DiagnosticResponse* response,
@@ -100,30 +294,36 @@ static void checkSupportedPids(DiagnosticsManager* manager,
     }
 
     debug("%s", "Querying for supported PIDs from vehicle");
+    Obd2PidGroup groups[OBD2_PID_COUNT];
+    int groupCount = 0;
     for(int i = 0; i < response->payload_length; i++) {
         for(int j = CHAR_BIT - 1; j >= 0; j--) {
             if(response->payload[i] >> j & 0x1) {
                 uint16_t pid = response->pid + (i * CHAR_BIT) + j + 1;
                 debug("Vehicle supports PID 0x%02x", pid);
-                for(size_t i = 0; i < sizeof(OBD2_PIDS) / sizeof(Obd2Pid); i++) {
-                    if(OBD2_PIDS[i].pid == pid) {
-                        debug("Automatically adding recurring request for PID 0x%x", pid);
-                        DiagnosticRequest request = {
-                                arbitration_id: OBD2_FUNCTIONAL_BROADCAST_ID,
-                                mode: 0x1, has_pid: true, pid: pid};
-                        addRecurringRequest(manager, manager->obd2Bus, &request,
-                                OBD2_PIDS[i].name, false,
-                                openxc::diagnostics::obd2::handleObd2Pid,
-                                checkIgnitionStatus, OBD2_PIDS[i].frequency);
+                for(size_t k = 0; k < OBD2_PID_COUNT; k++) {
+                    if(OBD2_PIDS[k].pid == pid && !PID_STATES[k].requested) {
+                        addToGroup(groups, &groupCount, k);
                         break;
                     }
                 }
             }
         }
     }
+
+    for(int i = 0; i < groupCount; i++) {
+        addPidGroup(manager, &groups[i]);
+    }
 }
 
 void openxc::diagnostics::obd2::initialize(DiagnosticsManager* manager) {
+    // Initializing the diagnostics manager drops any automatic requests, so
+    // start over with the ignition check and the query for supported PIDs
+    ENGINE_STARTED = false;
+    VEHICLE_IN_MOTION = false;
+    PID_SUPPORT_QUERIED = false;
+    SENT_FINAL_IGNITION_CHECK = false;
+    memset(PID_STATES, 0, sizeof(PID_STATES));
     requestIgnitionStatus(manager);
 }
 
@@ -133,15 +333,12 @@ void openxc::diagnostics::obd2::initialize(DiagnosticsManager* manager) {
 // * If normal CAN is blocked, we rely on a watchdog to wake us up every 15
 // seconds to start this process over again.
 void openxc::diagnostics::obd2::loop(DiagnosticsManager* manager) {
-    static bool pidSupportQueried = false;
-    static bool sentFinalIgnitionCheck = false;
-
     if(!manager->initialized || manager->obd2Bus == NULL) {
         return;
     }
 
     if(time::elapsed(&IGNITION_STATUS_TIMER, false)) {
-        if(sentFinalIgnitionCheck && getConfiguration()->powerManagement ==
+        if(SENT_FINAL_IGNITION_CHECK && getConfiguration()->powerManagement ==
                         PowerManagement::OBD2_IGNITION_CHECK) {
             debug("Ceasing diagnostic requests as ignition went off");
             diagnostics::reset(manager);
@@ -149,8 +346,9 @@ void openxc::diagnostics::obd2::loop(DiagnosticsManager* manager) {
             // active we want to keep querying for igntion. If we de-init
             // diagnosicts here we risk getting stuck awake, but not querying
             // for any diagnostics messages.
-            sentFinalIgnitionCheck = false;
-            pidSupportQueried = false;
+            SENT_FINAL_IGNITION_CHECK = false;
+            PID_SUPPORT_QUERIED = false;
+            memset(PID_STATES, 0, sizeof(PID_STATES));
             IGNITION_STATUS_TIMER.frequency = .1;
             time::tick(&IGNITION_STATUS_TIMER);
         } else {
@@ -161,15 +359,15 @@ void openxc::diagnostics::obd2::loop(DiagnosticsManager* manager) {
             // ignition off to decide we should cancel all outstanding requests.
             IGNITION_STATUS_TIMER.frequency = .2;
             requestIgnitionStatus(manager);
-            sentFinalIgnitionCheck = true;
+            SENT_FINAL_IGNITION_CHECK = true;
         }
     } else if(ENGINE_STARTED || VEHICLE_IN_MOTION) {
         IGNITION_STATUS_TIMER.frequency = .5;
-        sentFinalIgnitionCheck = false;
+        SENT_FINAL_IGNITION_CHECK = false;
         getConfiguration()->desiredRunLevel = RunLevel::ALL_IO;
-        if(getConfiguration()->recurringObd2Requests && !pidSupportQueried) {
+        if(getConfiguration()->recurringObd2Requests && !PID_SUPPORT_QUERIED) {
             debug("Ignition is on - querying for supported OBD-II PIDs");
-            pidSupportQueried = true;
+            PID_SUPPORT_QUERIED = true;
             DiagnosticRequest request = {
                     arbitration_id: OBD2_FUNCTIONAL_BROADCAST_ID,
                     mode: 0x1,
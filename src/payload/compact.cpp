@@ -0,0 +1,293 @@
+#include "compact.h"
+
+#include <string.h>
+#include <sys/param.h>
+
+#include "payload/protobuf.h"
+#include "can/canutil.h"
+#include "signals.h"
+#include "util/strutil.h"
+#include "util/log.h"
+
+#define SIGNAL_VALUE_RECORD_SIZE 7
+#define CAN_FRAME_HEADER_SIZE 8
+#define TIMESTAMP_SIZE 8
+#define SIGNAL_INDEX_CACHE_SIZE 32
+// The most bytes a COBS code byte can cover, including itself
+#define COBS_MAX_BLOCK_SIZE 0xff
+
+namespace compact = openxc::payload::compact;
+namespace protobuf = openxc::payload::protobuf;
+
+using openxc::signals::getSignals;
+using openxc::signals::getSignalCount;
+using openxc::util::log::debug;
+
+/* Private: The index of a recently serialized signal for each bucket of name
+ * hashes, plus 1 so a zeroed entry is empty. Every entry is checked against
+ * the signal's name before it's used, so it doesn't need to be cleared when
+ * the message set changes.
+ */
+static uint16_t signalIndexCache[SIGNAL_INDEX_CACHE_SIZE];
+
+/* Private: Return the index of the signal with this name in the active message
+ * set, or -1 if there isn't one.
+ *
+ * The same few signals are serialized over and over, so this usually only
+ * has to compare against one name instead of searching the whole array.
+ */
+static int lookupSignalIndex(const char* name) {
+    CanSignal* signals = getSignals();
+    int signalCount = getSignalCount();
+    uint16_t* cached = &signalIndexCache[strhash(name) %
+            SIGNAL_INDEX_CACHE_SIZE];
+    if(*cached > 0 && *cached <= signalCount &&
+            !strcmp(signals[*cached - 1].genericName, name)) {
+        return *cached - 1;
+    }
+
+    for(int i = 0; i < signalCount; i++) {
+        if(!strcmp(signals[i].genericName, name)) {
+            *cached = i + 1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void writeLittleEndian(uint8_t* payload, uint64_t value, int size) {
+    for(int i = 0; i < size; i++) {
+        payload[i] = (value >> (i * 8)) & 0xff;
+    }
+}
+
+/* Private: Serialize a simple vehicle message as a fixed-size signal value
+ * record, if it's a value of a signal in the active message set.
+ *
+ * Returns the number of bytes written, or 0 if the message can't be sent as a
+ * signal value record.
+ */
+static int serializeSignalValue(openxc_VehicleMessage* message,
+        uint8_t payload[], size_t length) {
+    openxc_SimpleMessage* simple = &message->simple_message;
+    if(message->type != openxc_VehicleMessage_Type_SIMPLE ||
+            !simple->has_name || !simple->has_value || simple->has_event) {
+        return 0;
+    }
+
+    size_t recordSize = SIGNAL_VALUE_RECORD_SIZE +
+            (message->has_timestamp ? TIMESTAMP_SIZE : 0);
+    int index = lookupSignalIndex(simple->name);
+    if(index < 0 || index > 0xffff || length < recordSize) {
+        return 0;
+    }
+
+    uint8_t recordType;
+    uint32_t value;
+    if(simple->value.has_string_value) {
+        CanSignal* signal = &getSignals()[index];
+        const CanSignalState* state = openxc::can::lookupSignalState(
+                simple->value.string_value, signal);
+        if(state == NULL) {
+            return 0;
+        }
+        recordType = compact::RECORD_STATE;
+        value = state - signal->states;
+    } else if(simple->value.has_boolean_value) {
+        recordType = compact::RECORD_BOOLEAN;
+        value = simple->value.boolean_value;
+    } else if(simple->value.has_numeric_value) {
+        recordType = compact::RECORD_NUMBER;
+        float number = (float) simple->value.numeric_value;
+        memcpy(&value, &number, sizeof(value));
+    } else {
+        return 0;
+    }
+
+    payload[0] = recordType;
+    writeLittleEndian(&payload[1], index, 2);
+    writeLittleEndian(&payload[3], value, 4);
+    if(message->has_timestamp) {
+        payload[0] |= compact::RECORD_TIMESTAMP_FLAG;
+        writeLittleEndian(&payload[SIGNAL_VALUE_RECORD_SIZE],
+                message->timestamp, TIMESTAMP_SIZE);
+    }
+    return recordSize;
+}
+
+/* Private: Return the number of bytes framing adds to a record that fits in a
+ * buffer of this length: a COBS code byte for each block of up to 254 bytes,
+ * and the 0 delimiter.
+ */
+static size_t framingOverhead(size_t length) {
+    return length / (COBS_MAX_BLOCK_SIZE - 1) + 2;
+}
+
+/* Private: Frame a record by COBS-encoding it to the start of the payload, in
+ * place, and ending it with a 0 delimiter.
+ *
+ * payload - The buffer, with the record written at the offset.
+ * offset - Where the record starts, which must be at least one less than the
+ *      framingOverhead of the buffer's length so the encoding never overtakes
+ *      the bytes it hasn't read yet.
+ * recordLength - The length of the record.
+ *
+ * Returns the length of the framed record.
+ */
+static int frameRecord(uint8_t payload[], size_t offset,
+        size_t recordLength) {
+    size_t code = 0;
+    size_t output = 1;
+    uint8_t distance = 1;
+    for(size_t i = offset; i < offset + recordLength; i++) {
+        uint8_t byte = payload[i];
+        if(byte != 0) {
+            payload[output++] = byte;
+            ++distance;
+        }
+        if(byte == 0 || distance == COBS_MAX_BLOCK_SIZE) {
+            payload[code] = distance;
+            code = output++;
+            distance = 1;
+        }
+    }
+    payload[code] = distance;
+    payload[output++] = 0;
+    return output;
+}
+
+/* Private: Decode a COBS-encoded record in place.
+ *
+ * Returns the length of the decoded record, or 0 if it isn't valid.
+ */
+static size_t unframeRecord(uint8_t payload[], size_t length) {
+    size_t output = 0;
+    size_t position = 0;
+    while(position < length) {
+        uint8_t code = payload[position++];
+        if(code == 0 || position + code - 1 > length) {
+            return 0;
+        }
+        for(int i = 1; i < code; i++) {
+            payload[output++] = payload[position++];
+        }
+        if(code < COBS_MAX_BLOCK_SIZE && position < length) {
+            payload[output++] = 0;
+        }
+    }
+    return output;
+}
+
+/* Private: Write a RECORD_CAN_FRAME record.
+ *
+ * Returns the number of bytes written, or 0 if it didn't fit.
+ */
+static int serializeCanFrame(uint8_t busAddress, uint32_t id, bool extended,
+        const uint8_t* data, size_t dataLength, bool hasTimestamp,
+        uint64_t timestamp, uint8_t payload[], size_t length) {
+    dataLength = MIN(dataLength, CAN_MESSAGE_SIZE);
+    size_t recordSize = CAN_FRAME_HEADER_SIZE + dataLength +
+            (hasTimestamp ? TIMESTAMP_SIZE : 0);
+    if(length < recordSize) {
+        return 0;
+    }
+
+    payload[0] = compact::RECORD_CAN_FRAME;
+    payload[1] = busAddress;
+    writeLittleEndian(&payload[2], id, 4);
+    payload[6] = extended ? compact::CAN_FRAME_EXTENDED_FLAG : 0;
+    payload[7] = dataLength;
+    memcpy(&payload[CAN_FRAME_HEADER_SIZE], data, dataLength);
+    if(hasTimestamp) {
+        payload[0] |= compact::RECORD_TIMESTAMP_FLAG;
+        writeLittleEndian(&payload[CAN_FRAME_HEADER_SIZE + dataLength],
+                timestamp, TIMESTAMP_SIZE);
+    }
+    return recordSize;
+}
+
+int openxc::payload::compact::serializeCanMessage(uint8_t busAddress,
+        const CanMessage* message, bool includeTimestamp, uint8_t payload[],
+        size_t length) {
+    size_t overhead = framingOverhead(length);
+    if(length <= overhead) {
+        return 0;
+    }
+
+    int recordLength = serializeCanFrame(busAddress, message->id,
+            message->format == CanMessageFormat::EXTENDED, message->data,
+            message->length == 0 ? CAN_MESSAGE_SIZE : message->length,
+            includeTimestamp && message->timestamp != 0, message->timestamp,
+            &payload[overhead - 1], length - overhead);
+    return recordLength > 0 ?
+            frameRecord(payload, overhead - 1, recordLength) : 0;
+}
+
+size_t openxc::payload::compact::deserialize(uint8_t payload[], size_t length,
+        openxc_VehicleMessage* message) {
+    const uint8_t* delimiter = (const uint8_t*)memchr(payload, 0, length);
+    if(delimiter == NULL) {
+        return 0;
+    }
+
+    // The whole frame is consumed even if it isn't a valid message, so the
+    // next one starts after the delimiter
+    size_t frameLength = delimiter - payload + 1;
+    size_t recordLength = unframeRecord(payload, frameLength - 1);
+    if(recordLength < 2 || payload[0] != RECORD_PROTOBUF) {
+        debug("Dropping %u byte frame without a protobuf record",
+                frameLength);
+    } else if(protobuf::deserialize(&payload[1], recordLength - 1,
+                message) == 0) {
+        debug("Dropping %u byte frame with an invalid protobuf record",
+                frameLength);
+    }
+    return frameLength;
+}
+
+/* Private: Serialize a message as an unframed record.
+ *
+ * Returns the number of bytes written, or 0 if it didn't fit.
+ */
+static int serializeRecord(openxc_VehicleMessage* message, uint8_t payload[],
+        size_t length) {
+    int serializedLength = 0;
+    if(message->type == openxc_VehicleMessage_Type_CAN) {
+        openxc_CanMessage* canMessage = &message->can_message;
+        serializedLength = serializeCanFrame(canMessage->bus, canMessage->id,
+                canMessage->has_frame_format && canMessage->frame_format ==
+                    openxc_CanMessage_FrameFormat_EXTENDED,
+                canMessage->data.bytes, canMessage->data.size,
+                message->has_timestamp, message->timestamp, payload, length);
+    } else {
+        serializedLength = serializeSignalValue(message, payload, length);
+    }
+
+    if(serializedLength == 0 && length > 1) {
+        payload[0] = RECORD_PROTOBUF;
+        serializedLength = protobuf::serialize(message, &payload[1],
+                length - 1);
+        if(serializedLength > 0) {
+            ++serializedLength;
+        }
+    }
+    return serializedLength;
+}
+
+int openxc::payload::compact::serialize(openxc_VehicleMessage* message,
+        uint8_t payload[], size_t length) {
+    if(message == NULL) {
+        debug("Message object is NULL");
+        return 0;
+    }
+
+    size_t overhead = framingOverhead(length);
+    if(length <= overhead) {
+        return 0;
+    }
+
+    int recordLength = serializeRecord(message, &payload[overhead - 1],
+            length - overhead);
+    return recordLength > 0 ?
+            frameRecord(payload, overhead - 1, recordLength) : 0;
+}
@@ -0,0 +1,107 @@
+#ifndef __COMPACT_H__
+#define __COMPACT_H__
+
+#include "openxc.pb.h"
+#include "can/canutil.h"
+
+namespace openxc {
+namespace payload {
+namespace compact {
+
+/* Public: The record types in the compact payload format, in the first byte of
+ * every record.
+ *
+ * Every record is framed with Consistent Overhead Byte Stuffing (COBS) and
+ * ends with a 0 byte, which appears nowhere else in the stream. A host that
+ * starts reading mid-stream or loses bytes drops everything up to the next 0
+ * and picks up with the record after it. Framing adds 2 bytes to a record of
+ * up to 254 bytes. The layouts below are of the record before it's framed.
+ *
+ * A signal value is a fixed-size record of 7 bytes, or 15 with a timestamp:
+ *
+ *      byte 0 - The record type, optionally OR'd with RECORD_TIMESTAMP_FLAG.
+ *      bytes 1-2 - The index of the signal in the active message set, little
+ *          endian. The signal dictionary command returns the names.
+ *      bytes 3-6 - The value, little endian: an IEEE 754 float for
+ *          RECORD_NUMBER, 0 or 1 for RECORD_BOOLEAN, or the index of the state
+ *          in the signal's list of states for RECORD_STATE.
+ *      bytes 7-14 - If RECORD_TIMESTAMP_FLAG is set, the timestamp in
+ *          microseconds, little endian.
+ *
+ * A raw CAN message is a RECORD_CAN_FRAME record of 8 bytes plus the data, and
+ * another 8 with a timestamp:
+ *
+ *      byte 0 - RECORD_CAN_FRAME, optionally OR'd with RECORD_TIMESTAMP_FLAG.
+ *      byte 1 - The address of the CAN bus.
+ *      bytes 2-5 - The message ID, little endian.
+ *      byte 6 - Flags: CAN_FRAME_EXTENDED_FLAG if the ID is 29 bits.
+ *      byte 7 - The length of the data, 0 to 8.
+ *      bytes 8- - The data, followed by the timestamp in microseconds (little
+ *          endian) if RECORD_TIMESTAMP_FLAG is set.
+ *
+ * Any other message (diagnostic and command responses, evented messages and
+ * values of signals that aren't in the message set) is a RECORD_PROTOBUF byte
+ * followed by the message in the length-delimited protobuf format. Commands
+ * from the host are framed the same way.
+ */
+const uint8_t RECORD_NUMBER = 0x01;
+const uint8_t RECORD_BOOLEAN = 0x02;
+const uint8_t RECORD_STATE = 0x03;
+const uint8_t RECORD_CAN_FRAME = 0x04;
+const uint8_t RECORD_PROTOBUF = 0x40;
+const uint8_t RECORD_TIMESTAMP_FLAG = 0x80;
+
+const uint8_t CAN_FRAME_EXTENDED_FLAG = 0x01;
+
+/* Public: The largest possible RECORD_CAN_FRAME record, once it's framed.
+ */
+#define COMPACT_MAX_CAN_FRAME_RECORD_SIZE 26
+
+/* Public: Deserialize an OpenXC message from the first framed record in a
+ * compact payload. Only messages wrapped in a RECORD_PROTOBUF record are
+ * accepted, since commands from the host can't be expressed as signal value
+ * records. Any other record, or one that isn't valid, is dropped.
+ *
+ * payload - The bytestream payload to parse a message from.
+ * length -  The length of the payload.
+ * message - An output parameter, the object to store the deserialized message.
+ *
+ * Returns the number of bytes read for a complete frame from the payload, if
+ * the delimiter was found, even if the frame was dropped. The frame is decoded
+ * in place.
+ */
+size_t deserialize(uint8_t payload[], size_t length,
+        openxc_VehicleMessage* message);
+
+/* Public: Serialize an OpenXC message as a framed compact record and store it
+ * in the payload.
+ *
+ * message - The message to serialize.
+ * payload - The buffer to store the payload - must be allocated by the caller.
+ * length -  The length of the payload buffer.
+ *
+ * Returns the number of bytes written to the payload. If the length is 0, an
+ * error occurred while serializing.
+ */
+int serialize(openxc_VehicleMessage* message, uint8_t payload[], size_t length);
+
+/* Public: Serialize a received CAN message as a framed compact
+ * RECORD_CAN_FRAME record directly, without building an openxc_VehicleMessage
+ * first.
+ *
+ * busAddress - The address of the bus the message was received on.
+ * message - The received message.
+ * includeTimestamp - If true and the message has a timestamp, include it.
+ * payload - The buffer to store the payload - must be allocated by the caller.
+ * length -  The length of the payload buffer.
+ *
+ * Returns the number of bytes written to the payload, or 0 if it didn't fit.
+ */
+int serializeCanMessage(uint8_t busAddress, const CanMessage* message,
+        bool includeTimestamp, uint8_t payload[], size_t length);
+
+} // namespace compact
+} // namespace payload
+} // namespace openxc
+
+#endif // __COMPACT_H__
@@ -1,6 +1,5 @@
 #include "payload.h"
 
-#include <cJSON.h>
 #include <stdlib.h>
 #include <sys/param.h>
 #include <stdio.h>
@@ -9,6 +8,7 @@
 #include "util/strutil.h"
 #include "util/log.h"
 #include "config.h"
+#include "commands/commands.h"
 
 namespace payload = openxc::payload;
 
@@ -21,9 +21,12 @@ const char openxc::payload::json::PASSTHROUGH_COMMAND_NAME[] = "passthrough";
 const char openxc::payload::json::ACCEPTANCE_FILTER_BYPASS_COMMAND_NAME[] = "af_bypass";
 const char openxc::payload::json::PAYLOAD_FORMAT_COMMAND_NAME[] = "payload_format";
 const char openxc::payload::json::PREDEFINED_OBD2_REQUESTS_COMMAND_NAME[] = "predefined_obd2";
+const char openxc::payload::json::LATENCY_COMMAND_NAME[] = "latency";
+const char openxc::payload::json::SIGNAL_DICTIONARY_COMMAND_NAME[] = "signal_dictionary";
 
 const char openxc::payload::json::PAYLOAD_FORMAT_JSON_NAME[] = "json";
 const char openxc::payload::json::PAYLOAD_FORMAT_PROTOBUF_NAME[] = "protobuf";
+const char openxc::payload::json::PAYLOAD_FORMAT_COMPACT_NAME[] = "compact";
 
 const char openxc::payload::json::COMMAND_RESPONSE_FIELD_NAME[] = "command_response";
 const char openxc::payload::json::COMMAND_RESPONSE_MESSAGE_FIELD_NAME[] = "message";
@@ -36,6 +39,7 @@ const char openxc::payload::json::NAME_FIELD_NAME[] = "name";
 const char openxc::payload::json::VALUE_FIELD_NAME[] = "value";
 const char openxc::payload::json::EVENT_FIELD_NAME[] = "event";
 const char openxc::payload::json::FRAME_FORMAT_FIELD_NAME[] = "frame_format";
+const char openxc::payload::json::TIMESTAMP_FIELD_NAME[] = "timestamp";
 
 const char openxc::payload::json::FRAME_FORMAT_STANDARD_NAME[] = "standard";
 const char openxc::payload::json::FRAME_FORMAT_EXTENDED_NAME[] = "extended";
@@ -47,49 +51,194 @@ const char openxc::payload::json::DIAGNOSTIC_NRC_FIELD_NAME[] = "negative_respon
 const char openxc::payload::json::DIAGNOSTIC_PAYLOAD_FIELD_NAME[] = "payload";
 const char openxc::payload::json::DIAGNOSTIC_VALUE_FIELD_NAME[] = "value";
 
-static bool serializeDiagnostic(openxc_VehicleMessage* message, cJSON* root) {
-    cJSON_AddNumberToObject(root, payload::json::BUS_FIELD_NAME,
-            message->diagnostic_response.bus);
-    cJSON_AddNumberToObject(root, payload::json::ID_FIELD_NAME,
-            message->diagnostic_response.message_id);
-    cJSON_AddNumberToObject(root, payload::json::DIAGNOSTIC_MODE_FIELD_NAME,
-            message->diagnostic_response.mode);
-    cJSON_AddBoolToObject(root, payload::json::DIAGNOSTIC_SUCCESS_FIELD_NAME,
-            message->diagnostic_response.success);
-
-    if(message->diagnostic_response.has_pid) {
-        cJSON_AddNumberToObject(root, payload::json::DIAGNOSTIC_PID_FIELD_NAME,
-                message->diagnostic_response.pid);
-    }
-
-    if(message->diagnostic_response.has_negative_response_code) {
-        cJSON_AddNumberToObject(root, payload::json::DIAGNOSTIC_NRC_FIELD_NAME,
-                message->diagnostic_response.negative_response_code);
-    }
-
-    if(message->diagnostic_response.has_value) {
-        cJSON_AddNumberToObject(root, payload::json::DIAGNOSTIC_VALUE_FIELD_NAME,
-                message->diagnostic_response.value);
-    } else if(message->diagnostic_response.has_payload) {
-        char encodedData[67];
-        const char* maxAddress = encodedData + sizeof(encodedData);
-        char* encodedDataIndex = encodedData;
-        encodedDataIndex += sprintf(encodedDataIndex, "0x");
-        for(uint8_t i = 0; i < message->diagnostic_response.payload.size &&
-                encodedDataIndex < maxAddress; i++) {
-            encodedDataIndex += snprintf(encodedDataIndex,
-                    maxAddress - encodedDataIndex,
-                    "%02x",
-                    message->diagnostic_response.payload.bytes[i]);
+/* Private: The most bytes written as a hex string in a CAN message or
+ * diagnostic payload, the same limit the cJSON serializer had.
+ */
+#define MAX_HEX_STRING_BYTES 32
+
+/* Private: The most digits written after the decimal point in a number. This
+ * matches the resolution of printf's %f, which cJSON used, and is enough for
+ * timestamps in seconds to keep microsecond resolution. Signals can be rounded
+ * to fewer places with their precision.
+ */
+#define JSON_DECIMAL_PLACES 6
+
+/* Private: A cursor for writing a JSON object straight into an output buffer.
+ *
+ * The output has the same layout as cJSON_PrintUnformatted would produce for
+ * the same fields, but there's no intermediate tree, so nothing is allocated
+ * from the heap.
+ *
+ * buffer - The output buffer.
+ * length - The size of the output buffer.
+ * position - The index of the next byte to write.
+ * overflowed - True if anything didn't fit in the buffer.
+ * fieldCount - The number of fields written in the current object.
+ */
+typedef struct {
+    char* buffer;
+    size_t length;
+    size_t position;
+    bool overflowed;
+    int fieldCount;
+} JsonWriter;
+
+static void writeCharacter(JsonWriter* writer, char character) {
+    if(writer->position < writer->length) {
+        writer->buffer[writer->position++] = character;
+    } else {
+        writer->overflowed = true;
+    }
+}
+
+static void writeRaw(JsonWriter* writer, const char* text) {
+    for(; *text != '\0'; text++) {
+        writeCharacter(writer, *text);
+    }
+}
+
+/* Private: Write a quoted string, escaped the same way as cJSON.
+ */
+static void writeString(JsonWriter* writer, const char* value) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    writeCharacter(writer, '"');
+    for(const char* character = value; *character != '\0'; character++) {
+        unsigned char token = *character;
+        if(token > 31 && token != '"' && token != '\\') {
+            writeCharacter(writer, token);
+            continue;
         }
-        cJSON_AddStringToObject(root, payload::json::DIAGNOSTIC_PAYLOAD_FIELD_NAME,
-                encodedData);
+
+        writeCharacter(writer, '\\');
+        switch(token) {
+            case '\\':
+            case '"':
+                writeCharacter(writer, token);
+                break;
+            case '\b':
+                writeCharacter(writer, 'b');
+                break;
+            case '\f':
+                writeCharacter(writer, 'f');
+                break;
+            case '\n':
+                writeCharacter(writer, 'n');
+                break;
+            case '\r':
+                writeCharacter(writer, 'r');
+                break;
+            case '\t':
+                writeCharacter(writer, 't');
+                break;
+            default:
+                writeRaw(writer, "u00");
+                writeCharacter(writer, HEX_DIGITS[token >> 4]);
+                writeCharacter(writer, HEX_DIGITS[token & 0xf]);
+                break;
+        }
+    }
+    writeCharacter(writer, '"');
+}
+
+static void writeKey(JsonWriter* writer, const char* key) {
+    if(writer->fieldCount++ > 0) {
+        writeCharacter(writer, ',');
+    }
+    writeString(writer, key);
+    writeCharacter(writer, ':');
+}
+
+/* Private: Write a number in decimal notation, with up to
+ * JSON_DECIMAL_PLACES digits after the decimal point and no trailing zeros. A
+ * value JSON can't represent, e.g. NaN, is written as null.
+ */
+static void writeNumber(JsonWriter* writer, double value) {
+    char number[32];
+    if(formatDecimal(value, JSON_DECIMAL_PLACES, number, sizeof(number)) > 0) {
+        writeRaw(writer, number);
+    } else {
+        writeRaw(writer, "null");
+    }
+}
+
+static void writeNumberField(JsonWriter* writer, const char* key,
+        double value) {
+    writeKey(writer, key);
+    writeNumber(writer, value);
+}
+
+static void writeBooleanField(JsonWriter* writer, const char* key,
+        bool value) {
+    writeKey(writer, key);
+    writeRaw(writer, value ? "true" : "false");
+}
+
+static void writeStringField(JsonWriter* writer, const char* key,
+        const char* value) {
+    writeKey(writer, key);
+    writeString(writer, value);
+}
+
+/* Private: Write a byte array as a "0x"-prefixed hex string.
+ */
+static void writeHexField(JsonWriter* writer, const char* key,
+        const uint8_t* bytes, size_t size) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    writeKey(writer, key);
+    writeRaw(writer, "\"0x");
+    for(size_t i = 0; i < MIN(size, MAX_HEX_STRING_BYTES); i++) {
+        writeCharacter(writer, HEX_DIGITS[bytes[i] >> 4]);
+        writeCharacter(writer, HEX_DIGITS[bytes[i] & 0xf]);
+    }
+    writeCharacter(writer, '"');
+}
+
+/* Private: Write a dynamic field's value, if it has one.
+ */
+static void writeDynamicField(JsonWriter* writer, const char* key,
+        openxc_DynamicField* field) {
+    if(field->has_numeric_value) {
+        writeNumberField(writer, key, field->numeric_value);
+    } else if(field->has_boolean_value) {
+        writeBooleanField(writer, key, field->boolean_value);
+    } else if(field->has_string_value) {
+        writeStringField(writer, key, field->string_value);
+    }
+}
+
+static bool serializeDiagnostic(openxc_VehicleMessage* message,
+        JsonWriter* writer) {
+    openxc_DiagnosticResponse* response = &message->diagnostic_response;
+    writeNumberField(writer, payload::json::BUS_FIELD_NAME, response->bus);
+    writeNumberField(writer, payload::json::ID_FIELD_NAME,
+            response->message_id);
+    writeNumberField(writer, payload::json::DIAGNOSTIC_MODE_FIELD_NAME,
+            response->mode);
+    writeBooleanField(writer, payload::json::DIAGNOSTIC_SUCCESS_FIELD_NAME,
+            response->success);
+
+    if(response->has_pid) {
+        writeNumberField(writer, payload::json::DIAGNOSTIC_PID_FIELD_NAME,
+                response->pid);
+    }
+
+    if(response->has_negative_response_code) {
+        writeNumberField(writer, payload::json::DIAGNOSTIC_NRC_FIELD_NAME,
+                response->negative_response_code);
+    }
+
+    if(response->has_value) {
+        writeNumberField(writer, payload::json::DIAGNOSTIC_VALUE_FIELD_NAME,
+                response->value);
+    } else if(response->has_payload) {
+        writeHexField(writer, payload::json::DIAGNOSTIC_PAYLOAD_FIELD_NAME,
+                response->payload.bytes, response->payload.size);
     }
     return true;
 }
 
 static bool serializeCommandResponse(openxc_VehicleMessage* message,
-        cJSON* root) {
+        JsonWriter* writer) {
     const char* typeString = NULL;
     if(message->command_response.type == openxc_ControlCommand_Type_VERSION) {
         typeString = payload::json::VERSION_COMMAND_NAME;
@@ -105,47 +254,40 @@ static bool serializeCommandResponse(openxc_VehicleMessage* message,
         typeString = payload::json::PAYLOAD_FORMAT_COMMAND_NAME;
     } else if(message->command_response.type == openxc_ControlCommand_Type_PREDEFINED_OBD2_REQUESTS) {
         typeString = payload::json::PREDEFINED_OBD2_REQUESTS_COMMAND_NAME;
+    } else if(message->command_response.type == openxc::commands::LATENCY_COMMAND_TYPE) {
+        typeString = payload::json::LATENCY_COMMAND_NAME;
+    } else if(message->command_response.type == openxc::commands::SIGNAL_DICTIONARY_COMMAND_TYPE) {
+        typeString = payload::json::SIGNAL_DICTIONARY_COMMAND_NAME;
     } else {
         return false;
     }
 
-    cJSON_AddStringToObject(root, payload::json::COMMAND_RESPONSE_FIELD_NAME,
+    writeStringField(writer, payload::json::COMMAND_RESPONSE_FIELD_NAME,
             typeString);
     if(message->command_response.has_message) {
-        cJSON_AddStringToObject(root,
+        writeStringField(writer,
                 payload::json::COMMAND_RESPONSE_MESSAGE_FIELD_NAME,
                 message->command_response.message);
     }
 
     if(message->command_response.has_status) {
-        cJSON_AddBoolToObject(root,
+        writeBooleanField(writer,
                 payload::json::COMMAND_RESPONSE_STATUS_FIELD_NAME,
                 message->command_response.status);
     }
     return true;
 }
 
-static bool serializeCan(openxc_VehicleMessage* message, cJSON* root) {
-    cJSON_AddNumberToObject(root, payload::json::BUS_FIELD_NAME,
+static bool serializeCan(openxc_VehicleMessage* message, JsonWriter* writer) {
+    writeNumberField(writer, payload::json::BUS_FIELD_NAME,
             message->can_message.bus);
-    cJSON_AddNumberToObject(root, payload::json::ID_FIELD_NAME,
+    writeNumberField(writer, payload::json::ID_FIELD_NAME,
             message->can_message.id);
-
-    char encodedData[67];
-    const char* maxAddress = encodedData + sizeof(encodedData);
-    char* encodedDataIndex = encodedData;
-    encodedDataIndex += sprintf(encodedDataIndex, "0x");
-    for(uint8_t i = 0; i < message->can_message.data.size &&
-            encodedDataIndex < maxAddress; i++) {
-        encodedDataIndex += snprintf(encodedDataIndex,
-                maxAddress - encodedDataIndex,
-                "%02x", message->can_message.data.bytes[i]);
-    }
-    cJSON_AddStringToObject(root, payload::json::DATA_FIELD_NAME,
-            encodedData);
+    writeHexField(writer, payload::json::DATA_FIELD_NAME,
+            message->can_message.data.bytes, message->can_message.data.size);
 
     if(message->can_message.has_frame_format) {
-        cJSON_AddStringToObject(root, payload::json::FRAME_FORMAT_FIELD_NAME,
+        writeStringField(writer, payload::json::FRAME_FORMAT_FIELD_NAME,
                 message->can_message.frame_format == openxc_CanMessage_FrameFormat_STANDARD ?
                     payload::json::FRAME_FORMAT_STANDARD_NAME :
                         payload::json::FRAME_FORMAT_EXTENDED_NAME);
@@ -153,43 +295,531 @@ static bool serializeCan(openxc_VehicleMessage* message, cJSON* root) {
     return true;
 }
 
-static cJSON* serializeDynamicField(openxc_DynamicField* field) {
-    cJSON* value = NULL;
-    if(field->has_numeric_value) {
-        value = cJSON_CreateNumber(field->numeric_value);
-    } else if(field->has_boolean_value) {
-        value = cJSON_CreateBool(field->boolean_value);
-    } else if(field->has_string_value) {
-        value = cJSON_CreateString(field->string_value);
+static bool serializeSimple(openxc_VehicleMessage* message,
+        JsonWriter* writer) {
+    writeStringField(writer, payload::json::NAME_FIELD_NAME,
+            message->simple_message.name);
+
+    if(message->simple_message.has_value) {
+        writeDynamicField(writer, payload::json::VALUE_FIELD_NAME,
+                &message->simple_message.value);
+    }
+
+    if(message->simple_message.has_event) {
+        writeDynamicField(writer, payload::json::EVENT_FIELD_NAME,
+                &message->simple_message.event);
     }
-    return value;
+    return true;
 }
 
-static bool serializeSimple(openxc_VehicleMessage* message, cJSON* root) {
-    const char* name = message->simple_message.name;
-    cJSON_AddStringToObject(root, payload::json::NAME_FIELD_NAME, name);
+/* Private: The type of a value parsed from a JSON command.
+ *
+ * JSON_NONE - The field wasn't in the command.
+ * JSON_OTHER - null, or an object or array that isn't read.
+ */
+typedef enum {
+    JSON_NONE,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_BOOLEAN,
+    JSON_OTHER
+} JsonValueType;
+
+/* Private: A value parsed from a JSON command. Strings aren't copied or
+ * unescaped until they're stored in the message, so they point back into the
+ * payload.
+ */
+typedef struct {
+    JsonValueType type;
+    union {
+        struct {
+            const char* start;
+            uint16_t length;
+        } string;
+        double number;
+        bool boolean;
+    };
+} JsonValue;
+
+/* Private: The fields of a diagnostic request in a JSON command.
+ */
+typedef struct {
+    bool present;
+    JsonValue bus;
+    JsonValue mode;
+    JsonValue id;
+    JsonValue pid;
+    JsonValue payload;
+    JsonValue multipleResponses;
+    JsonValue frequency;
+    JsonValue decodedType;
+    JsonValue name;
+} JsonDiagnosticRequestFields;
+
+/* Private: Every field that's read from an incoming JSON message, for all of
+ * the message types. The type isn't known until the whole object has been
+ * read, because the field that determines it can be anywhere in the object.
+ */
+typedef struct {
+    JsonValue command;
+    JsonValue name;
+    JsonValue value;
+    JsonValue event;
+    JsonValue bus;
+    JsonValue id;
+    JsonValue data;
+    JsonValue frameFormat;
+    JsonValue enabled;
+    JsonValue bypass;
+    JsonValue format;
+    JsonValue action;
+    JsonDiagnosticRequestFields request;
+} JsonFields;
+
+/* Private: A position in a NUL-terminated JSON message.
+ */
+typedef struct {
+    const char* position;
+    const char* end;
+} JsonCursor;
 
-    cJSON* value = NULL;
-    if(message->simple_message.has_value) {
-        value = serializeDynamicField(&message->simple_message.value);
-        if(value != NULL) {
-            cJSON_AddItemToObject(root, payload::json::VALUE_FIELD_NAME, value);
+/* Private: Objects and arrays nested deeper than this in a command are
+ * rejected, to bound the recursion while skipping them.
+ */
+#define MAX_JSON_DEPTH 8
+
+static void skipWhitespace(JsonCursor* cursor) {
+    while(cursor->position < cursor->end && (*cursor->position == ' ' ||
+                *cursor->position == '\t' || *cursor->position == '\n' ||
+                *cursor->position == '\r')) {
+        ++cursor->position;
+    }
+}
+
+static bool consume(JsonCursor* cursor, char character) {
+    skipWhitespace(cursor);
+    if(cursor->position < cursor->end && *cursor->position == character) {
+        ++cursor->position;
+        return true;
+    }
+    return false;
+}
+
+static bool consumeLiteral(JsonCursor* cursor, const char* literal) {
+    size_t length = strlen(literal);
+    if((size_t)(cursor->end - cursor->position) >= length &&
+            !strncmp(cursor->position, literal, length)) {
+        cursor->position += length;
+        return true;
+    }
+    return false;
+}
+
+/* Private: Read a string, leaving the cursor after its closing quote.
+ *
+ * start - An output parameter, the first character inside the quotes.
+ * length - An output parameter, the length of the string, still escaped.
+ */
+static bool parseString(JsonCursor* cursor, const char** start,
+        size_t* length) {
+    if(!consume(cursor, '"')) {
+        return false;
+    }
+
+    *start = cursor->position;
+    for(; cursor->position < cursor->end; ++cursor->position) {
+        if(*cursor->position == '\\') {
+            ++cursor->position;
+        } else if(*cursor->position == '"') {
+            *length = cursor->position - *start;
+            ++cursor->position;
+            return true;
         }
     }
+    return false;
+}
 
-    cJSON* event = NULL;
-    if(message->simple_message.has_event) {
-        event = serializeDynamicField(&message->simple_message.event);
-        if(event != NULL) {
-            cJSON_AddItemToObject(root, payload::json::EVENT_FIELD_NAME, event);
+/* Private: The most significant digits of a number that are kept while
+ * parsing it, which is more than a double can represent and still fits in a
+ * uint64_t.
+ */
+#define MAX_JSON_NUMBER_DIGITS 19
+
+/* Private: Exponents of numbers are clamped to this magnitude, past the range
+ * of a double, to bound the scaling loop.
+ */
+#define MAX_JSON_NUMBER_EXPONENT 400
+
+static bool isDigit(const JsonCursor* cursor) {
+    return cursor->position < cursor->end && *cursor->position >= '0' &&
+            *cursor->position <= '9';
+}
+
+/* Private: Read a number in the JSON grammar, leaving the cursor after it.
+ *
+ * This is used instead of strtod, which can allocate from the heap in newlib
+ * and accepts numbers JSON doesn't, like hex and "inf". The digits are
+ * collected in an integer and scaled by a power of ten once, like cJSON's
+ * parse_number, so the result may be off from the closest double in the last
+ * bit.
+ */
+static bool parseNumber(JsonCursor* cursor, double* number) {
+    bool negative = cursor->position < cursor->end &&
+            *cursor->position == '-';
+    if(negative) {
+        ++cursor->position;
+    }
+    if(!isDigit(cursor)) {
+        return false;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    // JSON doesn't allow leading zeros, so a number starting with 0 has no
+    // other digits before the decimal point
+    bool integerPart = *cursor->position != '0';
+    if(!integerPart) {
+        ++cursor->position;
+    }
+    for(; integerPart && isDigit(cursor); ++cursor->position) {
+        if(digits < MAX_JSON_NUMBER_DIGITS) {
+            mantissa = mantissa * 10 + (*cursor->position - '0');
+            digits += mantissa != 0;
+        } else {
+            ++exponent;
+        }
+    }
+
+    if(cursor->position < cursor->end && *cursor->position == '.') {
+        ++cursor->position;
+        if(!isDigit(cursor)) {
+            return false;
+        }
+        for(; isDigit(cursor); ++cursor->position) {
+            if(digits < MAX_JSON_NUMBER_DIGITS) {
+                mantissa = mantissa * 10 + (*cursor->position - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
         }
     }
+
+    if(cursor->position < cursor->end &&
+            (*cursor->position == 'e' || *cursor->position == 'E')) {
+        ++cursor->position;
+        bool negativeExponent = false;
+        if(cursor->position < cursor->end && (*cursor->position == '+' ||
+                    *cursor->position == '-')) {
+            negativeExponent = *cursor->position == '-';
+            ++cursor->position;
+        }
+        if(!isDigit(cursor)) {
+            return false;
+        }
+        int value = 0;
+        for(; isDigit(cursor); ++cursor->position) {
+            if(value < MAX_JSON_NUMBER_EXPONENT) {
+                value = value * 10 + (*cursor->position - '0');
+            }
+        }
+        exponent += negativeExponent ? -value : value;
+    }
+
+    double scale = 1;
+    for(int i = 0; i < MIN(abs(exponent), MAX_JSON_NUMBER_EXPONENT); i++) {
+        scale *= 10;
+    }
+    *number = exponent < 0 ? mantissa / scale : mantissa * scale;
+    if(negative) {
+        *number = -*number;
+    }
+    // Too large for a double, which strtod would have returned as infinity
+    return *number - *number == 0;
+}
+
+static bool parseObject(JsonCursor* cursor, JsonFields* fields,
+        JsonDiagnosticRequestFields* request, int depth);
+
+/* Private: Read any JSON value, storing it in the value if it's not NULL.
+ * Objects and arrays are skipped.
+ */
+static bool parseValue(JsonCursor* cursor, JsonValue* value, int depth) {
+    JsonValue parsed;
+    parsed.type = JSON_OTHER;
+
+    skipWhitespace(cursor);
+    if(cursor->position >= cursor->end || depth > MAX_JSON_DEPTH) {
+        return false;
+    }
+
+    char first = *cursor->position;
+    if(first == '"') {
+        size_t length;
+        if(!parseString(cursor, &parsed.string.start, &length)) {
+            return false;
+        }
+        parsed.type = JSON_STRING;
+        parsed.string.length = length;
+    } else if(first == '-' || (first >= '0' && first <= '9')) {
+        if(!parseNumber(cursor, &parsed.number)) {
+            return false;
+        }
+        parsed.type = JSON_NUMBER;
+    } else if(consumeLiteral(cursor, "true")) {
+        parsed.type = JSON_BOOLEAN;
+        parsed.boolean = true;
+    } else if(consumeLiteral(cursor, "false")) {
+        parsed.type = JSON_BOOLEAN;
+        parsed.boolean = false;
+    } else if(consumeLiteral(cursor, "null")) {
+        // Stored as JSON_OTHER, like any other value that isn't read
+    } else if(first == '{') {
+        if(!parseObject(cursor, NULL, NULL, depth + 1)) {
+            return false;
+        }
+    } else if(first == '[') {
+        ++cursor->position;
+        if(!consume(cursor, ']')) {
+            do {
+                if(!parseValue(cursor, NULL, depth + 1)) {
+                    return false;
+                }
+            } while(consume(cursor, ','));
+            if(!consume(cursor, ']')) {
+                return false;
+            }
+        }
+    } else {
+        return false;
+    }
+
+    // Like cJSON_GetObjectItem, use the first value if a key is repeated
+    if(value != NULL && value->type == JSON_NONE) {
+        *value = parsed;
+    }
     return true;
 }
 
-/* Private: Parse a hex string as a byte array.
+static bool keyEquals(const char* key, size_t keyLength, const char* name) {
+    return strlen(name) == keyLength && !strncmp(key, name, keyLength);
+}
+
+/* Private: Return where to store the value of a field in the top level object
+ * of a message, or NULL if it's not used.
+ */
+static JsonValue* lookupField(JsonFields* fields, const char* key,
+        size_t keyLength) {
+    if(keyEquals(key, keyLength, "command")) {
+        return &fields->command;
+    } else if(keyEquals(key, keyLength, payload::json::NAME_FIELD_NAME)) {
+        return &fields->name;
+    } else if(keyEquals(key, keyLength, payload::json::VALUE_FIELD_NAME)) {
+        return &fields->value;
+    } else if(keyEquals(key, keyLength, payload::json::EVENT_FIELD_NAME)) {
+        return &fields->event;
+    } else if(keyEquals(key, keyLength, payload::json::BUS_FIELD_NAME)) {
+        return &fields->bus;
+    } else if(keyEquals(key, keyLength, payload::json::ID_FIELD_NAME)) {
+        return &fields->id;
+    } else if(keyEquals(key, keyLength, payload::json::DATA_FIELD_NAME)) {
+        return &fields->data;
+    } else if(keyEquals(key, keyLength,
+                payload::json::FRAME_FORMAT_FIELD_NAME)) {
+        return &fields->frameFormat;
+    } else if(keyEquals(key, keyLength, "enabled")) {
+        return &fields->enabled;
+    } else if(keyEquals(key, keyLength, "bypass")) {
+        return &fields->bypass;
+    } else if(keyEquals(key, keyLength, "format")) {
+        return &fields->format;
+    } else if(keyEquals(key, keyLength, "action")) {
+        return &fields->action;
+    }
+    return NULL;
+}
+
+/* Private: Return where to store the value of a field in the request object of
+ * a diagnostic command, or NULL if it's not used.
+ */
+static JsonValue* lookupRequestField(JsonDiagnosticRequestFields* request,
+        const char* key, size_t keyLength) {
+    if(keyEquals(key, keyLength, "bus")) {
+        return &request->bus;
+    } else if(keyEquals(key, keyLength, "mode")) {
+        return &request->mode;
+    } else if(keyEquals(key, keyLength, "id")) {
+        return &request->id;
+    } else if(keyEquals(key, keyLength, "pid")) {
+        return &request->pid;
+    } else if(keyEquals(key, keyLength, "payload")) {
+        return &request->payload;
+    } else if(keyEquals(key, keyLength, "multiple_responses")) {
+        return &request->multipleResponses;
+    } else if(keyEquals(key, keyLength, "frequency")) {
+        return &request->frequency;
+    } else if(keyEquals(key, keyLength, "decoded_type")) {
+        return &request->decodedType;
+    } else if(keyEquals(key, keyLength, "name")) {
+        return &request->name;
+    }
+    return NULL;
+}
+
+/* Private: Read an object, storing the fields that are used in either the
+ * top-level fields or the diagnostic request fields. If both are NULL, the
+ * object is skipped.
+ */
+static bool parseObject(JsonCursor* cursor, JsonFields* fields,
+        JsonDiagnosticRequestFields* request, int depth) {
+    if(!consume(cursor, '{')) {
+        return false;
+    }
+    if(consume(cursor, '}')) {
+        return true;
+    }
+
+    do {
+        const char* key;
+        size_t keyLength;
+        if(!parseString(cursor, &key, &keyLength) || !consume(cursor, ':')) {
+            return false;
+        }
+
+        skipWhitespace(cursor);
+        bool parsed;
+        if(fields != NULL && keyEquals(key, keyLength, "request") &&
+                cursor->position < cursor->end && *cursor->position == '{' &&
+                !fields->request.present) {
+            fields->request.present = true;
+            parsed = parseObject(cursor, NULL, &fields->request, depth + 1);
+        } else {
+            JsonValue* value = NULL;
+            if(fields != NULL) {
+                value = lookupField(fields, key, keyLength);
+            } else if(request != NULL) {
+                value = lookupRequestField(request, key, keyLength);
+            }
+            parsed = parseValue(cursor, value, depth);
+        }
+
+        if(!parsed) {
+            return false;
+        }
+    } while(consume(cursor, ','));
+
+    return consume(cursor, '}');
+}
+
+static bool hasField(const JsonValue* value) {
+    return value->type != JSON_NONE;
+}
+
+/* Private: Return a field as an integer, the same as cJSON's valueint - numbers
+ * are truncated, true is 1 and anything else is 0.
+ */
+static int intField(const JsonValue* value) {
+    if(value->type == JSON_NUMBER) {
+        return (int)value->number;
+    } else if(value->type == JSON_BOOLEAN) {
+        return value->boolean;
+    }
+    return 0;
+}
+
+static bool stringFieldEquals(const JsonValue* value, const char* expected) {
+    return value->type == JSON_STRING &&
+            keyEquals(value->string.start, value->string.length, expected);
+}
+
+/* Private: Return true if a string field starts with the prefix.
+ */
+static bool stringFieldStartsWith(const JsonValue* value, const char* prefix) {
+    size_t prefixLength = strlen(prefix);
+    return value->type == JSON_STRING &&
+            value->string.length >= prefixLength &&
+            !strncmp(value->string.start, prefix, prefixLength);
+}
+
+static int parseHexDigit(char digit) {
+    if(digit >= '0' && digit <= '9') {
+        return digit - '0';
+    } else if(digit >= 'a' && digit <= 'f') {
+        return digit - 'a' + 10;
+    } else if(digit >= 'A' && digit <= 'F') {
+        return digit - 'A' + 10;
+    }
+    return -1;
+}
+
+/* Private: Unescape a string field into a NUL-terminated string, truncated if
+ * it doesn't fit.
+ */
+static void copyStringField(const JsonValue* value, char* destination,
+        size_t size) {
+    const char* source = value->string.start;
+    const char* end = source + value->string.length;
+    size_t length = 0;
+    while(source < end && length + 1 < size) {
+        char character = *source++;
+        if(character == '\\' && source < end) {
+            character = *source++;
+            switch(character) {
+                case 'b':
+                    character = '\b';
+                    break;
+                case 'f':
+                    character = '\f';
+                    break;
+                case 'n':
+                    character = '\n';
+                    break;
+                case 'r':
+                    character = '\r';
+                    break;
+                case 't':
+                    character = '\t';
+                    break;
+                case 'u': {
+                    uint16_t codePoint = 0;
+                    for(int i = 0; i < 4 && source < end; i++) {
+                        int digit = parseHexDigit(*source++);
+                        codePoint = (codePoint << 4) | (digit < 0 ? 0 : digit);
+                    }
+                    // Encode as UTF-8, like cJSON
+                    if(codePoint < 0x80) {
+                        character = codePoint;
+                    } else if(codePoint < 0x800) {
+                        if(length + 2 >= size) {
+                            source = end;
+                            continue;
+                        }
+                        destination[length++] = 0xc0 | (codePoint >> 6);
+                        character = 0x80 | (codePoint & 0x3f);
+                    } else {
+                        if(length + 3 >= size) {
+                            source = end;
+                            continue;
+                        }
+                        destination[length++] = 0xe0 | (codePoint >> 12);
+                        destination[length++] = 0x80 | ((codePoint >> 6) & 0x3f);
+                        character = 0x80 | (codePoint & 0x3f);
+                    }
+                    break;
+                }
+                default:
+                    // \", \\ and \/ are the character itself
+                    break;
+            }
+        }
+        destination[length++] = character;
+    }
+    destination[length] = '\0';
+}
+
+/* Private: Parse a hex string field as a byte array.
  *
- * source - The hex string to parse - each byte in the string *must* be
+ * value - The hex string to parse - each byte in the string *must* be
  *      represented with 2 characters, e.g. `1` is `01` - the complete string
  *      must have an even number of characters. The string can optionally begin
  *      with a '0x' prefix.
@@ -198,209 +828,204 @@ static bool serializeSimple(openxc_VehicleMessage* message, cJSON* root) {
  *
  * Returns the size of the byte array stored in dest.
  */
-static size_t dehexlify(const char source[], uint8_t* destination,
+static size_t dehexlify(const JsonValue* value, uint8_t* destination,
         size_t destinationLength) {
-    size_t i = 0;
-    if(strstr(source, "0x") != NULL) {
-        i += 2;
+    const char* source = value->string.start;
+    const char* end = source + value->string.length;
+    if(end - source >= 2 && source[0] == '0' && source[1] == 'x') {
+        source += 2;
     }
 
     size_t byteIndex = 0;
-    for(; i < strlen(source) && byteIndex < destinationLength; i += 2) {
-        char bytestring[3] = {0};
-        strncpy(bytestring, &(source[i]), 2);
-
-        char* end = NULL;
-        destination[byteIndex++] = strtoul(bytestring, &end, 16);
+    for(; source < end && byteIndex < destinationLength; source += 2) {
+        int high = parseHexDigit(source[0]);
+        int low = source + 1 < end ? parseHexDigit(source[1]) : -1;
+        if(high < 0) {
+            destination[byteIndex++] = 0;
+        } else if(low < 0) {
+            destination[byteIndex++] = high;
+        } else {
+            destination[byteIndex++] = (high << 4) | low;
+        }
     }
     return byteIndex;
 }
 
-static void deserializePassthrough(cJSON* root, openxc_ControlCommand* command) {
+static void deserializePassthrough(const JsonFields* fields,
+        openxc_ControlCommand* command) {
     command->has_type = true;
     command->type = openxc_ControlCommand_Type_PASSTHROUGH;
     command->has_passthrough_mode_request = true;
 
-    cJSON* element = cJSON_GetObjectItem(root, "bus");
-    if(element != NULL) {
+    if(hasField(&fields->bus)) {
         command->passthrough_mode_request.has_bus = true;
-        command->passthrough_mode_request.bus = element->valueint;
+        command->passthrough_mode_request.bus = intField(&fields->bus);
     }
 
-    element = cJSON_GetObjectItem(root, "enabled");
-    if(element != NULL) {
+    if(hasField(&fields->enabled)) {
         command->passthrough_mode_request.has_enabled = true;
-        command->passthrough_mode_request.enabled = bool(element->valueint);
+        command->passthrough_mode_request.enabled =
+                bool(intField(&fields->enabled));
     }
 }
 
-static void deserializePayloadFormat(cJSON* root,
+static void deserializePayloadFormat(const JsonFields* fields,
         openxc_ControlCommand* command) {
     command->has_type = true;
     command->type = openxc_ControlCommand_Type_PAYLOAD_FORMAT;
     command->has_payload_format_command = true;
 
-    cJSON* element = cJSON_GetObjectItem(root, "format");
-    if(element != NULL) {
-        if(!strcmp(element->valuestring,
-                    openxc::payload::json::PAYLOAD_FORMAT_JSON_NAME)) {
-            command->payload_format_command.has_format = true;
-            command->payload_format_command.format =
-                    openxc_PayloadFormatCommand_PayloadFormat_JSON;
-        } else if(!strcmp(element->valuestring,
-                    openxc::payload::json::PAYLOAD_FORMAT_PROTOBUF_NAME)) {
-            command->payload_format_command.has_format = true;
-            command->payload_format_command.format =
-                    openxc_PayloadFormatCommand_PayloadFormat_PROTOBUF;
-        }
+    if(stringFieldEquals(&fields->format,
+                openxc::payload::json::PAYLOAD_FORMAT_JSON_NAME)) {
+        command->payload_format_command.has_format = true;
+        command->payload_format_command.format =
+                openxc_PayloadFormatCommand_PayloadFormat_JSON;
+    } else if(stringFieldEquals(&fields->format,
+                openxc::payload::json::PAYLOAD_FORMAT_PROTOBUF_NAME)) {
+        command->payload_format_command.has_format = true;
+        command->payload_format_command.format =
+                openxc_PayloadFormatCommand_PayloadFormat_PROTOBUF;
+    } else if(stringFieldEquals(&fields->format,
+                openxc::payload::json::PAYLOAD_FORMAT_COMPACT_NAME)) {
+        command->payload_format_command.has_format = true;
+        command->payload_format_command.format =
+                openxc::commands::COMPACT_PAYLOAD_FORMAT;
     }
 }
 
-static void deserializePredefinedObd2RequestsCommand(cJSON* root,
+static void deserializePredefinedObd2RequestsCommand(const JsonFields* fields,
         openxc_ControlCommand* command) {
     command->has_type = true;
     command->type = openxc_ControlCommand_Type_PREDEFINED_OBD2_REQUESTS;
     command->has_predefined_obd2_requests_command = true;
 
-    cJSON* element = cJSON_GetObjectItem(root, "enabled");
-    if(element != NULL) {
+    if(hasField(&fields->enabled)) {
         command->predefined_obd2_requests_command.has_enabled = true;
-        command->predefined_obd2_requests_command.enabled = bool(element->valueint);
+        command->predefined_obd2_requests_command.enabled =
+                bool(intField(&fields->enabled));
     }
 }
 
-static void deserializeAfBypass(cJSON* root, openxc_ControlCommand* command) {
+static void deserializeAfBypass(const JsonFields* fields,
+        openxc_ControlCommand* command) {
     command->has_type = true;
     command->type = openxc_ControlCommand_Type_ACCEPTANCE_FILTER_BYPASS;
     command->has_acceptance_filter_bypass_command = true;
 
-    cJSON* element = cJSON_GetObjectItem(root, "bus");
-    if(element != NULL) {
+    if(hasField(&fields->bus)) {
         command->acceptance_filter_bypass_command.has_bus = true;
-        command->acceptance_filter_bypass_command.bus = element->valueint;
+        command->acceptance_filter_bypass_command.bus = intField(&fields->bus);
     }
 
-    element = cJSON_GetObjectItem(root, "bypass");
-    if(element != NULL) {
+    if(hasField(&fields->bypass)) {
         command->acceptance_filter_bypass_command.has_bypass = true;
         command->acceptance_filter_bypass_command.bypass =
-            bool(element->valueint);
+            bool(intField(&fields->bypass));
     }
 }
 
-static void deserializeDiagnostic(cJSON* root, openxc_ControlCommand* command) {
+static void deserializeDiagnostic(const JsonFields* fields,
+        openxc_ControlCommand* command) {
     command->has_type = true;
     command->type = openxc_ControlCommand_Type_DIAGNOSTIC;
     command->has_diagnostic_request = true;
 
-    cJSON* action = cJSON_GetObjectItem(root, "action");
-    if(action != NULL && action->type == cJSON_String) {
+    if(stringFieldEquals(&fields->action, "add")) {
         command->diagnostic_request.has_action = true;
-        if(!strcmp(action->valuestring, "add")) {
-            command->diagnostic_request.action =
-                    openxc_DiagnosticControlCommand_Action_ADD;
-        } else if(!strcmp(action->valuestring, "cancel")) {
-            command->diagnostic_request.action =
-                    openxc_DiagnosticControlCommand_Action_CANCEL;
-        } else {
-            command->diagnostic_request.has_action = false;
-        }
+        command->diagnostic_request.action =
+                openxc_DiagnosticControlCommand_Action_ADD;
+    } else if(stringFieldEquals(&fields->action, "cancel")) {
+        command->diagnostic_request.has_action = true;
+        command->diagnostic_request.action =
+                openxc_DiagnosticControlCommand_Action_CANCEL;
     }
 
-    cJSON* request = cJSON_GetObjectItem(root, "request");
-    if(request != NULL) {
-        cJSON* element = cJSON_GetObjectItem(request, "bus");
-        if(element != NULL) {
-            command->diagnostic_request.request.has_bus = true;
-            command->diagnostic_request.request.bus = element->valueint;
-        }
+    const JsonDiagnosticRequestFields* request = &fields->request;
+    if(!request->present) {
+        return;
+    }
 
-        element = cJSON_GetObjectItem(request, "mode");
-        if(element != NULL) {
-            command->diagnostic_request.request.has_mode = true;
-            command->diagnostic_request.request.mode = element->valueint;
-        }
+    openxc_DiagnosticRequest* diagnosticRequest =
+            &command->diagnostic_request.request;
+    if(hasField(&request->bus)) {
+        diagnosticRequest->has_bus = true;
+        diagnosticRequest->bus = intField(&request->bus);
+    }
 
-        element = cJSON_GetObjectItem(request, "id");
-        if(element != NULL) {
-            command->diagnostic_request.request.has_message_id = true;
-            command->diagnostic_request.request.message_id = element->valueint;
-        }
+    if(hasField(&request->mode)) {
+        diagnosticRequest->has_mode = true;
+        diagnosticRequest->mode = intField(&request->mode);
+    }
 
-        element = cJSON_GetObjectItem(request, "pid");
-        if(element != NULL) {
-            command->diagnostic_request.request.has_pid = true;
-            command->diagnostic_request.request.pid = element->valueint;
-        }
+    if(hasField(&request->id)) {
+        diagnosticRequest->has_message_id = true;
+        diagnosticRequest->message_id = intField(&request->id);
+    }
 
-        element = cJSON_GetObjectItem(request, "payload");
-        if(element != NULL) {
-            command->diagnostic_request.request.has_payload = true;
-            command->diagnostic_request.request.payload.size = dehexlify(
-                    element->valuestring,
-                    command->diagnostic_request.request.payload.bytes,
-                    sizeof(((openxc_DiagnosticRequest*)0)->payload.bytes));
-        }
+    if(hasField(&request->pid)) {
+        diagnosticRequest->has_pid = true;
+        diagnosticRequest->pid = intField(&request->pid);
+    }
 
-        element = cJSON_GetObjectItem(request, "multiple_responses");
-        if(element != NULL) {
-            command->diagnostic_request.request.has_multiple_responses = true;
-            command->diagnostic_request.request.multiple_responses =
-                bool(element->valueint);
-        }
+    if(request->payload.type == JSON_STRING) {
+        diagnosticRequest->has_payload = true;
+        diagnosticRequest->payload.size = dehexlify(&request->payload,
+                diagnosticRequest->payload.bytes,
+                sizeof(diagnosticRequest->payload.bytes));
+    }
 
-        element = cJSON_GetObjectItem(request, "frequency");
-        if(element != NULL) {
-            command->diagnostic_request.request.has_frequency = true;
-            command->diagnostic_request.request.frequency =
-                element->valuedouble;
-        }
+    if(hasField(&request->multipleResponses)) {
+        diagnosticRequest->has_multiple_responses = true;
+        diagnosticRequest->multiple_responses =
+                bool(intField(&request->multipleResponses));
+    }
 
-        element = cJSON_GetObjectItem(request, "decoded_type");
-        if(element != NULL) {
-            if(!strcmp(element->valuestring, "obd2")) {
-                command->diagnostic_request.request.has_decoded_type = true;
-                command->diagnostic_request.request.decoded_type =
-                        openxc_DiagnosticRequest_DecodedType_OBD2;
-            } else if(!strcmp(element->valuestring, "none")) {
-                command->diagnostic_request.request.has_decoded_type = true;
-                command->diagnostic_request.request.decoded_type =
-                        openxc_DiagnosticRequest_DecodedType_NONE;
-            }
-        }
+    if(hasField(&request->frequency)) {
+        diagnosticRequest->has_frequency = true;
+        diagnosticRequest->frequency = request->frequency.type == JSON_NUMBER ?
+                request->frequency.number : 0;
+    }
 
-        element = cJSON_GetObjectItem(request, "name");
-        if(element != NULL && element->type == cJSON_String) {
-            command->diagnostic_request.request.has_name = true;
-            strcpy(command->diagnostic_request.request.name,
-                    element->valuestring);
-        }
+    if(stringFieldEquals(&request->decodedType, "obd2")) {
+        diagnosticRequest->has_decoded_type = true;
+        diagnosticRequest->decoded_type =
+                openxc_DiagnosticRequest_DecodedType_OBD2;
+    } else if(stringFieldEquals(&request->decodedType, "none")) {
+        diagnosticRequest->has_decoded_type = true;
+        diagnosticRequest->decoded_type =
+                openxc_DiagnosticRequest_DecodedType_NONE;
+    }
+
+    if(request->name.type == JSON_STRING) {
+        diagnosticRequest->has_name = true;
+        copyStringField(&request->name, diagnosticRequest->name,
+                sizeof(diagnosticRequest->name));
     }
 }
 
-static bool deserializeDynamicField(cJSON* element,
+static bool deserializeDynamicField(const JsonValue* value,
         openxc_DynamicField* field) {
     bool status = true;
     field->has_type = true;
-    switch(element->type) {
-        case cJSON_String:
+    switch(value->type) {
+        case JSON_STRING:
             field->type = openxc_DynamicField_Type_STRING;
             field->has_string_value = true;
-            strcpy(field->string_value, element->valuestring);
+            copyStringField(value, field->string_value,
+                    sizeof(field->string_value));
             break;
-        case cJSON_False:
-        case cJSON_True:
+        case JSON_BOOLEAN:
             field->type = openxc_DynamicField_Type_BOOL;
             field->has_boolean_value = true;
-            field->boolean_value = bool(element->valueint);
+            field->boolean_value = value->boolean;
             break;
-        case cJSON_Number:
+        case JSON_NUMBER:
             field->type = openxc_DynamicField_Type_NUM;
             field->has_numeric_value = true;
-            field->numeric_value = element->valuedouble;
+            field->numeric_value = value->number;
             break;
         default:
-            debug("Unsupported type in value field: %d", element->type);
+            debug("Unsupported type in value field: %d", value->type);
             field->has_type = false;
             status = false;
             break;
@@ -408,189 +1033,188 @@ static bool deserializeDynamicField(cJSON* element,
     return status;
 }
 
-static void deserializeSimple(cJSON* root, openxc_VehicleMessage* message) {
+static void deserializeSimple(const JsonFields* fields,
+        openxc_VehicleMessage* message) {
     message->has_type = true;
     message->type = openxc_VehicleMessage_Type_SIMPLE;
     message->has_simple_message = true;
     openxc_SimpleMessage* simpleMessage = &message->simple_message;
 
-    cJSON* element = cJSON_GetObjectItem(root, "name");
-    if(element != NULL && element->type == cJSON_String) {
+    if(fields->name.type == JSON_STRING) {
         simpleMessage->has_name = true;
-        strcpy(simpleMessage->name, element->valuestring);
+        copyStringField(&fields->name, simpleMessage->name,
+                sizeof(simpleMessage->name));
     }
 
-    element = cJSON_GetObjectItem(root, "value");
-    if(element != NULL) {
-        if(deserializeDynamicField(element, &simpleMessage->value)) {
+    if(hasField(&fields->value)) {
+        if(deserializeDynamicField(&fields->value, &simpleMessage->value)) {
             simpleMessage->has_value = true;
         }
     }
 
-    element = cJSON_GetObjectItem(root, "event");
-    if(element != NULL) {
-        if(deserializeDynamicField(element, &simpleMessage->event)) {
+    if(hasField(&fields->event)) {
+        if(deserializeDynamicField(&fields->event, &simpleMessage->event)) {
             simpleMessage->has_event = true;
         }
     }
 }
 
-static void deserializeCan(cJSON* root, openxc_VehicleMessage* message) {
+static void deserializeCan(const JsonFields* fields,
+        openxc_VehicleMessage* message) {
     message->has_type = true;
     message->type = openxc_VehicleMessage_Type_CAN;
     message->has_can_message = true;
     openxc_CanMessage* canMessage = &message->can_message;
 
-    cJSON* element = cJSON_GetObjectItem(root, "id");
-    if(element != NULL) {
+    if(hasField(&fields->id)) {
         canMessage->has_id = true;
-        canMessage->id = element->valueint;
+        canMessage->id = intField(&fields->id);
 
-        element = cJSON_GetObjectItem(root, "data");
-        if(element != NULL) {
+        if(fields->data.type == JSON_STRING) {
             canMessage->has_data = true;
-            canMessage->data.size = dehexlify(
-                    element->valuestring,
-                    canMessage->data.bytes,
-                    sizeof(((openxc_CanMessage*)0)->data.bytes));
+            canMessage->data.size = dehexlify(&fields->data,
+                    canMessage->data.bytes, sizeof(canMessage->data.bytes));
         }
 
-        element = cJSON_GetObjectItem(root, "bus");
-        if(element != NULL) {
+        if(hasField(&fields->bus)) {
             canMessage->has_bus = true;
-            canMessage->bus = element->valueint;
+            canMessage->bus = intField(&fields->bus);
         }
 
-        element = cJSON_GetObjectItem(root, payload::json::FRAME_FORMAT_FIELD_NAME);
-        if(element != NULL) {
+        if(stringFieldEquals(&fields->frameFormat,
+                    payload::json::FRAME_FORMAT_STANDARD_NAME)) {
             canMessage->has_frame_format = true;
-            if(!strcmp(element->valuestring,
-                        payload::json::FRAME_FORMAT_STANDARD_NAME)) {
-                canMessage->frame_format = openxc_CanMessage_FrameFormat_STANDARD;
-            } else if(!strcmp(element->valuestring,
-                        payload::json::FRAME_FORMAT_EXTENDED_NAME)) {
-                canMessage->frame_format = openxc_CanMessage_FrameFormat_EXTENDED;
-            } else {
-                canMessage->has_frame_format = false;
-            }
+            canMessage->frame_format = openxc_CanMessage_FrameFormat_STANDARD;
+        } else if(stringFieldEquals(&fields->frameFormat,
+                    payload::json::FRAME_FORMAT_EXTENDED_NAME)) {
+            canMessage->has_frame_format = true;
+            canMessage->frame_format = openxc_CanMessage_FrameFormat_EXTENDED;
         }
     } else {
         message->has_can_message = false;
     }
 }
 
+static void deserializeCommand(const JsonFields* fields,
+        openxc_VehicleMessage* message) {
+    message->has_type = true;
+    message->type = openxc_VehicleMessage_Type_CONTROL_COMMAND;
+    message->has_control_command = true;
+    openxc_ControlCommand* command = &message->control_command;
+
+    const JsonValue* name = &fields->command;
+    if(stringFieldStartsWith(name, payload::json::VERSION_COMMAND_NAME)) {
+        command->has_type = true;
+        command->type = openxc_ControlCommand_Type_VERSION;
+    } else if(stringFieldStartsWith(name,
+                payload::json::DEVICE_ID_COMMAND_NAME)) {
+        command->has_type = true;
+        command->type = openxc_ControlCommand_Type_DEVICE_ID;
+    } else if(stringFieldStartsWith(name,
+                payload::json::DIAGNOSTIC_COMMAND_NAME)) {
+        deserializeDiagnostic(fields, command);
+    } else if(stringFieldStartsWith(name,
+                payload::json::PASSTHROUGH_COMMAND_NAME)) {
+        deserializePassthrough(fields, command);
+    } else if(stringFieldStartsWith(name,
+                payload::json::PREDEFINED_OBD2_REQUESTS_COMMAND_NAME)) {
+        deserializePredefinedObd2RequestsCommand(fields, command);
+    } else if(stringFieldStartsWith(name,
+                payload::json::ACCEPTANCE_FILTER_BYPASS_COMMAND_NAME)) {
+        deserializeAfBypass(fields, command);
+    } else if(stringFieldStartsWith(name,
+                payload::json::PAYLOAD_FORMAT_COMMAND_NAME)) {
+        deserializePayloadFormat(fields, command);
+    } else if(stringFieldStartsWith(name,
+                payload::json::LATENCY_COMMAND_NAME)) {
+        command->has_type = true;
+        command->type = openxc::commands::LATENCY_COMMAND_TYPE;
+    } else if(stringFieldStartsWith(name,
+                payload::json::SIGNAL_DICTIONARY_COMMAND_NAME)) {
+        command->has_type = true;
+        command->type = openxc::commands::SIGNAL_DICTIONARY_COMMAND_TYPE;
+    } else {
+        debug("Unrecognized command");
+        message->has_control_command = false;
+    }
+}
+
 size_t openxc::payload::json::deserialize(uint8_t payload[], size_t length,
         openxc_VehicleMessage* message) {
-    const char* delimiter = strnchr((const char*)payload, length - 1, '\0');
-    size_t messageLength = 0;
-    if(delimiter != NULL) {
-        messageLength = (size_t)(delimiter - (const char*)payload) + 1;
-        uint8_t messageBuffer[messageLength];
-        if(messageLength > 0) {
-            memcpy(messageBuffer, payload, messageLength);
-        }
-        // There may be junk data at the start of the payload - seek ahead to the
-        // start of the message.
-        char* jsonStart = strchr((char*)messageBuffer, '{');
-        if(jsonStart == NULL) {
-            debug("%s", "No JSON object start found");
-            // Return message length so this bogus front matter is erased
-            return messageLength;
-        }
+    // Nothing is parsed until the delimiter has arrived, so a partial message
+    // only costs a scan for the NULL character.
+    const char* delimiter = length > 0 ?
+            (const char*)memchr(payload, '\0', length) : NULL;
+    if(delimiter == NULL) {
+        return 0;
+    }
 
-        cJSON *root = cJSON_Parse(jsonStart);
-        if(root == NULL) {
-            debug("No JSON found in %u byte payload", length);
-            // TODO should this return messageLength to eat up corrupt data, or
-            // does it need to be 0 so we preserve partial messages?
-            return 0;
-        }
+    size_t messageLength = (size_t)(delimiter - (const char*)payload) + 1;
+    // There may be junk data at the start of the payload - seek ahead to the
+    // start of the message.
+    const char* jsonStart = (const char*)memchr(payload, '{',
+            messageLength - 1);
+    if(jsonStart == NULL) {
+        debug("%s", "No JSON object start found");
+        // Return message length so this bogus front matter is erased
+        return messageLength;
+    }
 
-        message->has_type = true;
-        cJSON* commandNameObject = cJSON_GetObjectItem(root, "command");
-        if(commandNameObject != NULL) {
-            message->has_type = true;
-            message->type = openxc_VehicleMessage_Type_CONTROL_COMMAND;
-            message->has_control_command = true;
-            openxc_ControlCommand* command = &message->control_command;
-
-            if(!strncmp(commandNameObject->valuestring, VERSION_COMMAND_NAME,
-                        strlen(VERSION_COMMAND_NAME))) {
-                command->has_type = true;
-                command->type = openxc_ControlCommand_Type_VERSION;
-            } else if(!strncmp(commandNameObject->valuestring,
-                        DEVICE_ID_COMMAND_NAME, strlen(DEVICE_ID_COMMAND_NAME))) {
-                command->has_type = true;
-                command->type = openxc_ControlCommand_Type_DEVICE_ID;
-            } else if(!strncmp(commandNameObject->valuestring,
-                        DIAGNOSTIC_COMMAND_NAME, strlen(DIAGNOSTIC_COMMAND_NAME))) {
-                deserializeDiagnostic(root, command);
-            } else if(!strncmp(commandNameObject->valuestring,
-                        PASSTHROUGH_COMMAND_NAME, strlen(PASSTHROUGH_COMMAND_NAME))) {
-                deserializePassthrough(root, command);
-            } else if(!strncmp(commandNameObject->valuestring,
-                        PREDEFINED_OBD2_REQUESTS_COMMAND_NAME,
-                            strlen(PREDEFINED_OBD2_REQUESTS_COMMAND_NAME))) {
-                deserializePredefinedObd2RequestsCommand(root, command);
-            } else if(!strncmp(commandNameObject->valuestring,
-                        ACCEPTANCE_FILTER_BYPASS_COMMAND_NAME,
-                        strlen(ACCEPTANCE_FILTER_BYPASS_COMMAND_NAME))) {
-                deserializeAfBypass(root, command);
-            } else if(!strncmp(commandNameObject->valuestring,
-                        PAYLOAD_FORMAT_COMMAND_NAME,
-                        strlen(PAYLOAD_FORMAT_COMMAND_NAME))) {
-                deserializePayloadFormat(root, command);
-            } else {
-                debug("Unrecognized command: %s", commandNameObject->valuestring);
-                message->has_control_command = false;
-            }
-        } else {
-            cJSON* nameObject = cJSON_GetObjectItem(root, "name");
-            if(nameObject == NULL) {
-                deserializeCan(root, message);
-            } else {
-                deserializeSimple(root, message);
-            }
-        }
-        cJSON_Delete(root);
+    JsonFields fields;
+    memset(&fields, 0, sizeof(fields));
+    JsonCursor cursor = {jsonStart, delimiter};
+    if(!parseObject(&cursor, &fields, NULL, 0)) {
+        debug("No JSON found in %u byte payload", length);
+        // TODO should this return messageLength to eat up corrupt data, or
+        // does it need to be 0 so we preserve partial messages?
+        return 0;
     }
 
+    message->has_type = true;
+    if(hasField(&fields.command)) {
+        deserializeCommand(&fields, message);
+    } else if(!hasField(&fields.name)) {
+        deserializeCan(&fields, message);
+    } else {
+        deserializeSimple(&fields, message);
+    }
     return messageLength;
 }
 
 int openxc::payload::json::serialize(openxc_VehicleMessage* message,
         uint8_t payload[], size_t length) {
-    cJSON* root = cJSON_CreateObject();
-    size_t finalLength = 0;
-    if(root != NULL) {
-        bool status = true;
-        if(message->type == openxc_VehicleMessage_Type_SIMPLE) {
-            status = serializeSimple(message, root);
-        } else if(message->type == openxc_VehicleMessage_Type_CAN) {
-            status = serializeCan(message, root);
-        } else if(message->type == openxc_VehicleMessage_Type_DIAGNOSTIC) {
-            status = serializeDiagnostic(message, root);
-        } else if(message->type == openxc_VehicleMessage_Type_COMMAND_RESPONSE) {
-            status = serializeCommandResponse(message, root);
-        } else {
-            debug("Unrecognized message type -- not sending");
-        }
+    JsonWriter writer = {(char*)payload, length, 0, false, 0};
+    writeCharacter(&writer, '{');
+
+    bool status = true;
+    if(message->type == openxc_VehicleMessage_Type_SIMPLE) {
+        status = serializeSimple(message, &writer);
+    } else if(message->type == openxc_VehicleMessage_Type_CAN) {
+        status = serializeCan(message, &writer);
+    } else if(message->type == openxc_VehicleMessage_Type_DIAGNOSTIC) {
+        status = serializeDiagnostic(message, &writer);
+    } else if(message->type == openxc_VehicleMessage_Type_COMMAND_RESPONSE) {
+        status = serializeCommandResponse(message, &writer);
+    } else {
+        debug("Unrecognized message type -- not sending");
+    }
 
-        char* serialized = cJSON_PrintUnformatted(root);
-        if(status && serialized != NULL) {
-            // set the length to the strlen + 1, so we include the NULL
-            // character as a delimiter
-            finalLength = MIN(length, strlen(serialized) + 1);
-            memcpy(payload, serialized, finalLength);
+    if(message->has_timestamp) {
+        // The timestamp is in microseconds, but JSON timestamps are
+        // conventionally in seconds
+        writeNumberField(&writer, payload::json::TIMESTAMP_FIELD_NAME,
+                message->timestamp / 1000000.0);
+    }
 
-            free(serialized);
-        } else {
-            debug("Converting JSON to string failed -- possibly OOM");
-        }
+    writeCharacter(&writer, '}');
+    // Include the NULL character as a delimiter
+    writeCharacter(&writer, '\0');
 
-        cJSON_Delete(root);
-    } else {
-        debug("JSON object is NULL -- probably OOM");
+    if(!status) {
+        return 0;
+    } else if(writer.overflowed) {
+        debug("JSON message doesn't fit in %d byte payload", length);
+        return 0;
     }
-    return finalLength;
+    return writer.position;
 }
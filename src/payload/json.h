@@ -14,9 +14,12 @@ extern const char PASSTHROUGH_COMMAND_NAME[];
 extern const char ACCEPTANCE_FILTER_BYPASS_COMMAND_NAME[];
 extern const char PAYLOAD_FORMAT_COMMAND_NAME[];
 extern const char PREDEFINED_OBD2_REQUESTS_COMMAND_NAME[];
+extern const char LATENCY_COMMAND_NAME[];
+extern const char SIGNAL_DICTIONARY_COMMAND_NAME[];
 
 extern const char PAYLOAD_FORMAT_JSON_NAME[];
 extern const char PAYLOAD_FORMAT_PROTOBUF_NAME[];
+extern const char PAYLOAD_FORMAT_COMPACT_NAME[];
 
 extern const char COMMAND_RESPONSE_FIELD_NAME[];
 extern const char COMMAND_RESPONSE_MESSAGE_FIELD_NAME[];
@@ -29,6 +32,7 @@ extern const char NAME_FIELD_NAME[];
 extern const char VALUE_FIELD_NAME[];
 extern const char EVENT_FIELD_NAME[];
 extern const char FRAME_FORMAT_FIELD_NAME[];
+extern const char TIMESTAMP_FIELD_NAME[];
 
 extern const char FRAME_FORMAT_STANDARD_NAME[];
 extern const char FRAME_FORMAT_EXTENDED_NAME[];
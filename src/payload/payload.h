@@ -8,10 +8,15 @@ namespace openxc {
 namespace payload {
 
 /* Public: The available encoding formats for OpenXC payloads.
+ *
+ * COMPACT - Fixed-size binary records identifying signals by their index in
+ *      the active message set instead of by name, for low bandwidth links. See
+ *      the payload::compact module.
  */
 typedef enum {
     JSON,
     PROTOBUF,
+    COMPACT,
 } PayloadFormat;
 
 /* Public: Deserialize an OpenXC message from the given payload, using the given
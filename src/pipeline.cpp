@@ -4,12 +4,21 @@
 #include "util/timer.h"
 #include "util/statistics.h"
 #include "util/bytebuffer.h"
+#include "util/strutil.h"
 #include "config.h"
 #include "lights.h"
+#include "platform/platform.h"
+
+#include <string.h>
 
 #define PIPELINE_ENDPOINT_COUNT 3
 #define PIPELINE_STATS_LOG_FREQUENCY_S 15
 #define QUEUE_FLUSH_MAX_TRIES 100
+#define PIPELINE_TRACKED_MESSAGE_COUNT 64
+#define PIPELINE_COALESCE_MAX_MESSAGE_SIZE 72
+#define PIPELINE_COALESCE_WATERMARK_PERCENT 75
+#define PIPELINE_STAGED_MESSAGE_COUNT 8
+#define PIPELINE_MESSAGE_CLASS_COUNT 5
 
 namespace uart = openxc::interface::uart;
 namespace usb = openxc::interface::usb;
@@ -17,37 +26,263 @@ namespace network = openxc::interface::network;
 namespace time = openxc::util::time;
 namespace statistics = openxc::util::statistics;
 namespace config = openxc::config;
+namespace platform = openxc::platform;
 
 using openxc::util::bytebuffer::conditionalEnqueue;
 using openxc::util::bytebuffer::messageFits;
+using openxc::util::bytebuffer::discard;
+using openxc::util::bytebuffer::transfer;
 using openxc::util::statistics::DeltaStatistic;
 using openxc::util::log::debug;
 using openxc::pipeline::Pipeline;
 using openxc::pipeline::MessageClass;
 using openxc::interface::InterfaceDescriptor;
 using openxc::interface::InterfaceType;
+using openxc::interface::OverflowPolicy;
 using openxc::config::LoggingOutputInterface;
+using openxc::payload::PayloadFormat;
 
 unsigned int droppedMessages[PIPELINE_ENDPOINT_COUNT];
 unsigned int sentMessages[PIPELINE_ENDPOINT_COUNT];
 unsigned int dataSent[PIPELINE_ENDPOINT_COUNT];
 unsigned int sendQueueLength[PIPELINE_ENDPOINT_COUNT];
 unsigned int receiveQueueLength[PIPELINE_ENDPOINT_COUNT];
+unsigned int coalescedMessages[PIPELINE_ENDPOINT_COUNT];
+unsigned int droppedClassMessages[PIPELINE_ENDPOINT_COUNT][
+        PIPELINE_MESSAGE_CLASS_COUNT];
+
+/* Private: The messages in an endpoint's data queue, tracked so whole
+ * messages can be dropped from the front of it and the flush latency can be
+ * sampled.
+ *
+ * The total number of bytes ever queued is compared against what remains in the
+ * queue to tell how far the interface has flushed, without any help from the
+ * interface.
+ *
+ * bytesQueued - The total number of bytes ever added to the queue.
+ * oldestMessageStart - The value of bytesQueued when the oldest tracked message
+ *      was added.
+ * messageSizes - A ring of the sizes of the tracked messages, in the order they
+ *      were added. If it fills up, the oldest messages are no longer tracked.
+ * messageClasses - The class of each tracked message, at the same index as its
+ *      size.
+ * oldestMessage - The index of the oldest tracked message in messageSizes.
+ * messageCount - The number of tracked messages.
+ * pendingMarker - The value of bytesQueued after the message being sampled for
+ *      flush latency was added.
+ * pendingTimestamp - The receive time of the message being sampled for flush
+ *      latency, or 0 if none is.
+ * flushLatency - The flush latency samples.
+ */
+typedef struct {
+    unsigned int bytesQueued;
+    unsigned int oldestMessageStart;
+    uint16_t messageSizes[PIPELINE_TRACKED_MESSAGE_COUNT];
+    uint8_t messageClasses[PIPELINE_TRACKED_MESSAGE_COUNT];
+    int oldestMessage;
+    int messageCount;
+    unsigned int pendingMarker;
+    uint64_t pendingTimestamp;
+    statistics::Histogram flushLatency;
+} EndpointTracker;
+
+static EndpointTracker endpointTrackers[PIPELINE_ENDPOINT_COUNT];
+
+#if DEFAULT_COALESCE_TABLE_SIZE > 0
+/* Private: The latest value of a signal waiting to be sent to an interface
+ * using the COALESCE overflow policy.
+ *
+ * key - A hash of the signal's name.
+ * size - The size of the serialized message, or 0 if this entry is free.
+ * message - The serialized message.
+ */
+typedef struct {
+    uint32_t key;
+    uint8_t size;
+    uint8_t message[PIPELINE_COALESCE_MAX_MESSAGE_SIZE];
+} CoalescedMessage;
+
+/* Private: The latest values of signals that didn't fit in an interface's send
+ * queue.
+ *
+ * entries - The waiting messages, at most one per signal.
+ * pendingCount - The number of entries in use.
+ * nextToDrain - The index of the entry to check first the next time there's
+ *      room in the queue, so every signal gets a turn.
+ */
+typedef struct {
+    CoalescedMessage entries[DEFAULT_COALESCE_TABLE_SIZE];
+    int pendingCount;
+    int nextToDrain;
+} CoalesceTable;
 
-void conditionalFlush(Pipeline* pipeline,
+static CoalesceTable coalesceTables[PIPELINE_ENDPOINT_COUNT];
+#endif // DEFAULT_COALESCE_TABLE_SIZE > 0
+
+/* Private: Responses (command and diagnostic) that didn't fit in an
+ * interface's send queue, waiting to go ahead of any other messages as soon as
+ * there's room.
+ *
+ * The queue starts out empty because it's zero-initialized.
+ *
+ * queue - The waiting messages.
+ * messageSizes - A ring of the sizes of the waiting messages.
+ * messageClasses - The class of each waiting message.
+ * oldestMessage - The index of the oldest waiting message in messageSizes.
+ * messageCount - The number of waiting messages.
+ */
+typedef struct {
+    QUEUE_TYPE(uint8_t) queue;
+    uint16_t messageSizes[PIPELINE_STAGED_MESSAGE_COUNT];
+    uint8_t messageClasses[PIPELINE_STAGED_MESSAGE_COUNT];
+    int oldestMessage;
+    int messageCount;
+} ResponseStage;
+
+static ResponseStage responseStages[PIPELINE_ENDPOINT_COUNT];
+
+/* Private: Return true if messages of this class are responses to a request
+ * from the host, which take priority over the data stream.
+ */
+static bool isResponse(MessageClass messageClass) {
+    return messageClass == MessageClass::COMMAND_RESPONSE ||
+        messageClass == MessageClass::DIAGNOSTIC;
+}
+
+/* Private: True while waiting for room in a queue for a command response, so
+ * process() doesn't refill the queues with coalesced values in the meantime.
+ */
+static bool flushingForCommandResponse;
+
+/* Private: Flush the interfaces until a command response fits in the send
+ * queue, after any responses already waiting for the interface, or until
+ * giving up.
+ */
+void conditionalFlush(Pipeline* pipeline, InterfaceType endpointType,
         QUEUE_TYPE(uint8_t)* sendQueue, uint8_t* message, int messageSize) {
     int timeout = QUEUE_FLUSH_MAX_TRIES;
-    while(timeout > 0 && !messageFits(sendQueue, message, messageSize)) {
+    flushingForCommandResponse = true;
+    while(timeout > 0 && (responseStages[endpointType].messageCount > 0 ||
+                !messageFits(sendQueue, message, messageSize))) {
         process(pipeline);
         --timeout;
     }
+    flushingForCommandResponse = false;
+}
+
+/* Private: Return the number of bytes that have left an endpoint's data queue,
+ * either flushed by the interface or dropped.
+ */
+static unsigned int bytesRemoved(EndpointTracker* tracker,
+        QUEUE_TYPE(uint8_t)* sendQueue) {
+    return tracker->bytesQueued - QUEUE_LENGTH(uint8_t, sendQueue);
+}
+
+static void forgetOldestMessage(EndpointTracker* tracker) {
+    tracker->oldestMessageStart +=
+            tracker->messageSizes[tracker->oldestMessage];
+    tracker->oldestMessage = (tracker->oldestMessage + 1) %
+            PIPELINE_TRACKED_MESSAGE_COUNT;
+    --tracker->messageCount;
+}
+
+/* Private: Stop tracking the messages that have completely left an endpoint's
+ * data queue.
+ */
+static void forgetRemovedMessages(EndpointTracker* tracker,
+        QUEUE_TYPE(uint8_t)* sendQueue) {
+    unsigned int removed = bytesRemoved(tracker, sendQueue);
+    while(tracker->messageCount > 0 && (int)(removed -
+                (tracker->oldestMessageStart +
+                 tracker->messageSizes[tracker->oldestMessage])) >= 0) {
+        forgetOldestMessage(tracker);
+    }
 }
 
-void sendToEndpoint(openxc::interface::InterfaceType endpointType,
+/* Private: Account for a message added to an endpoint's data queue, and
+ * start a flush latency sample with it if it has a receive timestamp and no
+ * other sample is pending.
+ */
+static void trackQueuedMessage(InterfaceType endpointType,
+        QUEUE_TYPE(uint8_t)* sendQueue, int messageSize,
+        MessageClass messageClass, uint64_t timestamp) {
+    EndpointTracker* tracker = &endpointTrackers[endpointType];
+    forgetRemovedMessages(tracker, sendQueue);
+    if(tracker->messageCount == PIPELINE_TRACKED_MESSAGE_COUNT) {
+        forgetOldestMessage(tracker);
+    }
+    if(tracker->messageCount == 0) {
+        tracker->oldestMessageStart = tracker->bytesQueued;
+    }
+    int index = (tracker->oldestMessage + tracker->messageCount) %
+            PIPELINE_TRACKED_MESSAGE_COUNT;
+    tracker->messageSizes[index] = messageSize;
+    tracker->messageClasses[index] = messageClass;
+    ++tracker->messageCount;
+
+    tracker->bytesQueued += messageSize;
+    if(timestamp != 0 && tracker->pendingTimestamp == 0) {
+        tracker->pendingTimestamp = timestamp;
+        tracker->pendingMarker = tracker->bytesQueued;
+    }
+}
+
+/* Private: Finish the pending flush latency sample for an endpoint if the
+ * sampled message has left its data queue.
+ */
+static void trackFlushedMessages(InterfaceType endpointType,
+        QUEUE_TYPE(uint8_t)* sendQueue) {
+    EndpointTracker* tracker = &endpointTrackers[endpointType];
+    if(tracker->pendingTimestamp == 0) {
+        return;
+    }
+
+    if((int)(bytesRemoved(tracker, sendQueue) - tracker->pendingMarker) >= 0) {
+        statistics::update(&tracker->flushLatency,
+                time::systemTimeUs() - tracker->pendingTimestamp);
+        tracker->pendingTimestamp = 0;
+    }
+}
+
+/* Private: Drop whole messages from the front of an endpoint's data queue
+ * until the new message fits, as long as the interface hasn't already started
+ * sending the oldest one and it isn't a response.
+ *
+ * The queue may be drained from an interrupt handler, so this runs with
+ * interrupts disabled.
+ */
+static void dropOldestMessages(InterfaceType endpointType,
+        QUEUE_TYPE(uint8_t)* sendQueue, uint8_t* message, int messageSize) {
+    EndpointTracker* tracker = &endpointTrackers[endpointType];
+    unsigned int interruptState = platform::disableInterrupts();
+    forgetRemovedMessages(tracker, sendQueue);
+    while(!messageFits(sendQueue, message, messageSize) &&
+            tracker->messageCount > 0 &&
+            tracker->oldestMessageStart == bytesRemoved(tracker, sendQueue) &&
+            !isResponse((MessageClass)
+                tracker->messageClasses[tracker->oldestMessage])) {
+        discard(sendQueue, tracker->messageSizes[tracker->oldestMessage]);
+        ++droppedMessages[endpointType];
+        ++droppedClassMessages[endpointType][
+                tracker->messageClasses[tracker->oldestMessage]];
+        forgetOldestMessage(tracker);
+    }
+    platform::restoreInterrupts(interruptState);
+
+    if(tracker->pendingTimestamp != 0 && (int)(bytesRemoved(tracker,
+                    sendQueue) - tracker->pendingMarker) >= 0) {
+        // the message being sampled was dropped, not flushed
+        tracker->pendingTimestamp = 0;
+    }
+}
+
+bool sendToEndpoint(openxc::interface::InterfaceType endpointType,
         QUEUE_TYPE(uint8_t)* sendQueue, QUEUE_TYPE(uint8_t)* receiveQueue,
-        uint8_t* message, int messageSize) {
-    if(!conditionalEnqueue(sendQueue, message, messageSize)) {
+        uint8_t* message, int messageSize, MessageClass messageClass) {
+    bool queued = conditionalEnqueue(sendQueue, message, messageSize);
+    if(!queued) {
         ++droppedMessages[endpointType];
+        ++droppedClassMessages[endpointType][messageClass];
     } else {
         ++sentMessages[endpointType];
         dataSent[endpointType] += messageSize;
@@ -55,10 +290,222 @@ void sendToEndpoint(openxc::interface::InterfaceType endpointType,
     sendQueueLength[endpointType] = QUEUE_LENGTH(uint8_t, sendQueue);
     // TODO This may not belong here after USB refactoring
     receiveQueueLength[endpointType] = QUEUE_LENGTH(uint8_t, receiveQueue);
+    return queued;
+}
+
+/* Private: Hold a response for an interface until there's room for it in the
+ * send queue.
+ *
+ * Returns false if there's no room left to hold it.
+ */
+static bool stageResponse(InterfaceType endpointType, uint8_t* message,
+        int messageSize, MessageClass messageClass) {
+    ResponseStage* stage = &responseStages[endpointType];
+    if(stage->messageCount == PIPELINE_STAGED_MESSAGE_COUNT ||
+            !conditionalEnqueue(&stage->queue, message, messageSize)) {
+        return false;
+    }
+
+    int index = (stage->oldestMessage + stage->messageCount) %
+            PIPELINE_STAGED_MESSAGE_COUNT;
+    stage->messageSizes[index] = messageSize;
+    stage->messageClasses[index] = messageClass;
+    ++stage->messageCount;
+    return true;
+}
+
+/* Private: Move as many of the responses waiting for an interface into its
+ * send queue as will fit, oldest first.
+ */
+static void drainStagedResponses(InterfaceDescriptor* descriptor,
+        QUEUE_TYPE(uint8_t)* sendQueue, QUEUE_TYPE(uint8_t)* receiveQueue) {
+    ResponseStage* stage = &responseStages[descriptor->type];
+    while(stage->messageCount > 0) {
+        int messageSize = stage->messageSizes[stage->oldestMessage];
+        if(!messageFits(sendQueue, NULL, messageSize)) {
+            break;
+        }
+
+        transfer(&stage->queue, sendQueue, messageSize);
+        ++sentMessages[descriptor->type];
+        dataSent[descriptor->type] += messageSize;
+        sendQueueLength[descriptor->type] = QUEUE_LENGTH(uint8_t, sendQueue);
+        trackQueuedMessage(descriptor->type, sendQueue, messageSize,
+                (MessageClass) stage->messageClasses[stage->oldestMessage], 0);
+
+        stage->oldestMessage = (stage->oldestMessage + 1) %
+                PIPELINE_STAGED_MESSAGE_COUNT;
+        --stage->messageCount;
+    }
+}
+
+static bool aboveCoalesceWatermark(QUEUE_TYPE(uint8_t)* sendQueue) {
+    return QUEUE_LENGTH(uint8_t, sendQueue) * 100 >=
+            QUEUE_MAX_LENGTH(uint8_t) * PIPELINE_COALESCE_WATERMARK_PERCENT;
+}
+
+#if DEFAULT_COALESCE_TABLE_SIZE > 0
+static int coalescedPending(InterfaceType endpointType) {
+    return coalesceTables[endpointType].pendingCount;
+}
+
+/* Private: Store the message as the latest value of its signal for an
+ * interface, replacing any older value still waiting to be sent.
+ *
+ * An older value is discarded even if the new message can't be stored, since
+ * the caller will send the new one directly and the older one mustn't follow
+ * it.
+ *
+ * Returns false if the message is too large or the table is full of other
+ * signals.
+ */
+static bool coalesce(InterfaceType endpointType, uint32_t key,
+        uint8_t* message, int messageSize) {
+    CoalesceTable* table = &coalesceTables[endpointType];
+    CoalescedMessage* freeEntry = NULL;
+    for(int i = 0; i < DEFAULT_COALESCE_TABLE_SIZE; i++) {
+        CoalescedMessage* entry = &table->entries[i];
+        if(entry->size != 0 && entry->key == key) {
+            entry->size = 0;
+            --table->pendingCount;
+            ++coalescedMessages[endpointType];
+            freeEntry = entry;
+            break;
+        } else if(entry->size == 0 && freeEntry == NULL) {
+            freeEntry = entry;
+        }
+    }
+
+    if(freeEntry == NULL || messageSize > PIPELINE_COALESCE_MAX_MESSAGE_SIZE) {
+        return false;
+    }
+
+    freeEntry->key = key;
+    freeEntry->size = messageSize;
+    memcpy(freeEntry->message, message, messageSize);
+    ++table->pendingCount;
+    return true;
+}
+
+/* Private: Move as many of the latest signal values waiting for an interface
+ * into its send queue as will fit below the watermark.
+ */
+static void drainCoalesced(InterfaceDescriptor* descriptor,
+        QUEUE_TYPE(uint8_t)* sendQueue, QUEUE_TYPE(uint8_t)* receiveQueue) {
+    CoalesceTable* table = &coalesceTables[descriptor->type];
+    for(int i = 0; i < DEFAULT_COALESCE_TABLE_SIZE &&
+            table->pendingCount > 0 && !aboveCoalesceWatermark(sendQueue);
+            i++) {
+        CoalescedMessage* entry = &table->entries[table->nextToDrain];
+        if(entry->size != 0) {
+            if(!messageFits(sendQueue, entry->message, entry->size)) {
+                break;
+            }
+
+            if(sendToEndpoint(descriptor->type, sendQueue, receiveQueue,
+                        entry->message, entry->size, MessageClass::SIMPLE)) {
+                trackQueuedMessage(descriptor->type, sendQueue, entry->size,
+                        MessageClass::SIMPLE, 0);
+            }
+            entry->size = 0;
+            --table->pendingCount;
+        }
+        table->nextToDrain = (table->nextToDrain + 1) %
+                DEFAULT_COALESCE_TABLE_SIZE;
+    }
+}
+#else
+static int coalescedPending(InterfaceType endpointType) {
+    return 0;
+}
+
+static bool coalesce(InterfaceType endpointType, uint32_t key,
+        uint8_t* message, int messageSize) {
+    return false;
+}
+
+static void drainCoalesced(InterfaceDescriptor* descriptor,
+        QUEUE_TYPE(uint8_t)* sendQueue, QUEUE_TYPE(uint8_t)* receiveQueue) {
+}
+#endif // DEFAULT_COALESCE_TABLE_SIZE > 0
+
+/* Private: Add a message to an interface's send queue, handling a full queue
+ * according to the message's priority.
+ *
+ * Responses to the host (command and diagnostic) go ahead of the data stream:
+ * if they don't fit, they wait in a separate queue that's drained before
+ * anything else is added. Only if that's full too does a command response wait
+ * for the interface to flush, since the host is waiting for it.
+ *
+ * Everything else never waits. Log messages go to their own queue, and are
+ * dropped if it's full. Simple vehicle messages and raw CAN messages are
+ * dropped (or coalesced) according to the interface's overflow policy if they
+ * don't fit or any responses are still waiting.
+ *
+ * coalesceKey - A key identifying the signal the message is a value of, or 0
+ *      if it can't be coalesced with other values.
+ */
+static void sendToQueue(Pipeline* pipeline, InterfaceDescriptor* descriptor,
+        QUEUE_TYPE(uint8_t)* sendQueue, QUEUE_TYPE(uint8_t)* receiveQueue,
+        uint8_t* message, int messageSize, MessageClass messageClass,
+        uint64_t timestamp, uint32_t coalesceKey) {
+    if(messageClass == MessageClass::LOG) {
+        sendToEndpoint(descriptor->type, sendQueue, receiveQueue, message,
+                messageSize, messageClass);
+        return;
+    }
+
+    drainStagedResponses(descriptor, sendQueue, receiveQueue);
+    bool responsesWaiting = responseStages[descriptor->type].messageCount > 0;
+    if(isResponse(messageClass)) {
+        if(responsesWaiting || !messageFits(sendQueue, message, messageSize)) {
+            if(stageResponse(descriptor->type, message, messageSize,
+                        messageClass)) {
+                return;
+            }
+
+            if(messageClass == MessageClass::COMMAND_RESPONSE) {
+                conditionalFlush(pipeline, descriptor->type, sendQueue,
+                        message, messageSize);
+            }
+        }
+    } else {
+        if(descriptor->overflowPolicy == OverflowPolicy::COALESCE) {
+            drainCoalesced(descriptor, sendQueue, receiveQueue);
+            // Once any values are waiting, newer ones have to wait behind them
+            // so they aren't overwritten by an older value later
+            if(coalesceKey != 0 &&
+                    (coalescedPending(descriptor->type) > 0 ||
+                        responsesWaiting ||
+                        aboveCoalesceWatermark(sendQueue)) &&
+                    coalesce(descriptor->type, coalesceKey, message,
+                        messageSize)) {
+                return;
+            }
+        }
+
+        if(responsesWaiting) {
+            ++droppedMessages[descriptor->type];
+            ++droppedClassMessages[descriptor->type][messageClass];
+            return;
+        }
+
+        if(!messageFits(sendQueue, message, messageSize) &&
+                descriptor->overflowPolicy == OverflowPolicy::DROP_OLDEST) {
+            dropOldestMessages(descriptor->type, sendQueue, message,
+                    messageSize);
+        }
+    }
+
+    if(sendToEndpoint(descriptor->type, sendQueue, receiveQueue, message,
+                messageSize, messageClass)) {
+        trackQueuedMessage(descriptor->type, sendQueue, messageSize,
+                messageClass, timestamp);
+    }
 }
 
 void sendToUsb(Pipeline* pipeline, uint8_t* message, int messageSize,
-        MessageClass messageClass) {
+        MessageClass messageClass, uint64_t timestamp, uint32_t coalesceKey) {
     if(pipeline->usb->configured) {
         QUEUE_TYPE(uint8_t)* sendQueue;
         if(messageClass == MessageClass::LOG) {
@@ -73,72 +520,149 @@ void sendToUsb(Pipeline* pipeline, uint8_t* message, int messageSize,
             sendQueue = &pipeline->usb->endpoints[IN_ENDPOINT_INDEX].queue;
         }
 
-        conditionalFlush(pipeline, sendQueue, message, messageSize);
-        sendToEndpoint(pipeline->usb->descriptor.type, sendQueue,
+        sendToQueue(pipeline, &pipeline->usb->descriptor, sendQueue,
                 &pipeline->usb->endpoints[OUT_ENDPOINT_INDEX].queue,
-                message, messageSize);
+                message, messageSize, messageClass, timestamp, coalesceKey);
     }
 }
 
 void sendToUart(Pipeline* pipeline, uint8_t* message, int messageSize,
-        MessageClass messageClass) {
+        MessageClass messageClass, uint64_t timestamp, uint32_t coalesceKey) {
     if(uart::connected(pipeline->uart) && messageClass != MessageClass::LOG) {
-        QUEUE_TYPE(uint8_t)* sendQueue = &pipeline->uart->sendQueue;
-        conditionalFlush(pipeline, sendQueue, message, messageSize);
-        sendToEndpoint(pipeline->uart->descriptor.type, sendQueue,
-                &pipeline->uart->receiveQueue, message, messageSize);
+        sendToQueue(pipeline, &pipeline->uart->descriptor,
+                &pipeline->uart->sendQueue, &pipeline->uart->receiveQueue,
+                message, messageSize, messageClass, timestamp, coalesceKey);
     }
 }
 
 void sendToNetwork(Pipeline* pipeline, uint8_t* message, int messageSize,
-        MessageClass messageClass) {
+        MessageClass messageClass, uint64_t timestamp, uint32_t coalesceKey) {
     if(pipeline->network != NULL && messageClass != MessageClass::LOG) {
-        QUEUE_TYPE(uint8_t)* sendQueue = &pipeline->network->sendQueue;
-        conditionalFlush(pipeline, sendQueue, message, messageSize);
-        sendToEndpoint(pipeline->network->descriptor.type, sendQueue,
-                &pipeline->network->receiveQueue, message, messageSize);
+        sendToQueue(pipeline, &pipeline->network->descriptor,
+                &pipeline->network->sendQueue, &pipeline->network->receiveQueue,
+                message, messageSize, messageClass, timestamp, coalesceKey);
     }
 }
 
-void openxc::pipeline::publish(openxc_VehicleMessage* message,
-        Pipeline* pipeline) {
-    uint8_t payload[MAX_OUTGOING_PAYLOAD_SIZE] = {0};
-    size_t length = payload::serialize(message, payload, sizeof(payload),
-            config::getConfiguration()->payloadFormat);
+/* Private: Return a key identifying the signal a simple vehicle message is a
+ * value of, a hash of its name, or 0 if the message shouldn't be
+ * coalesced with other values. Evented messages aren't, since each event (e.g.
+ * each door) is a separate value.
+ */
+static uint32_t coalesceKey(openxc_VehicleMessage* message) {
+    if(message->type != openxc_VehicleMessage_Type_SIMPLE ||
+            !message->simple_message.has_name ||
+            message->simple_message.has_event) {
+        return 0;
+    }
+
+    uint32_t hash = strhash(message->simple_message.name);
+    return hash != 0 ? hash : 1;
+}
+
+bool openxc::pipeline::formatInUse(Pipeline* pipeline, PayloadFormat format) {
+    return (pipeline->usb->configured &&
+                pipeline->usb->descriptor.payloadFormat == format) ||
+            (uart::connected(pipeline->uart) &&
+                pipeline->uart->descriptor.payloadFormat == format) ||
+            (pipeline->network != NULL &&
+                pipeline->network->descriptor.payloadFormat == format);
+}
+
+/* Private: Queue a serialized message on only the interfaces that are connected
+ * and using its payload format.
+ */
+static void sendMessage(Pipeline* pipeline, PayloadFormat format,
+        uint8_t* message, int messageSize, MessageClass messageClass,
+        uint64_t timestamp, uint32_t coalesceKey) {
+    if(pipeline->usb->configured &&
+            pipeline->usb->descriptor.payloadFormat == format) {
+        sendToUsb(pipeline, message, messageSize, messageClass, timestamp,
+                coalesceKey);
+    }
+    if(uart::connected(pipeline->uart) &&
+            pipeline->uart->descriptor.payloadFormat == format) {
+        sendToUart(pipeline, message, messageSize, messageClass, timestamp,
+                coalesceKey);
+    }
+    if(pipeline->network != NULL &&
+            pipeline->network->descriptor.payloadFormat == format) {
+        sendToNetwork(pipeline, message, messageSize, messageClass, timestamp,
+                coalesceKey);
+    }
+}
+
+/* Private: Publish the message to the interfaces using any payload format
+ * except excludedFormat, if it's not NULL.
+ */
+static void publish(openxc_VehicleMessage* message, Pipeline* pipeline,
+        const PayloadFormat* excludedFormat) {
     MessageClass messageClass;
-    bool matched = false;
     switch(message->type) {
         case openxc_VehicleMessage_Type_SIMPLE:
             messageClass = MessageClass::SIMPLE;
-            matched = true;
             break;
         case openxc_VehicleMessage_Type_CAN:
             messageClass = MessageClass::CAN;
-            matched = true;
             break;
         case openxc_VehicleMessage_Type_DIAGNOSTIC:
             messageClass = MessageClass::DIAGNOSTIC;
-            matched = true;
             break;
         case openxc_VehicleMessage_Type_COMMAND_RESPONSE:
             messageClass = MessageClass::COMMAND_RESPONSE;
-            matched = true;
-            break;
-        case openxc_VehicleMessage_Type_CONTROL_COMMAND:
             break;
+        default:
+            debug("Trying to serialize unrecognized type: %d", message->type);
+            return;
     }
-    if(matched) {
-        sendMessage(pipeline, payload, length, messageClass);
-    } else {
-        debug("Trying to serialize unrecognized type: %d", message->type);
+
+    // Each interface can use a different payload format, so the message is
+    // serialized once for each format a connected interface is using, and the
+    // same bytes are copied into the queue of each of those interfaces. The
+    // serializers report the exact length they wrote, so there's no need to
+    // clear the buffer first.
+    static const PayloadFormat formats[] = {
+        PayloadFormat::JSON,
+        PayloadFormat::PROTOBUF,
+        PayloadFormat::COMPACT
+    };
+    uint32_t key = coalesceKey(message);
+    uint8_t payload[MAX_OUTGOING_PAYLOAD_SIZE];
+    for(size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        if((excludedFormat != NULL && formats[i] == *excludedFormat) ||
+                !openxc::pipeline::formatInUse(pipeline, formats[i])) {
+            continue;
+        }
+
+        size_t length = payload::serialize(message, payload, sizeof(payload),
+                formats[i]);
+        ::sendMessage(pipeline, formats[i], payload, length, messageClass,
+                message->timestamp, key);
     }
 }
 
+void openxc::pipeline::publish(openxc_VehicleMessage* message,
+        Pipeline* pipeline) {
+    ::publish(message, pipeline, NULL);
+}
+
+void openxc::pipeline::publish(openxc_VehicleMessage* message,
+        Pipeline* pipeline, PayloadFormat excludedFormat) {
+    ::publish(message, pipeline, &excludedFormat);
+}
+
+void openxc::pipeline::sendMessage(Pipeline* pipeline, uint8_t* message,
+        int messageSize, MessageClass messageClass, PayloadFormat format,
+        uint64_t timestamp) {
+    ::sendMessage(pipeline, format, message, messageSize, messageClass,
+            timestamp, 0);
+}
+
 void openxc::pipeline::sendMessage(Pipeline* pipeline, uint8_t* message,
         int messageSize, MessageClass messageClass) {
-    sendToUsb(pipeline, message, messageSize, messageClass);
-    sendToUart(pipeline, message, messageSize, messageClass);
-    sendToNetwork(pipeline, message, messageSize, messageClass);
+    sendToUsb(pipeline, message, messageSize, messageClass, 0, 0);
+    sendToUart(pipeline, message, messageSize, messageClass, 0, 0);
+    sendToNetwork(pipeline, message, messageSize, messageClass, 0, 0);
 
     if((config::getConfiguration()->loggingOutput == LoggingOutputInterface::BOTH ||
         config::getConfiguration()->loggingOutput == LoggingOutputInterface::UART)
@@ -152,15 +676,53 @@ void openxc::pipeline::process(Pipeline* pipeline) {
     // Must always process USB, because this function usually runs the MCU's USB
     // task that handles SETUP and enumeration.
     usb::processSendQueue(pipeline->usb);
+    trackFlushedMessages(pipeline->usb->descriptor.type,
+            &pipeline->usb->endpoints[IN_ENDPOINT_INDEX].queue);
+    // Responses still waiting for room go out even while flushing for a new
+    // command response, so they stay in order ahead of it
+    if(pipeline->usb->configured) {
+        drainStagedResponses(&pipeline->usb->descriptor,
+                &pipeline->usb->endpoints[IN_ENDPOINT_INDEX].queue,
+                &pipeline->usb->endpoints[OUT_ENDPOINT_INDEX].queue);
+        if(!flushingForCommandResponse) {
+            drainCoalesced(&pipeline->usb->descriptor,
+                    &pipeline->usb->endpoints[IN_ENDPOINT_INDEX].queue,
+                    &pipeline->usb->endpoints[OUT_ENDPOINT_INDEX].queue);
+        }
+    }
+
     if(uart::connected(pipeline->uart)) {
         uart::processSendQueue(pipeline->uart);
+        trackFlushedMessages(pipeline->uart->descriptor.type,
+                &pipeline->uart->sendQueue);
+        drainStagedResponses(&pipeline->uart->descriptor,
+                &pipeline->uart->sendQueue, &pipeline->uart->receiveQueue);
+        if(!flushingForCommandResponse) {
+            drainCoalesced(&pipeline->uart->descriptor,
+                    &pipeline->uart->sendQueue, &pipeline->uart->receiveQueue);
+        }
     }
 
     if(pipeline->network != NULL) {
        network::processSendQueue(pipeline->network);
+       trackFlushedMessages(pipeline->network->descriptor.type,
+               &pipeline->network->sendQueue);
+       drainStagedResponses(&pipeline->network->descriptor,
+               &pipeline->network->sendQueue,
+               &pipeline->network->receiveQueue);
+       if(!flushingForCommandResponse) {
+           drainCoalesced(&pipeline->network->descriptor,
+                   &pipeline->network->sendQueue,
+                   &pipeline->network->receiveQueue);
+       }
     }
 }
 
+openxc::util::statistics::Histogram* openxc::pipeline::getFlushLatency(
+        InterfaceType type) {
+    return &endpointTrackers[type].flushLatency;
+}
+
 void openxc::pipeline::logStatistics(Pipeline* pipeline) {
     if(!config::getConfiguration()->calculateMetrics) {
         return;
@@ -214,6 +776,22 @@ void openxc::pipeline::logStatistics(Pipeline* pipeline) {
                         droppedMessageStats[i].total,
                         statistics::exponentialMovingAverage(&droppedMessageStats[i]) /
                             statistics::exponentialMovingAverage(&totalMessageStats[i]) * 100);
+                if(droppedMessageStats[i].total > 0) {
+                    debug("%s msgs dropped by class, simple: %d, CAN: %d, "
+                                "diagnostic: %d, log: %d, command response: %d",
+                            descriptorToString(&descriptor),
+                            droppedClassMessages[i][MessageClass::SIMPLE],
+                            droppedClassMessages[i][MessageClass::CAN],
+                            droppedClassMessages[i][MessageClass::DIAGNOSTIC],
+                            droppedClassMessages[i][MessageClass::LOG],
+                            droppedClassMessages[i][
+                                MessageClass::COMMAND_RESPONSE]);
+                }
+                if(coalescedMessages[i] > 0) {
+                    debug("%s values replaced while waiting to send: %d",
+                            descriptorToString(&descriptor),
+                            coalescedMessages[i]);
+                }
                 debug("%s avg throughput: %fKB / s, %d msgs / s",
                         descriptorToString(&descriptor),
                         statistics::exponentialMovingAverage(&dataSentStats[i])
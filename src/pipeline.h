@@ -4,6 +4,7 @@
 #include "interface/usb.h"
 #include "interface/uart.h"
 #include "interface/network.h"
+#include "util/statistics.h"
 
 using openxc::interface::uart::UartDevice;
 using openxc::interface::usb::UsbDevice;
@@ -41,8 +42,9 @@ typedef struct {
 } Pipeline;
 
 /* Public: Serialize the message to a bytestream (conforming to the OpenXC
- * standard and the currently selected payload format) and send it out to the
- * pipeline.
+ * standard and the payload format of each interface) and send it out to the
+ * pipeline. The message is serialized once per payload format used by a
+ * connected interface.
  *
  * This will accept both raw and translated typed messages.
  *
@@ -52,6 +54,19 @@ typedef struct {
 void publish(openxc_VehicleMessage* message,
         openxc::pipeline::Pipeline* pipeline);
 
+/* Public: Publish the message as with publish(message, pipeline), but skip the
+ * interfaces using excludedFormat. Use this when the message has already been
+ * sent to those interfaces another way, e.g. serialized straight from the CAN
+ * message and sent with sendMessage.
+ */
+void publish(openxc_VehicleMessage* message,
+        openxc::pipeline::Pipeline* pipeline,
+        openxc::payload::PayloadFormat excludedFormat);
+
+/* Public: Return true if any connected interface is using the payload format.
+ */
+bool formatInUse(Pipeline* pipeline, openxc::payload::PayloadFormat format);
+
 /* Public: Queue the message to send on all of the interfaces registered with
  *      the pipeline. If the any of the queues does not have sufficient capacity
  *      to store the message, it will be dropped for that interface only (i.e.
@@ -67,6 +82,17 @@ void publish(openxc_VehicleMessage* message,
 void sendMessage(Pipeline* pipeline, uint8_t* message, int messageSize,
         MessageClass messageClass);
 
+/* Public: Queue a message that's already serialized in a payload format on only
+ * the connected interfaces using that format.
+ *
+ * format - The payload format the message is serialized in.
+ * timestamp - The time in microseconds the CAN message this was built from was
+ *      received, or 0. Used to sample the latency until it's flushed.
+ */
+void sendMessage(Pipeline* pipeline, uint8_t* message, int messageSize,
+        MessageClass messageClass, openxc::payload::PayloadFormat format,
+        uint64_t timestamp);
+
 /* Public: Perform interface-specific functions to flush all message queues out
  *      to their respective physical interfaces.
  *
@@ -77,6 +103,15 @@ void sendMessage(Pipeline* pipeline, uint8_t* message, int messageSize,
  */
 void process(Pipeline* pipeline);
 
+/* Public: Return the histogram of the time in microseconds from when a CAN
+ * message was received to when a message translated from it was flushed out to
+ * an interface. Only one message per interface is sampled at a time.
+ *
+ * type - The interface to look up.
+ */
+openxc::util::statistics::Histogram* getFlushLatency(
+        openxc::interface::InterfaceType type);
+
 void logStatistics(Pipeline* pipeline);
 
 } // namespace interface
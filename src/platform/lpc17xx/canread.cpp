@@ -3,12 +3,16 @@
 #include "signals.h"
 #include "util/log.h"
 
+namespace time = openxc::util::time;
+
 using openxc::util::log::debug;
 using openxc::signals::getCanBusCount;
 using openxc::signals::getCanBuses;
 using openxc::can::shouldAcceptMessage;
+using openxc::can::queueReceivedMessage;
 
 CanMessage receiveCanMessage(CanBus* bus) {
+    uint64_t timestamp = time::systemTimeUs();
     CAN_MSG_Type message;
     CAN_ReceiveMsg(CAN_CONTROLLER(bus), &message);
 
@@ -17,7 +21,8 @@ CanMessage receiveCanMessage(CanBus* bus) {
         format: message.format == STD_ID_FORMAT ?
             CanMessageFormat::STANDARD : CanMessageFormat::EXTENDED,
         data: {0},
-        length: message.len
+        length: message.len,
+        timestamp: timestamp
     };
 
     memcpy(result.data, message.dataA, 4);
@@ -32,8 +37,8 @@ void CAN_IRQHandler() {
         CanBus* bus = &getCanBuses()[i];
         if((CAN_IntGetStatus(CAN_CONTROLLER(bus)) & 0x01) == 1) {
             CanMessage message = receiveCanMessage(bus);
-            if(shouldAcceptMessage(bus, message.id) &&
-                    !QUEUE_PUSH(CanMessage, &bus->receiveQueue, message)) {
+            if(shouldAcceptMessage(bus, message.id, message.format) &&
+                    !queueReceivedMessage(bus, &message)) {
                 // An exception to the "don't leave commented out code" rule,
                 // this log statement is useful for debugging performance issues
                 // but if left enabled all of the time, it can can slown down
@@ -1,3 +1,14 @@
 #include "platform/platform.h"
+#include "LPC17xx.h"
 
 void openxc::platform::initialize() { }
+
+unsigned int openxc::platform::disableInterrupts() {
+    unsigned int state = __get_PRIMASK();
+    __disable_irq();
+    return state;
+}
+
+void openxc::platform::restoreInterrupts(unsigned int state) {
+    __set_PRIMASK(state);
+}
@@ -5,7 +5,7 @@
 
 #define DELAY_TIMER LPC_TIM0
 
-unsigned int SYSTEM_TICK_COUNT;
+volatile unsigned int SYSTEM_TICK_COUNT;
 
 extern "C" {
 
@@ -35,6 +35,26 @@ unsigned long openxc::util::time::systemTimeMs() {
     return SYSTEM_TICK_COUNT;
 }
 
+uint64_t openxc::util::time::systemTimeUs() {
+    unsigned int ticks;
+    uint32_t elapsedCycles;
+    bool tickPending;
+    do {
+        ticks = SYSTEM_TICK_COUNT;
+        elapsedCycles = SysTick->LOAD - SysTick->VAL;
+        tickPending = (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0;
+    } while(ticks != SYSTEM_TICK_COUNT);
+
+    if(tickPending) {
+        // The SysTick counter wrapped but its interrupt hasn't been handled
+        // yet, e.g. because we were called from a higher priority interrupt
+        // handler, so count that tick and use the new period's counter.
+        ++ticks;
+        elapsedCycles = SysTick->LOAD - SysTick->VAL;
+    }
+    return (uint64_t)ticks * 1000 + elapsedCycles / (SystemCoreClock / 1000000);
+}
+
 void openxc::util::time::initialize() {
     // Configure for 1ms tick
     SysTick_Config(SystemCoreClock / 1000);
@@ -5,11 +5,13 @@
 #include "power.h"
 
 namespace power = openxc::power;
+namespace time = openxc::util::time;
 
 using openxc::util::log::debug;
 using openxc::signals::getCanBuses;
 
 static CanMessage receiveCanMessage(CanBus* bus) {
+    uint64_t timestamp = time::systemTimeUs();
     CAN::RxMessageBuffer* message = CAN_CONTROLLER(bus)->getRxMessage(
             CAN::CHANNEL1);
 
@@ -17,7 +19,8 @@ static CanMessage receiveCanMessage(CanBus* bus) {
         id: message->msgSID.SID,
         format: CanMessageFormat::STANDARD,
         data: {0},
-        length: (uint8_t) message->msgEID.DLC
+        length: (uint8_t) message->msgEID.DLC,
+        timestamp: timestamp
     };
     memcpy(result.data, message->data, CAN_MESSAGE_SIZE);
 
@@ -47,7 +50,7 @@ void openxc::can::pic32::handleCanInterrupt(CanBus* bus) {
                 CAN::RX_CHANNEL_NOT_EMPTY, false);
 
         CanMessage message = receiveCanMessage(bus);
-        if(!QUEUE_PUSH(CanMessage, &bus->receiveQueue, message)) {
+        if(!queueReceivedMessage(bus, &message)) {
             // An exception to the "don't leave commented out code" rule,
             // this log statement is useful for debugging performance issues
             // but if left enabled all of the time, it can can slown down
@@ -11,3 +11,11 @@ void openxc::platform::initialize() {
     // (inspired by Arduino)
     init();
 }
+
+unsigned int openxc::platform::disableInterrupts() {
+    return ::disableInterrupts();
+}
+
+void openxc::platform::restoreInterrupts(unsigned int state) {
+    ::restoreInterrupts(state);
+}
@@ -9,4 +9,20 @@ unsigned long openxc::util::time::systemTimeMs() {
     return millis();
 }
 
+uint64_t openxc::util::time::systemTimeUs() {
+    // micros() wraps around every ~71 minutes, so extend it by counting the
+    // wraps. This must be called at least that often to notice each one.
+    static uint32_t lastMicros = 0;
+    static uint32_t wraps = 0;
+
+    unsigned int interruptStatus = disableInterrupts();
+    uint32_t now = micros();
+    if(now < lastMicros) {
+        ++wraps;
+    }
+    lastMicros = now;
+    restoreInterrupts(interruptStatus);
+    return ((uint64_t)wraps << 32) | now;
+}
+
 void openxc::util::time::initialize() { }
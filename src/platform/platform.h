@@ -16,6 +16,20 @@ void initialize();
  */
 void suspend(openxc::pipeline::Pipeline* pipeline);
 
+/* Public: Disable all interrupts, e.g. to modify a queue that's also modified
+ * from an interrupt handler.
+ *
+ * Returns the previous interrupt state, to pass to restoreInterrupts.
+ */
+unsigned int disableInterrupts();
+
+/* Public: Restore the interrupt state from before disableInterrupts was
+ * called.
+ *
+ * state - The value returned from disableInterrupts.
+ */
+void restoreInterrupts(unsigned int state);
+
 } // namespace platform
 } // namespace openxc
 
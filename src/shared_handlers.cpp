@@ -105,7 +105,8 @@ openxc_DynamicField openxc::signals::handlers::tirePressureDecoder(
 
 float firstReceivedOdometerValue(CanSignal* signals, int signalCount) {
     if(totalOdometerAtRestart == 0) {
-        CanSignal* odometerSignal = lookupSignal("total_odometer", signals,
+        static CanSignalReference odometerReference = {"total_odometer"};
+        CanSignal* odometerSignal = lookupSignal(&odometerReference, signals,
                 signalCount);
         if(odometerSignal != NULL && odometerSignal->received) {
             totalOdometerAtRestart = odometerSignal->lastValue;
@@ -187,18 +188,27 @@ openxc_DynamicField openxc::signals::handlers::handleInverted(CanSignal* signal,
 
 void openxc::signals::handlers::handleGpsMessage(CanMessage* message,
         CanSignal* signals, int signalCount, Pipeline* pipeline) {
+    static CanSignalReference latitudeDegreesReference = {"latitude_degrees"};
+    static CanSignalReference latitudeMinutesReference = {"latitude_minutes"};
+    static CanSignalReference latitudeMinuteFractionReference =
+        {"latitude_minute_fraction"};
+    static CanSignalReference longitudeDegreesReference = {"longitude_degrees"};
+    static CanSignalReference longitudeMinutesReference = {"longitude_minutes"};
+    static CanSignalReference longitudeMinuteFractionReference =
+        {"longitude_minute_fraction"};
+
     CanSignal* latitudeDegreesSignal =
-        lookupSignal("latitude_degrees", signals, signalCount);
+        lookupSignal(&latitudeDegreesReference, signals, signalCount);
     CanSignal* latitudeMinutesSignal =
-        lookupSignal("latitude_minutes", signals, signalCount);
+        lookupSignal(&latitudeMinutesReference, signals, signalCount);
     CanSignal* latitudeMinuteFractionSignal =
-        lookupSignal("latitude_minute_fraction", signals, signalCount);
+        lookupSignal(&latitudeMinuteFractionReference, signals, signalCount);
     CanSignal* longitudeDegreesSignal =
-        lookupSignal("longitude_degrees", signals, signalCount);
+        lookupSignal(&longitudeDegreesReference, signals, signalCount);
     CanSignal* longitudeMinutesSignal =
-        lookupSignal("longitude_minutes", signals, signalCount);
+        lookupSignal(&longitudeMinutesReference, signals, signalCount);
     CanSignal* longitudeMinuteFractionSignal =
-        lookupSignal("longitude_minute_fraction", signals, signalCount);
+        lookupSignal(&longitudeMinuteFractionReference, signals, signalCount);
 
     if(latitudeDegreesSignal == NULL ||
             latitudeMinutesSignal == NULL ||
@@ -244,8 +254,9 @@ openxc_DynamicField openxc::signals::handlers::handleExteriorLightSwitch(CanSign
 openxc_DynamicField openxc::signals::handlers::handleUnsignedSteeringWheelAngle(
         CanSignal* signal, CanSignal* signals, int signalCount,
         Pipeline* pipeline, float value, bool* send) {
-    CanSignal* steeringAngleSign = lookupSignal("steering_wheel_angle_sign",
-            signals, signalCount);
+    static CanSignalReference signReference = {"steering_wheel_angle_sign"};
+    CanSignal* steeringAngleSign = lookupSignal(&signReference, signals,
+            signalCount);
 
     if(steeringAngleSign == NULL) {
         debug("Unable to find stering wheel angle sign signal");
@@ -273,9 +284,11 @@ openxc_DynamicField openxc::signals::handlers::handleMultisizeWheelRotationCount
 
 void openxc::signals::handlers::handleButtonEventMessage(CanMessage* message,
         CanSignal* signals, int signalCount, Pipeline* pipeline) {
-    CanSignal* buttonTypeSignal = lookupSignal("button_type", signals,
+    static CanSignalReference buttonTypeReference = {"button_type"};
+    static CanSignalReference buttonStateReference = {"button_state"};
+    CanSignal* buttonTypeSignal = lookupSignal(&buttonTypeReference, signals,
             signalCount);
-    CanSignal* buttonStateSignal = lookupSignal("button_state", signals,
+    CanSignal* buttonStateSignal = lookupSignal(&buttonStateReference, signals,
             signalCount);
 
     if(buttonTypeSignal == NULL || buttonStateSignal == NULL) {
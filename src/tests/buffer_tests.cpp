@@ -158,6 +158,29 @@ START_TEST (test_enqueue_no_room_for_crlf)
 }
 END_TEST
 
+START_TEST (test_enqueue_wraps_around)
+{
+    for(int i = 0; i < QUEUE_MAX_LENGTH(uint8_t) - 4; i++) {
+        QUEUE_PUSH(uint8_t, &queue, 128);
+    }
+    while(!QUEUE_EMPTY(uint8_t, &queue)) {
+        QUEUE_POP(uint8_t, &queue);
+    }
+
+    char* message = "a message";
+    bool result = conditionalEnqueue(&queue, (uint8_t*)message, 10);
+    fail_unless(result);
+    ck_assert_int_eq(QUEUE_LENGTH(uint8_t, &queue), 10);
+
+    uint8_t snapshot[10];
+    QUEUE_SNAPSHOT(uint8_t, &queue, snapshot, sizeof(snapshot));
+    ck_assert_str_eq((char*)snapshot, message);
+
+    QUEUE_PUSH(uint8_t, &queue, 'b');
+    ck_assert_int_eq(QUEUE_LENGTH(uint8_t, &queue), 11);
+}
+END_TEST
+
 Suite* buffersSuite(void) {
     Suite* s = suite_create("buffers");
     TCase *tc_core = tcase_create("core");
@@ -178,6 +201,7 @@ Suite* buffersSuite(void) {
     tcase_add_test(tc_conditional, test_enqueue_full);
     tcase_add_test(tc_conditional, test_enqueue_no_room_for_crlf);
     tcase_add_test(tc_conditional, test_enqueue_just_enough_room);
+    tcase_add_test(tc_conditional, test_enqueue_wraps_around);
     suite_add_tcase(s, tc_conditional);
 
     return s;
@@ -35,7 +35,7 @@ bool queueEmpty() {
 }
 
 void setup() {
-    getConfiguration()->payloadFormat = openxc::payload::PayloadFormat::PROTOBUF;
+    getConfiguration()->usb.descriptor.payloadFormat = openxc::payload::PayloadFormat::PROTOBUF;
     initializeVehicleInterface();
     usb::initialize(&getConfiguration()->usb);
     getConfiguration()->usb.configured = true;
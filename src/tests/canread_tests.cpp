@@ -1,6 +1,7 @@
 #include <check.h>
 #include <stdint.h>
 #include <string>
+#include <canutil/read.h>
 #include "signals.h"
 #include "can/canutil.h"
 #include "can/canread.h"
@@ -52,14 +53,18 @@ void setup() {
     USB_PROCESSED = false;
     SENT_BYTES = 0;
     initializeVehicleInterface();
-    getConfiguration()->payloadFormat = openxc::payload::PayloadFormat::JSON;
+    getConfiguration()->usb.descriptor.payloadFormat = openxc::payload::PayloadFormat::JSON;
     usb::initialize(&getConfiguration()->usb);
     getConfiguration()->usb.configured = true;
+    getConfiguration()->integerDecoding = false;
+    getConfiguration()->messageTimestamps = false;
     for(int i = 0; i < getSignalCount(); i++) {
         getSignals()[i].received = false;
         getSignals()[i].sendSame = true;
         getSignals()[i].frequencyClock = {0};
         getSignals()[i].decoder = NULL;
+        getSignals()[i].precision = 0;
+        getSignals()[i].hasPrecision = false;
     }
 }
 
@@ -137,7 +142,7 @@ START_TEST (test_preserve_float_precision)
     QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
     snapshot[sizeof(snapshot) - 1] = NULL;
     ck_assert_str_eq((char*)snapshot,
-            "{\"name\":\"test\",\"value\":42.500000}\0");
+            "{\"name\":\"test\",\"value\":42.5}\0");
 }
 END_TEST
 
@@ -315,6 +320,76 @@ START_TEST (test_passthrough_message)
 }
 END_TEST
 
+START_TEST (test_passthrough_message_timestamp)
+{
+    getConfiguration()->messageTimestamps = true;
+    CanMessage message = {
+        id: 42,
+        format: CanMessageFormat::STANDARD,
+        data: {0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF1},
+        length: 8,
+        timestamp: 1500000
+    };
+    can::read::passthroughMessage(&getCanBuses()[0], &message, NULL, 0,
+            &getConfiguration()->pipeline);
+    fail_if(queueEmpty());
+
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE) + 1];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    snapshot[sizeof(snapshot) - 1] = NULL;
+    ck_assert(strstr((char*)snapshot, "\"timestamp\":1.5") != NULL);
+}
+END_TEST
+
+START_TEST (test_passthrough_message_compact)
+{
+    getConfiguration()->usb.descriptor.payloadFormat =
+            openxc::payload::PayloadFormat::COMPACT;
+    CanMessage message = {
+        id: 0x7e8,
+        format: CanMessageFormat::STANDARD,
+        data: {0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF1},
+        length: 8
+    };
+    can::read::passthroughMessage(&getCanBuses()[0], &message, NULL, 0,
+            &getConfiguration()->pipeline);
+    ck_assert_int_eq(QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE), 18);
+
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE)];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    // The record 04 01 e8 07 00 00 00 08 12 34 ... f1, COBS-framed
+    const uint8_t expected[] = {5, 0x04, 1, 0xe8, 0x07, 1, 1, 10, 8,
+            0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF1, 0};
+    ck_assert(!memcmp(snapshot, expected, sizeof(expected)));
+}
+END_TEST
+
+START_TEST (test_translate_timestamp)
+{
+    CanMessage message = TEST_MESSAGE;
+    message.timestamp = 2250000;
+    can::read::translateSignal(&getSignals()[0], &message, getSignals(),
+            getSignalCount(), &getConfiguration()->pipeline);
+    fail_if(queueEmpty());
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE) + 1];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    snapshot[sizeof(snapshot) - 1] = NULL;
+    ck_assert(strstr((char*)snapshot, "timestamp") == NULL);
+
+    QUEUE_INIT(uint8_t, OUTPUT_QUEUE);
+    getConfiguration()->messageTimestamps = true;
+    can::read::translateSignal(&getSignals()[0], &message, getSignals(),
+            getSignalCount(), &getConfiguration()->pipeline);
+    fail_if(queueEmpty());
+    uint8_t timestampedSnapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE) + 1];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, timestampedSnapshot,
+            sizeof(timestampedSnapshot));
+    timestampedSnapshot[sizeof(timestampedSnapshot) - 1] = NULL;
+    ck_assert(strstr((char*)timestampedSnapshot,
+                "\"timestamp\":2.25") != NULL);
+}
+END_TEST
+
 openxc_DynamicField floatDecoder(CanSignal* signal, CanSignal* signals, int signalCount,
         Pipeline* pipeline, float value, bool* send) {
     openxc_DynamicField decodedValue = {0};
@@ -370,12 +445,108 @@ START_TEST (test_translate_many_signals)
                 &TEST_MESSAGE, getSignals(), getSignalCount(), &getConfiguration()->pipeline);
         fail_unless(getSignals()[i].received);
     }
-    fail_unless(USB_PROCESSED);
-    // 8 signals sent
-    ck_assert_int_eq(10 * 29 + 2, SENT_BYTES);
-    // 6 in the output queue
+    // the output queue fills up after 10 signals, and the rest are dropped
+    // instead of waiting for it to be flushed
+    fail_if(USB_PROCESSED);
+    ck_assert_int_eq(0, SENT_BYTES);
+    ck_assert_int_eq(10 * 29, QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE));
+}
+END_TEST
+
+START_TEST (test_word_extraction_matches_bitfield)
+{
+    const uint8_t payloads[][CAN_MESSAGE_SIZE] = {
+        {0xeb, 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde},
+        {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff},
+        {0x80, 0x00, 0x00, 0x01, 0x80, 0x00, 0x00, 0x01},
+    };
+
+    CanSignal signal = {NULL, "test", 0, 1, 0.5, -10.0};
+    CanMessage message = TEST_MESSAGE;
+    for(size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++) {
+        memcpy(message.data, payloads[i], CAN_MESSAGE_SIZE);
+        for(int position = 0; position < CAN_MESSAGE_SIZE * 8; position++) {
+            for(int size = 1; position + size <= CAN_MESSAGE_SIZE * 8;
+                    size++) {
+                signal.bitPosition = position;
+                signal.bitSize = size;
+                can::prepareSignalBitfield(&signal);
+                fail_unless(signal.bitfieldPrepared);
+
+                float expected = bitfield_parse_float(message.data,
+                        CAN_MESSAGE_SIZE, position, size, signal.factor,
+                        signal.offset);
+                float actual = can::read::parseSignalBitfield(&signal,
+                        &message);
+                fail_unless(expected == actual,
+                        "Mismatch at bit %d, size %d: %f != %f", position,
+                        size, expected, actual);
+            }
+        }
+    }
+}
+END_TEST
+
+START_TEST (test_word_extraction_out_of_range)
+{
+    CanSignal signal = {NULL, "test", 60, 8, 1.0, 3.0};
+    can::prepareSignalBitfield(&signal);
+    fail_if(signal.bitfieldPrepared);
+    ck_assert(can::read::parseSignalBitfield(&signal, &TEST_MESSAGE) ==
+            bitfield_parse_float(TEST_MESSAGE.data, CAN_MESSAGE_SIZE, 60, 8,
+                1.0, 3.0));
+}
+END_TEST
+
+START_TEST (test_index_signals)
+{
+    // signals for message 4 are contiguous
+    ck_assert(getMessages()[4].signals == &getSignals()[7]);
+    ck_assert_int_eq(getMessages()[4].signalCount, 8);
+
+    // signals for message 2 are at 2, 4 and 5
+    ck_assert(getMessages()[2].signals == &getSignals()[2]);
+    ck_assert_int_eq(getMessages()[2].signalCount, 4);
+}
+END_TEST
+
+START_TEST (test_decode_message)
+{
+    CanMessage message = TEST_MESSAGE;
+    message.id = 4;
+    ck_assert(can::read::decodeMessage(&getCanBuses()[0], &message,
+            getMessages(), getMessageCount(), getSignals(), getSignalCount(),
+            &getConfiguration()->pipeline));
+    for(int i = 0; i < getSignalCount(); i++) {
+        ck_assert(getSignals()[i].received ==
+                (getSignals()[i].message == &getMessages()[4]));
+    }
     fail_if(queueEmpty());
-    ck_assert_int_eq(6 * 29, QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE));
+}
+END_TEST
+
+START_TEST (test_decode_message_non_contiguous)
+{
+    CanMessage message = TEST_MESSAGE;
+    message.id = 2;
+    ck_assert(can::read::decodeMessage(&getCanBuses()[0], &message,
+            getMessages(), getMessageCount(), getSignals(), getSignalCount(),
+            &getConfiguration()->pipeline));
+    fail_unless(getSignals()[2].received);
+    fail_if(getSignals()[3].received);
+    fail_unless(getSignals()[4].received);
+    fail_unless(getSignals()[5].received);
+}
+END_TEST
+
+START_TEST (test_decode_message_undefined)
+{
+    CanMessage message = TEST_MESSAGE;
+    message.id = 999;
+    fail_if(can::read::decodeMessage(&getCanBuses()[0], &message,
+            getMessages(), getMessageCount(), getSignals(), getSignalCount(),
+            &getConfiguration()->pipeline));
+    fail_unless(queueEmpty());
 }
 END_TEST
 
@@ -395,6 +566,46 @@ START_TEST (test_translate_float)
 }
 END_TEST
 
+openxc_DynamicField fractionDecoder(CanSignal* signal, CanSignal* signals,
+        int signalCount, Pipeline* pipeline, float value, bool* send) {
+    return openxc::payload::wrapNumber(42.4567);
+}
+
+START_TEST (test_translate_precision)
+{
+    getSignals()[0].decoder = fractionDecoder;
+    getSignals()[0].precision = 2;
+    getSignals()[0].hasPrecision = true;
+    can::read::translateSignal(&getSignals()[0],
+            &TEST_MESSAGE, getSignals(), getSignalCount(), &getConfiguration()->pipeline);
+    fail_if(queueEmpty());
+
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE) + 1];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    snapshot[sizeof(snapshot) - 1] = NULL;
+    ck_assert_str_eq((char*)snapshot,
+            "{\"name\":\"torque_at_transmission\",\"value\":42.46}\0");
+}
+END_TEST
+
+START_TEST (test_translate_precision_zero)
+{
+    getSignals()[0].decoder = fractionDecoder;
+    getSignals()[0].precision = 0;
+    getSignals()[0].hasPrecision = true;
+    can::read::translateSignal(&getSignals()[0],
+            &TEST_MESSAGE, getSignals(), getSignalCount(), &getConfiguration()->pipeline);
+    fail_if(queueEmpty());
+
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE) + 1];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    snapshot[sizeof(snapshot) - 1] = NULL;
+    ck_assert_str_eq((char*)snapshot,
+            "{\"name\":\"torque_at_transmission\",\"value\":42}\0");
+}
+END_TEST
+
+
 int frequencyTestCounter = 0;
 openxc_DynamicField floatDecoderFrequencyTest(CanSignal* signal, CanSignal* signals,
         int signalCount, Pipeline* pipeline, float value, bool* send) {
@@ -554,6 +765,98 @@ START_TEST (test_dont_send_same)
 }
 END_TEST
 
+START_TEST (test_integer_decoding_matches_float)
+{
+    can::read::translateSignal(&getSignals()[0], &TEST_MESSAGE, getSignals(),
+            getSignalCount(), &getConfiguration()->pipeline);
+    fail_if(queueEmpty());
+    uint8_t floatSnapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE) + 1];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, floatSnapshot, sizeof(floatSnapshot));
+    floatSnapshot[sizeof(floatSnapshot) - 1] = NULL;
+    float floatValue = getSignals()[0].lastValue;
+
+    QUEUE_INIT(uint8_t, OUTPUT_QUEUE);
+    getSignals()[0].received = false;
+    getConfiguration()->integerDecoding = true;
+    can::read::translateSignal(&getSignals()[0], &TEST_MESSAGE, getSignals(),
+            getSignalCount(), &getConfiguration()->pipeline);
+    fail_if(queueEmpty());
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE) + 1];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    snapshot[sizeof(snapshot) - 1] = NULL;
+
+    ck_assert_str_eq((char*)snapshot, (char*)floatSnapshot);
+    ck_assert(getSignals()[0].lastValue == floatValue);
+    ck_assert_int_eq(getSignals()[0].lastRawValue, 0xa);
+    fail_unless(getSignals()[0].received);
+}
+END_TEST
+
+START_TEST (test_integer_decoding_dont_send_same)
+{
+    getConfiguration()->integerDecoding = true;
+    getSignals()[0].sendSame = false;
+    can::read::translateSignal(&getSignals()[0], &TEST_MESSAGE, getSignals(),
+            getSignalCount(), &getConfiguration()->pipeline);
+    fail_if(queueEmpty());
+
+    QUEUE_INIT(uint8_t, OUTPUT_QUEUE);
+    can::read::translateSignal(&getSignals()[0], &TEST_MESSAGE, getSignals(),
+            getSignalCount(), &getConfiguration()->pipeline);
+    fail_unless(queueEmpty());
+
+    CanMessage message = TEST_MESSAGE;
+    message.data[0] = 0xc3;
+    can::read::translateSignal(&getSignals()[0], &message, getSignals(),
+            getSignalCount(), &getConfiguration()->pipeline);
+    fail_if(queueEmpty());
+    ck_assert_int_eq(getSignals()[0].lastRawValue, 0);
+    ck_assert(getSignals()[0].lastValue == -30000);
+}
+END_TEST
+
+START_TEST (test_integer_decoding_precision)
+{
+    getConfiguration()->integerDecoding = true;
+    getSignals()[3].precision = 1;
+    getSignals()[3].hasPrecision = true;
+    // A raw value of 12345, which is 12.345 after the 0.001 factor
+    CanMessage message = TEST_MESSAGE;
+    message.data[0] = 0x01;
+    message.data[1] = 0x81;
+    message.data[2] = 0xc8;
+    for(int i = 3; i < 8; i++) {
+        message.data[i] = 0;
+    }
+    can::read::translateSignal(&getSignals()[3], &message, getSignals(),
+            getSignalCount(), &getConfiguration()->pipeline);
+    fail_if(queueEmpty());
+
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE) + 1];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    snapshot[sizeof(snapshot) - 1] = NULL;
+    ck_assert_str_eq((char*)snapshot,
+            "{\"name\":\"measurement\",\"value\":12.3}\0");
+    ck_assert_int_eq(getSignals()[3].lastRawValue, 12345);
+}
+END_TEST
+
+START_TEST (test_integer_decoding_skips_custom_decoder)
+{
+    getConfiguration()->integerDecoding = true;
+    getSignals()[2].decoder = booleanDecoder;
+    can::read::translateSignal(&getSignals()[2], &TEST_MESSAGE, getSignals(),
+            getSignalCount(), &getConfiguration()->pipeline);
+    fail_if(queueEmpty());
+
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE) + 1];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    snapshot[sizeof(snapshot) - 1] = NULL;
+    ck_assert_str_eq((char*)snapshot,
+            "{\"name\":\"brake_pedal_status\",\"value\":true}\0");
+}
+END_TEST
+
 Suite* canreadSuite(void) {
     Suite* s = suite_create("canread");
     TCase *tc_core = tcase_create("core");
@@ -574,13 +877,18 @@ Suite* canreadSuite(void) {
     tcase_add_test(tc_sending, test_send_evented_string);
     tcase_add_test(tc_sending, test_send_evented_float);
     tcase_add_test(tc_sending, test_passthrough_message);
+    tcase_add_test(tc_sending, test_passthrough_message_compact);
     tcase_add_test(tc_sending, test_passthrough_limited_frequency);
     tcase_add_test(tc_sending, test_passthrough_force_send_changed);
+    tcase_add_test(tc_sending, test_passthrough_message_timestamp);
     suite_add_tcase(s, tc_sending);
 
     TCase *tc_translate = tcase_create("translate");
     tcase_add_checked_fixture(tc_translate, setup, NULL);
     tcase_add_test(tc_translate, test_translate_float);
+    tcase_add_test(tc_translate, test_translate_precision);
+    tcase_add_test(tc_translate, test_translate_precision_zero);
+    tcase_add_test(tc_translate, test_translate_timestamp);
     tcase_add_test(tc_translate, test_translate_string);
     tcase_add_test(tc_translate, test_limited_frequency);
     tcase_add_test(tc_translate, test_unlimited_frequency);
@@ -596,6 +904,16 @@ Suite* canreadSuite(void) {
             test_decoder_called_every_time_with_unlimited_frequency);
     tcase_add_test(tc_translate,
             test_translate_many_signals);
+    tcase_add_test(tc_translate, test_index_signals);
+    tcase_add_test(tc_translate, test_word_extraction_matches_bitfield);
+    tcase_add_test(tc_translate, test_word_extraction_out_of_range);
+    tcase_add_test(tc_translate, test_decode_message);
+    tcase_add_test(tc_translate, test_decode_message_non_contiguous);
+    tcase_add_test(tc_translate, test_decode_message_undefined);
+    tcase_add_test(tc_translate, test_integer_decoding_matches_float);
+    tcase_add_test(tc_translate, test_integer_decoding_dont_send_same);
+    tcase_add_test(tc_translate, test_integer_decoding_skips_custom_decoder);
+    tcase_add_test(tc_translate, test_integer_decoding_precision);
     suite_add_tcase(s, tc_translate);
 
     return s;
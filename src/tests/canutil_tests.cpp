@@ -1,5 +1,6 @@
 #include <check.h>
 #include <stdint.h>
+#include <string.h>
 #include "signals.h"
 #include "can/canread.h"
 #include "can/canwrite.h"
@@ -14,7 +15,13 @@ using openxc::can::lookupSignalState;
 using openxc::can::lookupMessageDefinition;
 using openxc::can::registerMessageDefinition;
 using openxc::can::unregisterMessageDefinition;
+using openxc::can::indexMessageDefinitions;
 using openxc::can::setAcceptanceFilterStatus;
+using openxc::can::addAcceptanceFilter;
+using openxc::can::removeAcceptanceFilter;
+using openxc::can::shouldAcceptMessage;
+using openxc::can::queueReceivedMessage;
+using openxc::can::receiveQueueCapacity;
 using openxc::signals::getCanBusCount;
 using openxc::signals::getCanBuses;
 using openxc::signals::getMessages;
@@ -88,6 +95,20 @@ START_TEST (test_lookup_writable_signal)
 }
 END_TEST
 
+START_TEST (test_lookup_signal_reference)
+{
+    CanSignalReference reference = {"torque_at_transmission"};
+    ck_assert(lookupSignal(&reference, getSignals(), getSignalCount()) ==
+            &getSignals()[0]);
+    ck_assert(reference.signals == getSignals());
+    ck_assert(lookupSignal(&reference, getSignals(), getSignalCount()) ==
+            &getSignals()[0]);
+
+    CanSignalReference missing = {"does_not_exist"};
+    ck_assert(lookupSignal(&missing, getSignals(), getSignalCount()) == NULL);
+}
+END_TEST
+
 START_TEST (test_lookup_signal_state_by_name)
 {
     fail_unless(lookupSignalState("does_not_exist", &getSignals()[1]) == NULL);
@@ -207,6 +228,84 @@ START_TEST (test_unregister_predefined)
 }
 END_TEST
 
+START_TEST (test_get_can_message_definition_wrong_format)
+{
+    ck_assert(lookupMessageDefinition(&getCanBuses()[0], 1,
+            CanMessageFormat::EXTENDED, getMessages(),
+            getMessageCount()) == NULL);
+}
+END_TEST
+
+START_TEST (test_get_can_message_definition_indexed)
+{
+    CanBus* bus = &getCanBuses()[0];
+    indexMessageDefinitions(bus, getMessages(), getMessageCount());
+
+    for(int i = 0; i < getMessageCount(); i++) {
+        CanMessageDefinition* definition = &getMessages()[i];
+        if(definition->bus == bus) {
+            ck_assert(lookupMessageDefinition(bus, definition->id,
+                    definition->format, getMessages(), getMessageCount()) ==
+                    definition);
+        }
+    }
+
+    ck_assert(lookupMessageDefinition(bus, 999, CanMessageFormat::STANDARD,
+            getMessages(), getMessageCount()) == NULL);
+    ck_assert(lookupMessageDefinition(bus, 1, CanMessageFormat::EXTENDED,
+            getMessages(), getMessageCount()) == NULL);
+}
+END_TEST
+
+START_TEST (test_get_can_message_definition_index_overflow)
+{
+    CanBus* bus = &getCanBuses()[0];
+    const int messageCount = MAX_MESSAGE_INDEX_SIZE + 2;
+    CanMessageDefinition messages[messageCount];
+    memset(messages, 0, sizeof(messages));
+    for(int i = 0; i < messageCount; i++) {
+        messages[i].bus = bus;
+        messages[i].id = i;
+        messages[i].format = CanMessageFormat::STANDARD;
+    }
+    indexMessageDefinitions(bus, messages, messageCount);
+
+    // definitions that didn't fit in the index are still found
+    for(int i = 0; i < messageCount; i++) {
+        ck_assert(lookupMessageDefinition(bus, i, CanMessageFormat::STANDARD,
+                messages, messageCount) == &messages[i]);
+    }
+    ck_assert(lookupMessageDefinition(bus, messageCount,
+            CanMessageFormat::STANDARD, messages, messageCount) == NULL);
+}
+END_TEST
+
+START_TEST (test_register_can_message_indexed)
+{
+    CanBus* bus = &getCanBuses()[0];
+    indexMessageDefinitions(bus, getMessages(), getMessageCount());
+
+    ck_assert(registerMessageDefinition(bus, MESSAGE_ID,
+            CanMessageFormat::EXTENDED, getMessages(), getMessageCount()));
+    CanMessageDefinition* message = lookupMessageDefinition(bus, MESSAGE_ID,
+            CanMessageFormat::EXTENDED, getMessages(), getMessageCount());
+    ck_assert(message != NULL);
+    ck_assert_int_eq(message->id, MESSAGE_ID);
+    ck_assert_int_eq(message->format, CanMessageFormat::EXTENDED);
+    ck_assert(lookupMessageDefinition(bus, MESSAGE_ID,
+            CanMessageFormat::STANDARD, getMessages(),
+            getMessageCount()) == NULL);
+
+    ck_assert(unregisterMessageDefinition(bus, MESSAGE_ID,
+            CanMessageFormat::EXTENDED));
+    ck_assert(lookupMessageDefinition(bus, MESSAGE_ID,
+            CanMessageFormat::EXTENDED, getMessages(),
+            getMessageCount()) == NULL);
+    ck_assert(lookupMessageDefinition(bus, 1, CanMessageFormat::STANDARD,
+            getMessages(), getMessageCount()) == &getMessages()[1]);
+}
+END_TEST
+
 START_TEST (test_set_acceptance_filter_status)
 {
     ck_assert(setAcceptanceFilterStatus(&getCanBuses()[0], true, getCanBuses(), getCanBusCount()));
@@ -219,6 +318,136 @@ START_TEST (test_set_acceptance_filter_status)
 }
 END_TEST
 
+START_TEST (test_should_accept_bypassed)
+{
+    CanBus* bus = &getCanBuses()[0];
+    bus->bypassFilters = true;
+    ck_assert(shouldAcceptMessage(bus, 0x123, CanMessageFormat::STANDARD));
+    ck_assert(shouldAcceptMessage(bus, 0x18db33f1, CanMessageFormat::EXTENDED));
+}
+END_TEST
+
+START_TEST (test_should_accept_standard_filter)
+{
+    CanBus* bus = &getCanBuses()[0];
+    bus->bypassFilters = false;
+    ck_assert(!shouldAcceptMessage(bus, 0x7e8, CanMessageFormat::STANDARD));
+
+    ck_assert(addAcceptanceFilter(bus, 0x7e8, CanMessageFormat::STANDARD,
+                getCanBuses(), getCanBusCount()));
+    ck_assert(shouldAcceptMessage(bus, 0x7e8, CanMessageFormat::STANDARD));
+    ck_assert(!shouldAcceptMessage(bus, 0x7e9, CanMessageFormat::STANDARD));
+    ck_assert(!shouldAcceptMessage(bus, 0x7e8, CanMessageFormat::EXTENDED));
+    ck_assert(!shouldAcceptMessage(&getCanBuses()[1], 0x7e8,
+                CanMessageFormat::STANDARD));
+}
+END_TEST
+
+START_TEST (test_should_accept_extended_filter)
+{
+    CanBus* bus = &getCanBuses()[0];
+    bus->bypassFilters = false;
+    uint32_t ids[] = {0x18daf110, 0x18daf101, 0x1fffffff, 0x800};
+    for(size_t i = 0; i < sizeof(ids) / sizeof(uint32_t); i++) {
+        ck_assert(addAcceptanceFilter(bus, ids[i], CanMessageFormat::EXTENDED,
+                    getCanBuses(), getCanBusCount()));
+    }
+
+    for(size_t i = 0; i < sizeof(ids) / sizeof(uint32_t); i++) {
+        ck_assert(shouldAcceptMessage(bus, ids[i], CanMessageFormat::EXTENDED));
+    }
+    ck_assert(!shouldAcceptMessage(bus, 0x18daf111, CanMessageFormat::EXTENDED));
+    ck_assert(!shouldAcceptMessage(bus, 0x0, CanMessageFormat::EXTENDED));
+}
+END_TEST
+
+START_TEST (test_remove_filter_honors_user_count)
+{
+    CanBus* bus = &getCanBuses()[0];
+    bus->bypassFilters = false;
+    ck_assert(addAcceptanceFilter(bus, 0x7e8, CanMessageFormat::STANDARD,
+                getCanBuses(), getCanBusCount()));
+    ck_assert(addAcceptanceFilter(bus, 0x7e8, CanMessageFormat::STANDARD,
+                getCanBuses(), getCanBusCount()));
+    ck_assert(addAcceptanceFilter(bus, 0x18daf110, CanMessageFormat::EXTENDED,
+                getCanBuses(), getCanBusCount()));
+
+    removeAcceptanceFilter(bus, 0x7e8, CanMessageFormat::STANDARD,
+            getCanBuses(), getCanBusCount());
+    ck_assert(shouldAcceptMessage(bus, 0x7e8, CanMessageFormat::STANDARD));
+
+    removeAcceptanceFilter(bus, 0x7e8, CanMessageFormat::STANDARD,
+            getCanBuses(), getCanBusCount());
+    ck_assert(!shouldAcceptMessage(bus, 0x7e8, CanMessageFormat::STANDARD));
+
+    removeAcceptanceFilter(bus, 0x18daf110, CanMessageFormat::EXTENDED,
+            getCanBuses(), getCanBusCount());
+    ck_assert(!shouldAcceptMessage(bus, 0x18daf110,
+                CanMessageFormat::EXTENDED));
+}
+END_TEST
+
+START_TEST (test_filters_for_same_id_different_format)
+{
+    CanBus* bus = &getCanBuses()[0];
+    bus->bypassFilters = false;
+    ck_assert(addAcceptanceFilter(bus, 0x7e8, CanMessageFormat::STANDARD,
+                getCanBuses(), getCanBusCount()));
+    ck_assert(addAcceptanceFilter(bus, 0x7e8, CanMessageFormat::EXTENDED,
+                getCanBuses(), getCanBusCount()));
+    ck_assert(shouldAcceptMessage(bus, 0x7e8, CanMessageFormat::STANDARD));
+    ck_assert(shouldAcceptMessage(bus, 0x7e8, CanMessageFormat::EXTENDED));
+
+    removeAcceptanceFilter(bus, 0x7e8, CanMessageFormat::EXTENDED,
+            getCanBuses(), getCanBusCount());
+    ck_assert(shouldAcceptMessage(bus, 0x7e8, CanMessageFormat::STANDARD));
+    ck_assert(!shouldAcceptMessage(bus, 0x7e8, CanMessageFormat::EXTENDED));
+}
+END_TEST
+
+START_TEST (test_receive_queue_default_capacity)
+{
+    CanBus* bus = &getCanBuses()[0];
+    bus->receiveQueueSize = 0;
+    ck_assert_int_eq(receiveQueueCapacity(bus), CAN_QUEUE_MAX_LENGTH);
+
+    bus->receiveQueueSize = CAN_QUEUE_MAX_LENGTH + 1;
+    ck_assert_int_eq(receiveQueueCapacity(bus), CAN_QUEUE_MAX_LENGTH);
+    bus->receiveQueueSize = 0;
+}
+END_TEST
+
+START_TEST (test_receive_queue_limited_capacity)
+{
+    CanBus* bus = &getCanBuses()[0];
+    bus->receiveQueueSize = 2;
+    CanMessage message = {0x42};
+    ck_assert(queueReceivedMessage(bus, &message));
+    ck_assert(queueReceivedMessage(bus, &message));
+    ck_assert(!queueReceivedMessage(bus, &message));
+    ck_assert_int_eq(can::ring::length(&bus->receiveQueue), 2);
+    bus->receiveQueueSize = 0;
+}
+END_TEST
+
+START_TEST (test_receive_queue_high_water_mark)
+{
+    CanBus* bus = &getCanBuses()[0];
+    ck_assert_int_eq(bus->receiveQueueHighWaterMark, 0);
+
+    CanMessage message = {0x42};
+    ck_assert(queueReceivedMessage(bus, &message));
+    ck_assert(queueReceivedMessage(bus, &message));
+    ck_assert(queueReceivedMessage(bus, &message));
+    ck_assert_int_eq(bus->receiveQueueHighWaterMark, 3);
+
+    CanMessage popped[2];
+    ck_assert_int_eq(can::ring::popBulk(&bus->receiveQueue, popped, 2), 2);
+    ck_assert(queueReceivedMessage(bus, &message));
+    ck_assert_int_eq(bus->receiveQueueHighWaterMark, 3);
+}
+END_TEST
+
 Suite* canutilSuite(void) {
     Suite* s = suite_create("canutil");
     TCase *tc_core = tcase_create("core");
@@ -228,6 +457,7 @@ Suite* canutilSuite(void) {
     tcase_add_test(tc_core, test_can_signal_states);
     tcase_add_test(tc_core, test_lookup_signal);
     tcase_add_test(tc_core, test_lookup_writable_signal);
+    tcase_add_test(tc_core, test_lookup_signal_reference);
     tcase_add_test(tc_core, test_lookup_signal_state_by_name);
     tcase_add_test(tc_core, test_lookup_signal_state_by_value);
     tcase_add_test(tc_core, test_lookup_command);
@@ -244,8 +474,29 @@ Suite* canutilSuite(void) {
     tcase_add_test(tc_message_def, test_unregister_can_message);
     tcase_add_test(tc_message_def, test_unregister_can_message_not_registered);
     tcase_add_test(tc_message_def, test_unregister_predefined);
+    tcase_add_test(tc_message_def, test_get_can_message_definition_wrong_format);
+    tcase_add_test(tc_message_def, test_get_can_message_definition_indexed);
+    tcase_add_test(tc_message_def,
+            test_get_can_message_definition_index_overflow);
+    tcase_add_test(tc_message_def, test_register_can_message_indexed);
     suite_add_tcase(s, tc_message_def);
 
+    TCase *tc_filters = tcase_create("acceptance_filters");
+    tcase_add_checked_fixture(tc_filters, setup, teardown);
+    tcase_add_test(tc_filters, test_should_accept_bypassed);
+    tcase_add_test(tc_filters, test_should_accept_standard_filter);
+    tcase_add_test(tc_filters, test_should_accept_extended_filter);
+    tcase_add_test(tc_filters, test_remove_filter_honors_user_count);
+    tcase_add_test(tc_filters, test_filters_for_same_id_different_format);
+    suite_add_tcase(s, tc_filters);
+
+    TCase *tc_queues = tcase_create("queues");
+    tcase_add_checked_fixture(tc_queues, setup, teardown);
+    tcase_add_test(tc_queues, test_receive_queue_default_capacity);
+    tcase_add_test(tc_queues, test_receive_queue_limited_capacity);
+    tcase_add_test(tc_queues, test_receive_queue_high_water_mark);
+    suite_add_tcase(s, tc_queues);
+
     return s;
 }
 
@@ -129,6 +129,26 @@ START_TEST (test_enqueue_message)
 }
 END_TEST
 
+START_TEST (test_enqueue_message_limited_capacity)
+{
+    CanBus* bus = &getCanBuses()[0];
+    bus->sendQueueSize = 2;
+    bus->sendQueueHighWaterMark = 0;
+    CanMessage message = {
+        id: 42,
+        format: CanMessageFormat::STANDARD,
+        data: {0x12, 0x34, 0x56}
+    };
+    can::write::enqueueMessage(bus, &message);
+    can::write::enqueueMessage(bus, &message);
+    can::write::enqueueMessage(bus, &message);
+
+    ck_assert_int_eq(2, QUEUE_LENGTH(CanMessage, &bus->sendQueue));
+    ck_assert_int_eq(2, bus->sendQueueHighWaterMark);
+    bus->sendQueueSize = 0;
+}
+END_TEST
+
 START_TEST (test_swaps_byte_order)
 {
     CanMessage message = {
@@ -353,6 +373,7 @@ Suite* canwriteSuite(void) {
     TCase *tc_send = tcase_create("send");
     tcase_add_checked_fixture(tc_send, setup, NULL);
     tcase_add_test(tc_send, test_enqueue_message);
+    tcase_add_test(tc_send, test_enqueue_message_limited_capacity);
     tcase_add_test(tc_send, test_swaps_byte_order);
     tcase_add_test(tc_send, test_send_using_default);
     tcase_add_test(tc_send, test_send_with_null_writer);
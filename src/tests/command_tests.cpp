@@ -63,7 +63,9 @@ static void resetQueues() {
 void setup() {
     getConfiguration()->desiredRunLevel = openxc::config::RunLevel::ALL_IO;
     getConfiguration()->obd2BusAddress = 0;
-    getConfiguration()->payloadFormat = PayloadFormat::JSON;
+    getConfiguration()->usb.descriptor.payloadFormat = PayloadFormat::JSON;
+    DESCRIPTOR.payloadFormat = PayloadFormat::JSON;
+    DESCRIPTOR.type = InterfaceType::USB;
     initializeVehicleInterface();
     getConfiguration()->usb.configured = true;
     fail_unless(canQueueEmpty(0));
@@ -611,6 +613,37 @@ START_TEST (test_device_id_message_in_stream)
 }
 END_TEST
 
+START_TEST (test_latency_message_in_stream)
+{
+    uint8_t request[] = "{\"command\": \"latency\"}\0";
+    ck_assert(outputQueueEmpty());
+    ck_assert(handleIncomingMessage(request, sizeof(request), &DESCRIPTOR));
+    ck_assert(!outputQueueEmpty());
+
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE) + 1];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    snapshot[sizeof(snapshot) - 1] = NULL;
+    ck_assert(strstr((char*)snapshot, "\"latency\"") != NULL);
+    ck_assert(strstr((char*)snapshot, "can1 decode") != NULL);
+}
+END_TEST
+
+START_TEST (test_signal_dictionary_message_in_stream)
+{
+    uint8_t request[] = "{\"command\": \"signal_dictionary\"}\0";
+    ck_assert(outputQueueEmpty());
+    ck_assert(handleIncomingMessage(request, sizeof(request), &DESCRIPTOR));
+    ck_assert(!outputQueueEmpty());
+
+    // The responses don't all fit in the queue, so the last one is only queued
+    // once the earlier ones are flushed
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE) + 1];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    snapshot[sizeof(snapshot) - 1] = NULL;
+    ck_assert(strstr((char*)snapshot, "\"signal_dictionary\"") != NULL);
+    ck_assert(strstr((char*)snapshot, "6 torque_at_transmission") != NULL);
+}
+END_TEST
 
 START_TEST (test_validate_raw)
 {
@@ -768,6 +801,53 @@ START_TEST (test_validate_version_command)
 }
 END_TEST
 
+START_TEST (test_validate_latency_command)
+{
+    CONTROL_COMMAND.control_command.type = openxc::commands::LATENCY_COMMAND_TYPE;
+    ck_assert(validate(&CONTROL_COMMAND));
+}
+END_TEST
+
+START_TEST (test_validate_signal_dictionary_command)
+{
+    CONTROL_COMMAND.control_command.type =
+            openxc::commands::SIGNAL_DICTIONARY_COMMAND_TYPE;
+    ck_assert(validate(&CONTROL_COMMAND));
+}
+END_TEST
+
+START_TEST (test_payload_format_command_compact)
+{
+    uint8_t request[] = "{\"command\": \"payload_format\", \"format\": \"compact\"}\0";
+    ck_assert(handleIncomingMessage(request, sizeof(request), &DESCRIPTOR));
+    ck_assert_int_eq(PayloadFormat::COMPACT, DESCRIPTOR.payloadFormat);
+}
+END_TEST
+
+START_TEST (test_payload_format_command_from_compact_uart)
+{
+    // Unlike protobuf, compact commands are framed so they can be read from
+    // a UART
+    DESCRIPTOR.type = InterfaceType::UART;
+    DESCRIPTOR.payloadFormat = PayloadFormat::COMPACT;
+    CONTROL_COMMAND.control_command.type =
+            openxc_ControlCommand_Type_PAYLOAD_FORMAT;
+    CONTROL_COMMAND.control_command.has_diagnostic_request = false;
+    CONTROL_COMMAND.control_command.has_payload_format_command = true;
+    CONTROL_COMMAND.control_command.payload_format_command.has_format = true;
+    CONTROL_COMMAND.control_command.payload_format_command.format =
+            openxc_PayloadFormatCommand_PayloadFormat_JSON;
+
+    uint8_t request[128];
+    int length = openxc::payload::serialize(&CONTROL_COMMAND, request,
+            sizeof(request), PayloadFormat::COMPACT);
+    ck_assert(length > 0);
+    ck_assert_int_eq(handleIncomingMessage(request, length, &DESCRIPTOR),
+            length);
+    ck_assert_int_eq(PayloadFormat::JSON, DESCRIPTOR.payloadFormat);
+}
+END_TEST
+
 START_TEST (test_validate_device_id_command)
 {
     CONTROL_COMMAND.control_command.type = openxc_ControlCommand_Type_DEVICE_ID;
@@ -844,9 +924,13 @@ END_TEST
 START_TEST (test_payload_format_command)
 {
     uint8_t request[] = "{\"command\": \"payload_format\", \"bus\": 1, \"format\": \"protobuf\"}\0";
-    ck_assert_int_eq(PayloadFormat::JSON, getConfiguration()->payloadFormat);
+    ck_assert_int_eq(PayloadFormat::JSON, DESCRIPTOR.payloadFormat);
+    getConfiguration()->uart.descriptor.payloadFormat = PayloadFormat::JSON;
     ck_assert(handleIncomingMessage(request, sizeof(request), &DESCRIPTOR));
-    ck_assert_int_eq(PayloadFormat::PROTOBUF, getConfiguration()->payloadFormat);
+    ck_assert_int_eq(PayloadFormat::PROTOBUF, DESCRIPTOR.payloadFormat);
+    // Only the interface the command came from changes format
+    ck_assert_int_eq(PayloadFormat::JSON,
+            getConfiguration()->uart.descriptor.payloadFormat);
 }
 END_TEST
 
@@ -926,9 +1010,15 @@ Suite* suite(void) {
     tcase_add_checked_fixture(tc_control_commands, setup, NULL);
     tcase_add_test(tc_control_commands, test_version_message_in_stream);
     tcase_add_test(tc_control_commands, test_device_id_message_in_stream);
+    tcase_add_test(tc_control_commands, test_latency_message_in_stream);
+    tcase_add_test(tc_control_commands,
+            test_signal_dictionary_message_in_stream);
     tcase_add_test(tc_control_commands, test_passthrough_request_message);
     tcase_add_test(tc_control_commands, test_bypass_command);
     tcase_add_test(tc_control_commands, test_payload_format_command);
+    tcase_add_test(tc_control_commands, test_payload_format_command_compact);
+    tcase_add_test(tc_control_commands,
+            test_payload_format_command_from_compact_uart);
     tcase_add_test(tc_control_commands, test_predefined_obd2_command);
     suite_add_tcase(s, tc_control_commands);
 
@@ -958,6 +1048,8 @@ Suite* suite(void) {
             test_validate_diagnostic_no_multiple_responses);
     tcase_add_test(tc_validation, test_validate_version_command);
     tcase_add_test(tc_validation, test_validate_device_id_command);
+    tcase_add_test(tc_validation, test_validate_latency_command);
+    tcase_add_test(tc_validation, test_validate_signal_dictionary_command);
     tcase_add_test(tc_validation, test_validate_passthrough_commmand);
     tcase_add_test(tc_validation, test_validate_bypass_command);
     tcase_add_test(tc_validation, test_validate_payload_format_command);
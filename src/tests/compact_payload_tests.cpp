@@ -0,0 +1,274 @@
+#include <check.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "payload/compact.h"
+#include "payload/payload.h"
+
+namespace compact = openxc::payload::compact;
+
+using openxc::payload::wrapNumber;
+using openxc::payload::wrapBoolean;
+
+openxc_VehicleMessage message;
+
+void setup() {
+    message = {0};
+    message.has_type = true;
+    message.type = openxc_VehicleMessage_Type_SIMPLE;
+    message.has_simple_message = true;
+    message.simple_message.has_name = true;
+    message.simple_message.has_value = true;
+}
+
+static float decodeFloat(const uint8_t* bytes) {
+    float value;
+    uint32_t bits = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+            ((uint32_t)bytes[3] << 24);
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/* Check that a record is framed by COBS with a single 0 delimiter at the end,
+ * and decode it.
+ *
+ * Returns the length of the decoded record.
+ */
+static int unframe(const uint8_t* payload, int length, uint8_t* record) {
+    ck_assert(length > 1);
+    ck_assert_int_eq(payload[length - 1], 0);
+    int recordLength = 0;
+    int position = 0;
+    while(position < length - 1) {
+        uint8_t code = payload[position++];
+        ck_assert(code != 0);
+        for(int i = 1; i < code; i++) {
+            ck_assert(payload[position] != 0);
+            record[recordLength++] = payload[position++];
+        }
+        if(code < 0xff && position < length - 1) {
+            record[recordLength++] = 0;
+        }
+    }
+    ck_assert_int_eq(position, length - 1);
+    return recordLength;
+}
+
+START_TEST (test_serialize_number)
+{
+    strcpy(message.simple_message.name, "torque_at_transmission");
+    message.simple_message.value = wrapNumber(42);
+    uint8_t payload[32] = {0};
+    int length = compact::serialize(&message, payload, sizeof(payload));
+    uint8_t record[32];
+    ck_assert_int_eq(unframe(payload, length, record), 7);
+    ck_assert_int_eq(record[0], compact::RECORD_NUMBER);
+    ck_assert_int_eq(record[1], 0);
+    ck_assert_int_eq(record[2], 0);
+    ck_assert(decodeFloat(&record[3]) == 42);
+}
+END_TEST
+
+START_TEST (test_serialize_fractional_number)
+{
+    strcpy(message.simple_message.name, "torque_at_transmission");
+    message.simple_message.value = wrapNumber(12.34);
+    uint8_t payload[32] = {0};
+    int length = compact::serialize(&message, payload, sizeof(payload));
+    uint8_t record[32];
+    ck_assert_int_eq(unframe(payload, length, record), 7);
+    ck_assert_int_eq(record[0], compact::RECORD_NUMBER);
+    ck_assert(decodeFloat(&record[3]) == 12.34f);
+}
+END_TEST
+
+START_TEST (test_serialize_boolean)
+{
+    strcpy(message.simple_message.name, "brake_pedal_status");
+    message.simple_message.value = wrapBoolean(true);
+    uint8_t payload[32] = {0};
+    int length = compact::serialize(&message, payload, sizeof(payload));
+    uint8_t record[32];
+    ck_assert_int_eq(unframe(payload, length, record), 7);
+    ck_assert_int_eq(record[0], compact::RECORD_BOOLEAN);
+    ck_assert_int_eq(record[1], 2);
+    ck_assert_int_eq(record[3], 1);
+}
+END_TEST
+
+START_TEST (test_serialize_state)
+{
+    strcpy(message.simple_message.name, "transmission_gear_position");
+    message.simple_message.value.has_type = true;
+    message.simple_message.value.type = openxc_DynamicField_Type_STRING;
+    message.simple_message.value.has_string_value = true;
+    strcpy(message.simple_message.value.string_value, "sixth");
+    uint8_t payload[32] = {0};
+    int length = compact::serialize(&message, payload, sizeof(payload));
+    uint8_t record[32];
+    ck_assert_int_eq(unframe(payload, length, record), 7);
+    ck_assert_int_eq(record[0], compact::RECORD_STATE);
+    ck_assert_int_eq(record[1], 1);
+    // The index of the state in the signal's list, not its CAN value
+    ck_assert_int_eq(record[3], 2);
+}
+END_TEST
+
+START_TEST (test_serialize_timestamp)
+{
+    strcpy(message.simple_message.name, "torque_at_transmission");
+    message.simple_message.value = wrapNumber(42);
+    message.has_timestamp = true;
+    message.timestamp = 0x0102030405ULL;
+    uint8_t payload[32] = {0};
+    int length = compact::serialize(&message, payload, sizeof(payload));
+    uint8_t record[32];
+    ck_assert_int_eq(unframe(payload, length, record), 15);
+    ck_assert_int_eq(record[0],
+            compact::RECORD_NUMBER | compact::RECORD_TIMESTAMP_FLAG);
+    ck_assert_int_eq(record[7], 0x05);
+    ck_assert_int_eq(record[11], 0x01);
+    ck_assert_int_eq(record[12], 0);
+}
+END_TEST
+
+START_TEST (test_unknown_signal_as_protobuf)
+{
+    strcpy(message.simple_message.name, "not_in_the_message_set");
+    message.simple_message.value = wrapNumber(42);
+    uint8_t payload[128] = {0};
+    int length = compact::serialize(&message, payload, sizeof(payload));
+    uint8_t record[128];
+    ck_assert(unframe(payload, length, record) > 7);
+    ck_assert_int_eq(record[0], compact::RECORD_PROTOBUF);
+
+    openxc_VehicleMessage deserialized = {0};
+    ck_assert_int_eq(compact::deserialize(payload, length, &deserialized),
+            length);
+    ck_assert_str_eq(deserialized.simple_message.name,
+            "not_in_the_message_set");
+}
+END_TEST
+
+START_TEST (test_serialize_can_message)
+{
+    CanMessage canMessage = {
+        id: 0x18daf110,
+        format: CanMessageFormat::EXTENDED,
+        data: {0x1, 0x2, 0x3},
+        length: 3,
+        timestamp: 0x0102030405ULL
+    };
+    uint8_t payload[COMPACT_MAX_CAN_FRAME_RECORD_SIZE] = {0};
+    int length = compact::serializeCanMessage(2, &canMessage, true, payload,
+            sizeof(payload));
+    uint8_t record[COMPACT_MAX_CAN_FRAME_RECORD_SIZE];
+    ck_assert_int_eq(unframe(payload, length, record), 19);
+    ck_assert_int_eq(record[0],
+            compact::RECORD_CAN_FRAME | compact::RECORD_TIMESTAMP_FLAG);
+    ck_assert_int_eq(record[1], 2);
+    ck_assert_int_eq(record[2], 0x10);
+    ck_assert_int_eq(record[5], 0x18);
+    ck_assert_int_eq(record[6], compact::CAN_FRAME_EXTENDED_FLAG);
+    ck_assert_int_eq(record[7], 3);
+    ck_assert_int_eq(record[10], 0x3);
+    ck_assert_int_eq(record[11], 0x05);
+    ck_assert_int_eq(record[15], 0x01);
+
+    length = compact::serializeCanMessage(2, &canMessage, false, payload,
+            sizeof(payload));
+    ck_assert_int_eq(unframe(payload, length, record), 11);
+    ck_assert_int_eq(record[0], compact::RECORD_CAN_FRAME);
+}
+END_TEST
+
+START_TEST (test_serialize_can_vehicle_message)
+{
+    message.type = openxc_VehicleMessage_Type_CAN;
+    message.has_simple_message = false;
+    message.has_can_message = true;
+    message.can_message.has_bus = true;
+    message.can_message.bus = 1;
+    message.can_message.has_id = true;
+    message.can_message.id = 42;
+    message.can_message.has_data = true;
+    message.can_message.data.size = 2;
+    message.can_message.data.bytes[0] = 0xab;
+    message.can_message.data.bytes[1] = 0xcd;
+    uint8_t payload[32] = {0};
+    int length = compact::serialize(&message, payload, sizeof(payload));
+    uint8_t record[32];
+    ck_assert_int_eq(unframe(payload, length, record), 10);
+    ck_assert_int_eq(record[0], compact::RECORD_CAN_FRAME);
+    ck_assert_int_eq(record[2], 42);
+    ck_assert_int_eq(record[6], 0);
+    ck_assert_int_eq(record[9], 0xcd);
+}
+END_TEST
+
+START_TEST (test_deserialize_signal_value_ignored)
+{
+    strcpy(message.simple_message.name, "torque_at_transmission");
+    message.simple_message.value = wrapNumber(42);
+    uint8_t payload[32] = {0};
+    int length = compact::serialize(&message, payload, sizeof(payload));
+
+    // The frame is dropped, without a message
+    openxc_VehicleMessage deserialized = {0};
+    ck_assert_int_eq(compact::deserialize(payload, length, &deserialized),
+            length);
+    ck_assert(!deserialized.has_type);
+}
+END_TEST
+
+START_TEST (test_deserialize_resyncs_after_corrupt_frame)
+{
+    strcpy(message.simple_message.name, "not_in_the_message_set");
+    message.simple_message.value = wrapNumber(42);
+    // The tail of a frame that was cut off, then a whole one
+    uint8_t payload[128] = {0x12, 0x34, 0x0};
+    int length = compact::serialize(&message, &payload[3],
+            sizeof(payload) - 3);
+    ck_assert(length > 0);
+
+    openxc_VehicleMessage deserialized = {0};
+    ck_assert_int_eq(compact::deserialize(payload, length + 3, &deserialized),
+            3);
+    ck_assert(!deserialized.has_type);
+    ck_assert_int_eq(compact::deserialize(&payload[3], length, &deserialized),
+            length);
+    ck_assert_str_eq(deserialized.simple_message.name,
+            "not_in_the_message_set");
+}
+END_TEST
+
+Suite* suite(void) {
+    Suite* s = suite_create("compact_payload");
+    TCase *tc_compact_payload = tcase_create("compact_payload");
+    tcase_add_checked_fixture(tc_compact_payload, setup, NULL);
+    tcase_add_test(tc_compact_payload, test_serialize_number);
+    tcase_add_test(tc_compact_payload, test_serialize_fractional_number);
+    tcase_add_test(tc_compact_payload, test_serialize_boolean);
+    tcase_add_test(tc_compact_payload, test_serialize_state);
+    tcase_add_test(tc_compact_payload, test_serialize_timestamp);
+    tcase_add_test(tc_compact_payload, test_unknown_signal_as_protobuf);
+    tcase_add_test(tc_compact_payload, test_serialize_can_message);
+    tcase_add_test(tc_compact_payload, test_serialize_can_vehicle_message);
+    tcase_add_test(tc_compact_payload, test_deserialize_signal_value_ignored);
+    tcase_add_test(tc_compact_payload, test_deserialize_resyncs_after_corrupt_frame);
+    suite_add_tcase(s, tc_compact_payload);
+
+    return s;
+}
+
+int main(void) {
+    int numberFailed;
+    Suite* s = suite();
+    SRunner *sr = srunner_create(s);
+    // Don't fork so we can actually use gdb
+    srunner_set_fork_status(sr, CK_NOFORK);
+    srunner_run_all(sr, CK_NORMAL);
+    numberFailed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (numberFailed == 0) ? 0 : 1;
+}
@@ -3,6 +3,7 @@
 #include "signals.h"
 #include "config.h"
 #include "diagnostics.h"
+#include "obd2.h"
 #include "platform/platform.h"
 
 #include "canutil_spy.h"
@@ -13,6 +14,7 @@ namespace usb = openxc::interface::usb;
 
 using openxc::diagnostics::ActiveDiagnosticRequest;
 using openxc::diagnostics::DiagnosticsManager;
+using openxc::diagnostics::DiagnosticValue;
 using openxc::signals::getCanBuses;
 using openxc::signals::getCanBusCount;
 using openxc::signals::getMessages;
@@ -62,8 +64,11 @@ void setup() {
     getCanBuses()[0].rawWritable = true;
     request.pid = 2;
     request.arbitration_id = 0x7e0;
+    getConfiguration()->diagnosticsManager.schedules[0].requestsPerSecond = 0;
+    getConfiguration()->recurringObd2Requests = false;
+    getConfiguration()->adaptiveObd2Requests = false;
     initializeVehicleInterface();
-    getConfiguration()->payloadFormat = openxc::payload::PayloadFormat::JSON;
+    getConfiguration()->usb.descriptor.payloadFormat = openxc::payload::PayloadFormat::JSON;
     resetQueues();
     diagnostics::initialize(&getConfiguration()->diagnosticsManager, getCanBuses(),
             getCanBusCount(), NULL);
@@ -87,6 +92,20 @@ START_TEST (test_add_twice_fails)
 }
 END_TEST
 
+START_TEST (test_add_twice_keeps_existing)
+{
+    ck_assert(diagnostics::addRecurringRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request, 1));
+    ck_assert(!diagnostics::addRecurringRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request, 1));
+    // get around the staggered start
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    FAKE_TIME += 2000;
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    fail_if(canQueueEmpty(0));
+}
+END_TEST
+
 START_TEST (test_add_recurring_too_frequent)
 {
     ck_assert(diagnostics::addRecurringRequest(&getConfiguration()->diagnosticsManager,
@@ -96,6 +115,15 @@ START_TEST (test_add_recurring_too_frequent)
 }
 END_TEST
 
+START_TEST (test_add_recurring_negative_frequency)
+{
+    ck_assert(!diagnostics::addRecurringRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request, -1));
+    fail_unless(TAILQ_EMPTY(
+            &getConfiguration()->diagnosticsManager.recurringRequests));
+}
+END_TEST
+
 START_TEST (test_simultaneous_recurring_nonrecurring)
 {
     ck_assert(diagnostics::addRecurringRequest(&getConfiguration()->diagnosticsManager,
@@ -444,6 +472,190 @@ START_TEST (test_recurring_obd2_build)
 }
 END_TEST
 
+/* Send requests until one for the OBD-II PID goes out on the first bus, letting
+ * any others in the way time out.
+ */
+static bool sendObd2Request(uint8_t pid, CanMessage* sent) {
+    for(int i = 0; i < 100; i++) {
+        diagnostics::sendRequests(&getConfiguration()->diagnosticsManager,
+                &getCanBuses()[0]);
+        while(!canQueueEmpty(0)) {
+            *sent = QUEUE_POP(CanMessage, &getCanBuses()[0].sendQueue);
+            if(sent->data[1] == OBD2_MODE_POWERTRAIN_DIAGNOSTIC_REQUEST &&
+                    sent->data[2] == pid) {
+                return true;
+            }
+        }
+        FAKE_TIME += 200;
+    }
+    return false;
+}
+
+/* Start the engine and answer the query for supported PIDs 0x1 to 0x20 with
+ * the bitfield, so the automatic OBD-II requests are added.
+ */
+static void receiveSupportedPids(uint8_t first, uint8_t second) {
+    DiagnosticsManager* manager = &getConfiguration()->diagnosticsManager;
+    getConfiguration()->recurringObd2Requests = true;
+    diagnostics::initialize(manager, getCanBuses(), getCanBusCount(), 1);
+
+    CanMessage sent;
+    ck_assert(sendObd2Request(0xc, &sent));
+    CanMessage engineSpeed = {
+       id: 0x7e8,
+       format: CanMessageFormat::STANDARD,
+       data: {0x04, 0x41, 0x0c, 0x1a, 0xf8},
+       length: 8
+    };
+    diagnostics::receiveCanMessage(manager, &getCanBuses()[0], &engineSpeed,
+            &getConfiguration()->pipeline);
+    diagnostics::obd2::loop(manager);
+
+    ck_assert(sendObd2Request(0x0, &sent));
+    CanMessage supportedPids = {
+       id: 0x7e8,
+       format: CanMessageFormat::STANDARD,
+       data: {0x06, 0x41, 0x00, first, second, 0x00, 0x00},
+       length: 8
+    };
+    diagnostics::receiveCanMessage(manager, &getCanBuses()[0], &supportedPids,
+            &getConfiguration()->pipeline);
+}
+
+static ActiveDiagnosticRequest* findRecurringRequest(uint16_t pid) {
+    ActiveDiagnosticRequest* entry;
+    TAILQ_FOREACH(entry,
+            &getConfiguration()->diagnosticsManager.recurringRequests,
+            queueEntries) {
+        if(entry->handle.request.pid == pid) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+START_TEST (test_obd2_groups_supported_pids)
+{
+    // PIDs 0x4 and 0x5, then 0xc and 0xd
+    receiveSupportedPids(0x18, 0x18);
+
+    // engine_coolant_temperature is the only 1Hz PID
+    ActiveDiagnosticRequest* coolant = findRecurringRequest(0x5);
+    fail_if(coolant == NULL);
+    ck_assert_int_eq(coolant->valueCount, 0);
+    ck_assert(coolant->frequencyClock.frequency == 1);
+
+    // engine_load and vehicle_speed fill a single frame response (mode, then
+    // 2 bytes for each), which leaves no room for engine_speed
+    ActiveDiagnosticRequest* group = findRecurringRequest(0x4);
+    fail_if(group == NULL);
+    ck_assert_int_eq(group->valueCount, 2);
+    ck_assert_int_eq(group->values[1].identifier, 0xd);
+    ck_assert(group->frequencyClock.frequency == 5);
+
+    ActiveDiagnosticRequest* engineSpeed = findRecurringRequest(0xc);
+    fail_if(engineSpeed == NULL);
+    ck_assert_int_eq(engineSpeed->valueCount, 0);
+    ck_assert(engineSpeed->frequencyClock.frequency == 5);
+
+    CanMessage sent;
+    ck_assert(sendObd2Request(0x4, &sent));
+    ck_assert_int_eq(sent.data[0], 0x3);
+    ck_assert_int_eq(sent.data[1], 0x1);
+    ck_assert_int_eq(sent.data[2], 0x4);
+    ck_assert_int_eq(sent.data[3], 0xd);
+}
+END_TEST
+
+/* Wait for the automatic request for the PID to be sent, then answer it with
+ * the data of a single frame response.
+ */
+static void respondToObd2Request(uint8_t pid, uint8_t length,
+        const uint8_t data[]) {
+    CanMessage sent;
+    ck_assert(sendObd2Request(pid, &sent));
+    CanMessage response = {
+       id: 0x7e8,
+       format: CanMessageFormat::STANDARD,
+       data: {length},
+       length: 8
+    };
+    memcpy(&response.data[1], data, length);
+    diagnostics::receiveCanMessage(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &response, &getConfiguration()->pipeline);
+}
+
+START_TEST (test_adaptive_obd2_doubles_on_change)
+{
+    getConfiguration()->adaptiveObd2Requests = true;
+    receiveSupportedPids(0x18, 0x18);
+    ActiveDiagnosticRequest* engineSpeed = findRecurringRequest(0xc);
+    fail_if(engineSpeed == NULL);
+
+    // nothing to compare the first value with
+    const uint8_t first[] = {0x41, 0xc, 0x1a, 0xf8};
+    respondToObd2Request(0xc, sizeof(first), first);
+    ck_assert(engineSpeed->frequencyClock.frequency == 5);
+
+    const uint8_t second[] = {0x41, 0xc, 0x20, 0x00};
+    respondToObd2Request(0xc, sizeof(second), second);
+    ck_assert(engineSpeed->frequencyClock.frequency == 10);
+
+    // already at the maximum
+    const uint8_t third[] = {0x41, 0xc, 0x28, 0x00};
+    respondToObd2Request(0xc, sizeof(third), third);
+    ck_assert(engineSpeed->frequencyClock.frequency ==
+            (float) DEFAULT_ADAPTIVE_OBD2_MAX_FREQUENCY_HZ);
+}
+END_TEST
+
+START_TEST (test_adaptive_obd2_halves_when_stable)
+{
+    getConfiguration()->adaptiveObd2Requests = true;
+    receiveSupportedPids(0x18, 0x18);
+    ActiveDiagnosticRequest* coolant = findRecurringRequest(0x5);
+    fail_if(coolant == NULL);
+
+    // less than 1% change
+    const uint8_t first[] = {0x41, 0x5, 0xc8};
+    respondToObd2Request(0x5, sizeof(first), first);
+    ck_assert(coolant->frequencyClock.frequency == 1);
+    const uint8_t second[] = {0x41, 0x5, 0xc9};
+    respondToObd2Request(0x5, sizeof(second), second);
+    ck_assert(coolant->frequencyClock.frequency == .5);
+
+    float expected[] = {.25, .125, DEFAULT_ADAPTIVE_OBD2_MIN_FREQUENCY_HZ,
+            DEFAULT_ADAPTIVE_OBD2_MIN_FREQUENCY_HZ};
+    for(size_t i = 0; i < sizeof(expected) / sizeof(float); i++) {
+        respondToObd2Request(0x5, sizeof(second), second);
+        ck_assert(coolant->frequencyClock.frequency == expected[i]);
+    }
+}
+END_TEST
+
+START_TEST (test_adaptive_obd2_group_adapts_once)
+{
+    getConfiguration()->adaptiveObd2Requests = true;
+    receiveSupportedPids(0x18, 0x18);
+    ActiveDiagnosticRequest* group = findRecurringRequest(0x4);
+    fail_if(group == NULL);
+
+    const uint8_t first[] = {0x41, 0x4, 0x40, 0xd, 0x32};
+    respondToObd2Request(0x4, sizeof(first), first);
+    ck_assert(group->frequencyClock.frequency == 5);
+
+    // only vehicle_speed changed, and the module answered it first
+    const uint8_t second[] = {0x41, 0xd, 0x40, 0x4, 0x40};
+    respondToObd2Request(0x4, sizeof(second), second);
+    ck_assert(group->frequencyClock.frequency == 10);
+
+    // both steady, so the whole group is halved once, not once per value
+    const uint8_t third[] = {0x41, 0x4, 0x40, 0xd, 0x40};
+    respondToObd2Request(0x4, sizeof(third), third);
+    ck_assert(group->frequencyClock.frequency == 5);
+}
+END_TEST
+
 START_TEST (test_ignition_check_power_management_uses_watchdog)
 {
     getConfiguration()->powerManagement = openxc::config::PowerManagement::OBD2_IGNITION_CHECK;
@@ -541,6 +753,262 @@ START_TEST (test_add_recurring)
 }
 END_TEST
 
+START_TEST (test_recurring_same_arb_id_serialized)
+{
+    ck_assert(diagnostics::addRecurringRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request, 1));
+    request.pid = request.pid + 1;
+    ck_assert(diagnostics::addRecurringRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request, 1));
+
+    // get around the staggered start - both are due, but only one can be in
+    // flight to the same module
+    FAKE_TIME += 2000;
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    ck_assert_int_eq(QUEUE_LENGTH(CanMessage, &getCanBuses()[0].sendQueue), 1);
+    resetQueues();
+
+    // the second keeps its place and goes as soon as the first times out
+    FAKE_TIME += 100;
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    ck_assert_int_eq(QUEUE_LENGTH(CanMessage, &getCanBuses()[0].sendQueue), 1);
+}
+END_TEST
+
+START_TEST (test_recurring_request_budget)
+{
+    getConfiguration()->diagnosticsManager.schedules[0].requestsPerSecond = 1;
+    ck_assert(diagnostics::addRecurringRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request, 1));
+    request.arbitration_id = request.arbitration_id + 1;
+    ck_assert(diagnostics::addRecurringRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request, 1));
+
+    FAKE_TIME += 2000;
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    ck_assert_int_eq(QUEUE_LENGTH(CanMessage, &getCanBuses()[0].sendQueue), 1);
+    resetQueues();
+
+    FAKE_TIME += 500;
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    fail_unless(canQueueEmpty(0));
+
+    FAKE_TIME += 500;
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    ck_assert_int_eq(QUEUE_LENGTH(CanMessage, &getCanBuses()[0].sendQueue), 1);
+}
+END_TEST
+
+START_TEST (test_achieved_frequency)
+{
+    ck_assert(diagnostics::addRecurringRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request, 2));
+    ActiveDiagnosticRequest* entry = TAILQ_FIRST(
+            &getConfiguration()->diagnosticsManager.recurringRequests);
+    ck_assert(diagnostics::achievedFrequency(entry) == 0);
+
+    FAKE_TIME += 1000;
+    for(int i = 0; i < 3; i++) {
+        diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+        fail_if(canQueueEmpty(0));
+        diagnostics::receiveCanMessage(&getConfiguration()->diagnosticsManager,
+                &getCanBuses()[0], &message, &getConfiguration()->pipeline);
+        resetQueues();
+        FAKE_TIME += 500;
+    }
+    ck_assert(diagnostics::achievedFrequency(entry) == 2);
+}
+END_TEST
+
+START_TEST (test_grouped_request)
+{
+    DiagnosticRequest groupedRequest = {
+        arbitration_id: 0x7e0,
+        mode: OBD2_MODE_POWERTRAIN_DIAGNOSTIC_REQUEST
+    };
+    DiagnosticValue values[] = {
+        {0xc, 2, "engine_speed", diagnostics::obd2::handleObd2Pid},
+        {0xd, 1, "vehicle_speed", diagnostics::obd2::handleObd2Pid}
+    };
+    ck_assert(diagnostics::addRecurringGroupedRequest(
+            &getConfiguration()->diagnosticsManager, &getCanBuses()[0],
+            &groupedRequest, values, 2, NULL, NULL, 1));
+    // get around the staggered start
+    FAKE_TIME += 2000;
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    fail_if(canQueueEmpty(0));
+    CanMessage sent = QUEUE_POP(CanMessage, &getCanBuses()[0].sendQueue);
+    ck_assert_int_eq(sent.data[0], 0x3);
+    ck_assert_int_eq(sent.data[1], 0x1);
+    ck_assert_int_eq(sent.data[2], 0xc);
+    ck_assert_int_eq(sent.data[3], 0xd);
+
+    CanMessage response = {
+       id: 0x7e8,
+       format: CanMessageFormat::STANDARD,
+       data: {0x06, 0x41, 0x0c, 0x1a, 0xf8, 0x0d, 0x32},
+       length: 8
+    };
+    diagnostics::receiveCanMessage(&getConfiguration()->diagnosticsManager, &getCanBuses()[0],
+            &response, &getConfiguration()->pipeline);
+    fail_if(outputQueueEmpty());
+
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE) + 1];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    snapshot[sizeof(snapshot) - 1] = NULL;
+    ck_assert(strstr((char*)snapshot, "engine_speed") != NULL);
+    ck_assert(strstr((char*)snapshot, "1726") != NULL);
+    ck_assert(strstr((char*)snapshot, "vehicle_speed") != NULL);
+    ck_assert(strstr((char*)snapshot, "50") != NULL);
+}
+END_TEST
+
+START_TEST (test_grouped_request_too_long)
+{
+    DiagnosticRequest groupedRequest = {
+        arbitration_id: 0x7e0,
+        mode: 0x22
+    };
+    DiagnosticValue values[] = {
+        {0xf190, 2, "first", NULL},
+        {0xf191, 2, "second", NULL},
+        {0xf192, 2, "third", NULL}
+    };
+    fail_if(diagnostics::addRecurringGroupedRequest(
+            &getConfiguration()->diagnosticsManager, &getCanBuses()[0],
+            &groupedRequest, values, 3, NULL, NULL, 1));
+    ck_assert(diagnostics::addRecurringGroupedRequest(
+            &getConfiguration()->diagnosticsManager, &getCanBuses()[0],
+            &groupedRequest, values, 1, NULL, NULL, 1));
+}
+END_TEST
+
+START_TEST (test_set_recurring_frequency)
+{
+    DiagnosticsManager* manager = &getConfiguration()->diagnosticsManager;
+    ck_assert(diagnostics::addRecurringRequest(manager, &getCanBuses()[0],
+            &request, 1));
+    // get around the staggered start
+    FAKE_TIME += 2000;
+    diagnostics::sendRequests(manager, &getCanBuses()[0]);
+    fail_if(canQueueEmpty(0));
+    diagnostics::receiveCanMessage(manager, &getCanBuses()[0], &message,
+            &getConfiguration()->pipeline);
+    resetQueues();
+
+    ActiveDiagnosticRequest* entry = TAILQ_FIRST(&manager->recurringRequests);
+    fail_if(diagnostics::setRecurringFrequency(manager, entry, 0));
+    fail_if(diagnostics::setRecurringFrequency(manager, entry, 100));
+    ck_assert(diagnostics::setRecurringFrequency(manager, entry, 2));
+
+    FAKE_TIME += 400;
+    diagnostics::sendRequests(manager, &getCanBuses()[0]);
+    fail_unless(canQueueEmpty(0));
+    FAKE_TIME += 100;
+    diagnostics::sendRequests(manager, &getCanBuses()[0]);
+    fail_if(canQueueEmpty(0));
+}
+END_TEST
+
+static unsigned int currentTimeout() {
+    ActiveDiagnosticRequest probe = {0};
+    probe.bus = &getCanBuses()[0];
+    probe.arbitration_id = request.arbitration_id;
+    return diagnostics::responseTimeout(&getConfiguration()->diagnosticsManager,
+            &probe);
+}
+
+START_TEST (test_timeout_from_response_time)
+{
+    ck_assert_int_eq(currentTimeout(), 100);
+    ck_assert(diagnostics::addRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request));
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    FAKE_TIME += 10;
+    diagnostics::receiveCanMessage(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &message, &getConfiguration()->pipeline);
+    ck_assert_int_eq(currentTimeout(), 30);
+    resetQueues();
+
+    request.pid = request.pid + 1;
+    ck_assert(diagnostics::addRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request));
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    fail_if(canQueueEmpty(0));
+    resetQueues();
+
+    request.pid = request.pid + 1;
+    ck_assert(diagnostics::addRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request));
+    FAKE_TIME += 29;
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    fail_unless(canQueueEmpty(0));
+
+    // the previous request has timed out much sooner than 100ms
+    FAKE_TIME += 1;
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    fail_if(canQueueEmpty(0));
+}
+END_TEST
+
+START_TEST (test_timeout_floor)
+{
+    ck_assert(diagnostics::addRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request));
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    diagnostics::receiveCanMessage(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &message, &getConfiguration()->pipeline);
+    ck_assert_int_eq(currentTimeout(), DEFAULT_DIAGNOSTIC_TIMEOUT_FLOOR_MS);
+}
+END_TEST
+
+START_TEST (test_timeout_backs_off)
+{
+    ck_assert(diagnostics::addRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request));
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    FAKE_TIME += 100;
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    ck_assert_int_eq(currentTimeout(), 200);
+
+    for(int i = 0; i < 10; i++) {
+        ck_assert(diagnostics::addRequest(&getConfiguration()->diagnosticsManager,
+                &getCanBuses()[0], &request));
+        diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+        FAKE_TIME += DEFAULT_DIAGNOSTIC_TIMEOUT_CEILING_MS;
+        diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    }
+    ck_assert_int_eq(currentTimeout(), DEFAULT_DIAGNOSTIC_TIMEOUT_CEILING_MS);
+}
+END_TEST
+
+START_TEST (test_timeout_fixed_for_broadcast)
+{
+    request.arbitration_id = OBD2_FUNCTIONAL_BROADCAST_ID;
+    ck_assert(diagnostics::addRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request, NULL, true));
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    FAKE_TIME += 8;
+    diagnostics::receiveCanMessage(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &message, &getConfiguration()->pipeline);
+    fail_if(outputQueueEmpty());
+    FAKE_TIME += 92;
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    resetQueues();
+
+    // a quick response doesn't shorten the time slower modules get to respond
+    // to the next request
+    ck_assert(diagnostics::addRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request, NULL, true));
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    FAKE_TIME += 90;
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    diagnostics::receiveCanMessage(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &message, &getConfiguration()->pipeline);
+    fail_if(outputQueueEmpty());
+}
+END_TEST
+
 START_TEST (test_receive_nonrecurring_twice)
 {
     ck_assert(diagnostics::addRequest(&getConfiguration()->diagnosticsManager,
@@ -566,6 +1034,48 @@ START_TEST (test_receive_nonrecurring_twice)
 }
 END_TEST
 
+START_TEST (test_receive_other_arb_id_ignored)
+{
+    ck_assert(diagnostics::addRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request));
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    fail_if(canQueueEmpty(0));
+
+    // Same bucket in the response index, but a different arbitration ID
+    CanMessage otherMessage = message;
+    otherMessage.id = message.id + DIAGNOSTIC_RESPONSE_BUCKET_COUNT;
+    diagnostics::receiveCanMessage(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &otherMessage, &getConfiguration()->pipeline);
+    fail_unless(outputQueueEmpty());
+
+    diagnostics::receiveCanMessage(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &message, &getConfiguration()->pipeline);
+    fail_if(outputQueueEmpty());
+}
+END_TEST
+
+START_TEST (test_receive_physical_and_broadcast_response)
+{
+    ck_assert(diagnostics::addRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request));
+    request.arbitration_id = OBD2_FUNCTIONAL_BROADCAST_ID;
+    ck_assert(diagnostics::addRequest(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &request, NULL, true));
+    diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, &getCanBuses()[0]);
+    fail_if(canQueueEmpty(0));
+
+    // 0x7e8 is the response to both the request to 0x7e0 and the functional
+    // broadcast
+    diagnostics::receiveCanMessage(&getConfiguration()->diagnosticsManager,
+            &getCanBuses()[0], &message, &getConfiguration()->pipeline);
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE) + 1];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    snapshot[sizeof(snapshot) - 1] = NULL;
+    ck_assert(strstr((char*)snapshot, "\"id\":2016") != NULL);
+    ck_assert(strstr((char*)snapshot, "\"id\":2024") != NULL);
+}
+END_TEST
+
 START_TEST (test_nonrecurring_timeout)
 {
     ck_assert(diagnostics::addRequest(&getConfiguration()->diagnosticsManager,
@@ -1011,8 +1521,10 @@ Suite* suite(void) {
     tcase_add_test(tc_core, test_add_request_with_name_and_decoder);
     tcase_add_test(tc_core, test_add_recurring);
     tcase_add_test(tc_core, test_add_recurring_too_frequent);
+    tcase_add_test(tc_core, test_add_recurring_negative_frequency);
     tcase_add_test(tc_core, test_add_twice_diff_frequency_fails);
     tcase_add_test(tc_core, test_add_twice_fails);
+    tcase_add_test(tc_core, test_add_twice_keeps_existing);
     tcase_add_test(tc_core, test_padding_on_by_default);
     tcase_add_test(tc_core, test_padding_enabled);
     tcase_add_test(tc_core, test_padding_disabled);
@@ -1024,10 +1536,22 @@ Suite* suite(void) {
     tcase_add_test(tc_core, test_add_nonrecurring_doesnt_clobber_recurring);
     tcase_add_test(tc_core, test_receive_nonrecurring_twice);
     tcase_add_test(tc_core, test_nonrecurring_timeout);
+    tcase_add_test(tc_core, test_timeout_from_response_time);
+    tcase_add_test(tc_core, test_timeout_floor);
+    tcase_add_test(tc_core, test_timeout_backs_off);
+    tcase_add_test(tc_core, test_timeout_fixed_for_broadcast);
+    tcase_add_test(tc_core, test_receive_other_arb_id_ignored);
+    tcase_add_test(tc_core, test_receive_physical_and_broadcast_response);
     tcase_add_test(tc_core, test_recognized_obd2_request);
     tcase_add_test(tc_core, test_recognized_obd2_request_overridden);
 
     tcase_add_test(tc_core, test_recurring_staggered);
+    tcase_add_test(tc_core, test_recurring_same_arb_id_serialized);
+    tcase_add_test(tc_core, test_recurring_request_budget);
+    tcase_add_test(tc_core, test_achieved_frequency);
+    tcase_add_test(tc_core, test_grouped_request);
+    tcase_add_test(tc_core, test_grouped_request_too_long);
+    tcase_add_test(tc_core, test_set_recurring_frequency);
     tcase_add_test(tc_core, test_nonrecurring_not_staggered);
 
     tcase_add_test(tc_core, test_clear_to_send_blocked);
@@ -1054,6 +1578,10 @@ Suite* suite(void) {
     tcase_add_test(tc_core, test_request_callback);
 
     tcase_add_test(tc_core, test_recurring_obd2_build);
+    tcase_add_test(tc_core, test_obd2_groups_supported_pids);
+    tcase_add_test(tc_core, test_adaptive_obd2_doubles_on_change);
+    tcase_add_test(tc_core, test_adaptive_obd2_halves_when_stable);
+    tcase_add_test(tc_core, test_adaptive_obd2_group_adapts_once);
 
     tcase_add_test(tc_core, test_ignition_check_power_management_uses_watchdog);
 
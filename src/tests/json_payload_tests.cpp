@@ -1,6 +1,9 @@
 #include <check.h>
 #include <stdint.h>
 #include <string>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "commands/commands.h"
 #include "payload/json.h"
@@ -164,6 +167,284 @@ START_TEST (test_deserialize_can_message_write_with_format)
 }
 END_TEST
 
+START_TEST (test_deserialize_diagnostic_request)
+{
+    uint8_t rawRequest[] = "{\"command\": \"diagnostic_request\", "
+        "\"action\": \"add\", \"request\": {\"bus\": 1, \"id\": 2016, "
+        "\"mode\": 34, \"pid\": 4660, \"payload\": \"0x1234\", "
+        "\"multiple_responses\": true, \"frequency\": 2.5, "
+        "\"decoded_type\": \"obd2\", \"name\": \"my\\\"pid\"}}\0";
+    openxc_VehicleMessage deserialized = {0};
+    ck_assert_int_eq(json::deserialize(rawRequest, sizeof(rawRequest),
+                &deserialized), sizeof(rawRequest) - 1);
+    ck_assert(deserialized.has_control_command);
+    ck_assert_int_eq(deserialized.control_command.type,
+            openxc_ControlCommand_Type_DIAGNOSTIC);
+    ck_assert_int_eq(deserialized.control_command.diagnostic_request.action,
+            openxc_DiagnosticControlCommand_Action_ADD);
+    openxc_DiagnosticRequest* request =
+            &deserialized.control_command.diagnostic_request.request;
+    ck_assert_int_eq(request->bus, 1);
+    ck_assert_int_eq(request->message_id, 2016);
+    ck_assert_int_eq(request->mode, 34);
+    ck_assert_int_eq(request->pid, 4660);
+    ck_assert_int_eq(request->payload.size, 2);
+    ck_assert_int_eq(request->payload.bytes[1], 0x34);
+    ck_assert(request->multiple_responses);
+    ck_assert(request->frequency == 2.5);
+    ck_assert_int_eq(request->decoded_type,
+            openxc_DiagnosticRequest_DecodedType_OBD2);
+    ck_assert_str_eq(request->name, "my\"pid");
+}
+END_TEST
+
+START_TEST (test_deserialize_skips_unknown_fields)
+{
+    uint8_t rawRequest[] = "{\"extra\": {\"id\": 7, \"list\": [1, \"a\", "
+        "{}]}, \"command\": \"passthrough\", \"bus\": 2, \"enabled\": false}\0";
+    openxc_VehicleMessage deserialized = {0};
+    ck_assert(json::deserialize(rawRequest, sizeof(rawRequest),
+                &deserialized) > 0);
+    ck_assert_int_eq(deserialized.control_command.type,
+            openxc_ControlCommand_Type_PASSTHROUGH);
+    ck_assert_int_eq(deserialized.control_command.passthrough_mode_request.bus,
+            2);
+    ck_assert(deserialized.control_command.passthrough_mode_request.has_enabled);
+    ck_assert(!deserialized.control_command.passthrough_mode_request.enabled);
+}
+END_TEST
+
+START_TEST (test_deserialize_simple)
+{
+    uint8_t rawRequest[] = "{\"name\": \"turn_signal_status\", "
+        "\"value\": \"left\", \"event\": -1.5}\0";
+    openxc_VehicleMessage deserialized = {0};
+    ck_assert(json::deserialize(rawRequest, sizeof(rawRequest),
+                &deserialized) > 0);
+    ck_assert_int_eq(deserialized.type, openxc_VehicleMessage_Type_SIMPLE);
+    ck_assert_str_eq(deserialized.simple_message.name, "turn_signal_status");
+    ck_assert_str_eq(deserialized.simple_message.value.string_value, "left");
+    ck_assert(deserialized.simple_message.event.numeric_value == -1.5);
+}
+END_TEST
+
+START_TEST (test_deserialize_numbers)
+{
+    uint8_t rawRequest[] = "{\"name\": \"odometer\", "
+        "\"value\": 1.25e2, \"event\": -0.005}\0";
+    openxc_VehicleMessage deserialized = {0};
+    ck_assert(json::deserialize(rawRequest, sizeof(rawRequest),
+                &deserialized) > 0);
+    ck_assert(deserialized.simple_message.value.numeric_value == 125);
+    ck_assert(deserialized.simple_message.event.numeric_value == -0.005);
+}
+END_TEST
+
+START_TEST (test_deserialize_invalid_numbers)
+{
+    const char* invalidNumbers[] = {"0x10", "inf", "-", "1.", "1e", "01",
+        "1e999"};
+    for(size_t i = 0; i < sizeof(invalidNumbers) / sizeof(char*); i++) {
+        char rawRequest[64];
+        snprintf(rawRequest, sizeof(rawRequest),
+                "{\"name\": \"odometer\", \"value\": %s}", invalidNumbers[i]);
+        openxc_VehicleMessage deserialized = {0};
+        ck_assert_int_eq(json::deserialize((uint8_t*)rawRequest,
+                    strlen(rawRequest) + 1, &deserialized), 0);
+        ck_assert(!deserialized.has_type);
+    }
+}
+END_TEST
+
+START_TEST (test_deserialize_incomplete)
+{
+    uint8_t rawRequest[] = "{\"command\": \"version\"";
+    openxc_VehicleMessage deserialized = {0};
+    ck_assert_int_eq(json::deserialize(rawRequest, sizeof(rawRequest) - 1,
+                &deserialized), 0);
+    ck_assert(!deserialized.has_type);
+}
+END_TEST
+
+START_TEST (test_deserialize_malformed)
+{
+    uint8_t rawRequest[] = "{\"command\" \"version\"}\0";
+    openxc_VehicleMessage deserialized = {0};
+    ck_assert_int_eq(json::deserialize(rawRequest, sizeof(rawRequest),
+                &deserialized), 0);
+    ck_assert(!deserialized.has_type);
+}
+END_TEST
+
+START_TEST (test_serialize_timestamp)
+{
+    openxc_VehicleMessage message = {0};
+    message.has_type = true;
+    message.type = openxc_VehicleMessage_Type_SIMPLE;
+    message.has_simple_message = true;
+    message.simple_message.has_name = true;
+    strcpy(message.simple_message.name, "foo");
+    message.has_timestamp = true;
+    message.timestamp = 3500000;
+    uint8_t payload[256] = {0};
+    ck_assert(json::serialize(&message, payload, sizeof(payload)) > 0);
+    ck_assert(strstr((char*)payload, "\"timestamp\":3.5") != NULL);
+}
+END_TEST
+
+START_TEST (test_serialize_simple)
+{
+    openxc_VehicleMessage message = {0};
+    message.has_type = true;
+    message.type = openxc_VehicleMessage_Type_SIMPLE;
+    message.has_simple_message = true;
+    message.simple_message.has_name = true;
+    strcpy(message.simple_message.name, "foo");
+    message.simple_message.has_value = true;
+    message.simple_message.value.has_numeric_value = true;
+    message.simple_message.value.numeric_value = 42.5;
+    message.simple_message.has_event = true;
+    message.simple_message.event.has_boolean_value = true;
+    message.simple_message.event.boolean_value = false;
+    uint8_t payload[256] = {0};
+    const char expected[] = "{\"name\":\"foo\",\"value\":42.5,\"event\":false}";
+    ck_assert_int_eq(json::serialize(&message, payload, sizeof(payload)),
+            sizeof(expected));
+    ck_assert_str_eq((char*)payload, expected);
+}
+END_TEST
+
+START_TEST (test_serialize_numbers)
+{
+    openxc_VehicleMessage message = {0};
+    message.has_type = true;
+    message.type = openxc_VehicleMessage_Type_SIMPLE;
+    message.has_simple_message = true;
+    message.simple_message.has_name = true;
+    strcpy(message.simple_message.name, "foo");
+    message.simple_message.has_value = true;
+    message.simple_message.value.has_numeric_value = true;
+    uint8_t payload[256] = {0};
+
+    message.simple_message.value.numeric_value = -0.05;
+    ck_assert(json::serialize(&message, payload, sizeof(payload)) > 0);
+    ck_assert_str_eq((char*)payload, "{\"name\":\"foo\",\"value\":-0.05}");
+
+    message.simple_message.value.numeric_value = 1234567.1234567;
+    ck_assert(json::serialize(&message, payload, sizeof(payload)) > 0);
+    ck_assert_str_eq((char*)payload,
+            "{\"name\":\"foo\",\"value\":1234567.123457}");
+
+    message.simple_message.value.numeric_value = 30000000000.0;
+    ck_assert(json::serialize(&message, payload, sizeof(payload)) > 0);
+    ck_assert_str_eq((char*)payload, "{\"name\":\"foo\",\"value\":30000000000}");
+
+    message.simple_message.value.numeric_value = NAN;
+    ck_assert(json::serialize(&message, payload, sizeof(payload)) > 0);
+    ck_assert_str_eq((char*)payload, "{\"name\":\"foo\",\"value\":null}");
+}
+END_TEST
+
+START_TEST (test_serialize_escaped_string)
+{
+    openxc_VehicleMessage message = {0};
+    message.has_type = true;
+    message.type = openxc_VehicleMessage_Type_SIMPLE;
+    message.has_simple_message = true;
+    message.simple_message.has_name = true;
+    strcpy(message.simple_message.name, "foo");
+    message.simple_message.has_value = true;
+    message.simple_message.value.has_string_value = true;
+    strcpy(message.simple_message.value.string_value, "a\"b\\c\n\x01");
+    uint8_t payload[256] = {0};
+    ck_assert(json::serialize(&message, payload, sizeof(payload)) > 0);
+    ck_assert_str_eq((char*)payload,
+            "{\"name\":\"foo\",\"value\":\"a\\\"b\\\\c\\n\\u0001\"}");
+}
+END_TEST
+
+START_TEST (test_serialize_can)
+{
+    openxc_VehicleMessage message = {0};
+    message.has_type = true;
+    message.type = openxc_VehicleMessage_Type_CAN;
+    message.has_can_message = true;
+    message.can_message.has_bus = true;
+    message.can_message.bus = 1;
+    message.can_message.has_id = true;
+    message.can_message.id = 0x7e8;
+    message.can_message.has_data = true;
+    message.can_message.data.size = 2;
+    message.can_message.data.bytes[0] = 0xab;
+    message.can_message.data.bytes[1] = 0x01;
+    message.can_message.has_frame_format = true;
+    message.can_message.frame_format = openxc_CanMessage_FrameFormat_EXTENDED;
+    uint8_t payload[256] = {0};
+    ck_assert(json::serialize(&message, payload, sizeof(payload)) > 0);
+    ck_assert_str_eq((char*)payload, "{\"bus\":1,\"id\":2024,"
+            "\"data\":\"0xab01\",\"frame_format\":\"extended\"}");
+}
+END_TEST
+
+START_TEST (test_serialize_diagnostic)
+{
+    openxc_VehicleMessage message = {0};
+    message.has_type = true;
+    message.type = openxc_VehicleMessage_Type_DIAGNOSTIC;
+    message.has_diagnostic_response = true;
+    message.diagnostic_response.has_bus = true;
+    message.diagnostic_response.bus = 1;
+    message.diagnostic_response.has_message_id = true;
+    message.diagnostic_response.message_id = 0x7e8;
+    message.diagnostic_response.has_mode = true;
+    message.diagnostic_response.mode = 0x22;
+    message.diagnostic_response.has_success = true;
+    message.diagnostic_response.success = false;
+    message.diagnostic_response.has_pid = true;
+    message.diagnostic_response.pid = 0x1234;
+    message.diagnostic_response.has_negative_response_code = true;
+    message.diagnostic_response.negative_response_code = 0x31;
+    uint8_t payload[256] = {0};
+    ck_assert(json::serialize(&message, payload, sizeof(payload)) > 0);
+    ck_assert_str_eq((char*)payload, "{\"bus\":1,\"id\":2024,\"mode\":34,"
+            "\"success\":false,\"pid\":4660,\"negative_response_code\":49}");
+}
+END_TEST
+
+START_TEST (test_serialize_command_response_message)
+{
+    openxc_VehicleMessage message = {0};
+    message.has_type = true;
+    message.type = openxc_VehicleMessage_Type_COMMAND_RESPONSE;
+    message.has_command_response = true;
+    message.command_response.has_type = true;
+    message.command_response.type = openxc_ControlCommand_Type_VERSION;
+    message.command_response.has_message = true;
+    strcpy(message.command_response.message, "7.0.1-dev (default)");
+    message.command_response.has_status = true;
+    message.command_response.status = true;
+    uint8_t payload[256] = {0};
+    ck_assert(json::serialize(&message, payload, sizeof(payload)) > 0);
+    ck_assert_str_eq((char*)payload, "{\"command_response\":\"version\","
+            "\"message\":\"7.0.1-dev (default)\",\"status\":true}");
+}
+END_TEST
+
+START_TEST (test_serialize_too_long)
+{
+    openxc_VehicleMessage message = {0};
+    message.has_type = true;
+    message.type = openxc_VehicleMessage_Type_SIMPLE;
+    message.has_simple_message = true;
+    message.simple_message.has_name = true;
+    strcpy(message.simple_message.name, "foo");
+    uint8_t payload[16] = {0};
+    // {"name":"foo"} plus the delimiter is exactly 15 bytes
+    ck_assert_int_eq(json::serialize(&message, payload, 15), 15);
+    ck_assert_int_eq(json::serialize(&message, payload, 14), 0);
+}
+END_TEST
+
 START_TEST (test_deserialize_message_after_junk)
 {
     uint8_t rawRequest[] = "prime\0{\"bus\": 1, \"id\": 42, \"data\": \"0x1234\"}\0";
@@ -188,6 +469,21 @@ Suite* suite(void) {
     tcase_add_test(tc_json_payload, test_deserialize_can_message_write);
     tcase_add_test(tc_json_payload, test_deserialize_can_message_write_with_format);
     tcase_add_test(tc_json_payload, test_deserialize_message_after_junk);
+    tcase_add_test(tc_json_payload, test_deserialize_diagnostic_request);
+    tcase_add_test(tc_json_payload, test_deserialize_skips_unknown_fields);
+    tcase_add_test(tc_json_payload, test_deserialize_simple);
+    tcase_add_test(tc_json_payload, test_deserialize_numbers);
+    tcase_add_test(tc_json_payload, test_deserialize_invalid_numbers);
+    tcase_add_test(tc_json_payload, test_deserialize_incomplete);
+    tcase_add_test(tc_json_payload, test_deserialize_malformed);
+    tcase_add_test(tc_json_payload, test_serialize_timestamp);
+    tcase_add_test(tc_json_payload, test_serialize_simple);
+    tcase_add_test(tc_json_payload, test_serialize_numbers);
+    tcase_add_test(tc_json_payload, test_serialize_escaped_string);
+    tcase_add_test(tc_json_payload, test_serialize_can);
+    tcase_add_test(tc_json_payload, test_serialize_diagnostic);
+    tcase_add_test(tc_json_payload, test_serialize_command_response_message);
+    tcase_add_test(tc_json_payload, test_serialize_too_long);
     suite_add_tcase(s, tc_json_payload);
 
     return s;
@@ -1,8 +1,11 @@
 #include <check.h>
 #include <stdint.h>
+#include <string.h>
+#include <stdio.h>
 #include "pipeline.h"
 #include "emqueue.h"
 #include "config.h"
+#include "payload/payload.h"
 
 namespace uart = openxc::interface::uart;
 namespace network = openxc::interface::network;
@@ -11,6 +14,7 @@ namespace usb = openxc::interface::usb;
 using openxc::pipeline::Pipeline;
 using openxc::pipeline::MessageClass;
 using openxc::config::getConfiguration;
+using openxc::payload::PayloadFormat;
 
 QUEUE_TYPE(uint8_t)* OUTPUT_QUEUE = &getConfiguration()->usb.endpoints[IN_ENDPOINT_INDEX].queue;
 QUEUE_TYPE(uint8_t)* LOG_QUEUE = &getConfiguration()->usb.endpoints[LOG_ENDPOINT_INDEX].queue;
@@ -18,6 +22,7 @@ QUEUE_TYPE(uint8_t)* LOG_QUEUE = &getConfiguration()->usb.endpoints[LOG_ENDPOINT
 extern bool USB_PROCESSED;
 extern bool UART_PROCESSED;
 extern bool NETWORK_PROCESSED;
+extern unsigned long FAKE_TIME;
 
 void setup() {
     getConfiguration()->pipeline.usb = &getConfiguration()->usb;
@@ -27,6 +32,10 @@ void setup() {
     uart::initialize(&getConfiguration()->uart);
     network::initialize(&getConfiguration()->network);
     getConfiguration()->usb.configured = true;
+    getConfiguration()->usb.descriptor.overflowPolicy =
+            openxc::interface::OverflowPolicy::DROP_NEWEST;
+    getConfiguration()->usb.descriptor.payloadFormat = PayloadFormat::JSON;
+    getConfiguration()->uart.descriptor.payloadFormat = PayloadFormat::JSON;
     USB_PROCESSED = false;
     UART_PROCESSED = false;
     NETWORK_PROCESSED = false;
@@ -91,6 +100,221 @@ START_TEST (test_full_usb)
 
     const char* message = "message";
     sendMessage(&getConfiguration()->pipeline, (uint8_t*)message, 8, MessageClass::SIMPLE);
+    fail_if(USB_PROCESSED);
+    fail_unless(QUEUE_FULL(uint8_t, OUTPUT_QUEUE));
+}
+END_TEST
+
+START_TEST (test_full_usb_drop_oldest)
+{
+    getConfiguration()->usb.descriptor.overflowPolicy =
+            openxc::interface::OverflowPolicy::DROP_OLDEST;
+    char message[8];
+    for(int i = 0; i < 50; i++) {
+        snprintf(message, sizeof(message), "msg%04d", i);
+        sendMessage(&getConfiguration()->pipeline, (uint8_t*)message,
+                sizeof(message), MessageClass::SIMPLE);
+    }
+    fail_if(USB_PROCESSED);
+
+    // 39 messages fit with room for a CRLF, so the first 11 were dropped
+    ck_assert_int_eq(QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE), 39 * 8);
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE)];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    ck_assert_str_eq((char*)snapshot, "msg0011");
+    ck_assert_str_eq((char*)&snapshot[sizeof(snapshot) - 8], "msg0049");
+}
+END_TEST
+
+START_TEST (test_full_usb_drop_oldest_partially_sent)
+{
+    getConfiguration()->usb.descriptor.overflowPolicy =
+            openxc::interface::OverflowPolicy::DROP_OLDEST;
+    char message[8];
+    for(int i = 0; i < 39; i++) {
+        snprintf(message, sizeof(message), "msg%04d", i);
+        sendMessage(&getConfiguration()->pipeline, (uint8_t*)message,
+                sizeof(message), MessageClass::SIMPLE);
+    }
+    // the interface has started sending the oldest message, so it can't be
+    // dropped and the new message is instead
+    QUEUE_POP(uint8_t, OUTPUT_QUEUE);
+    sendMessage(&getConfiguration()->pipeline, (uint8_t*)"msg0039",
+            sizeof(message), MessageClass::SIMPLE);
+    ck_assert_int_eq(QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE), 39 * 8 - 1);
+}
+END_TEST
+
+START_TEST (test_full_usb_command_response_waits)
+{
+    for(int i = 0; i < QUEUE_MAX_LENGTH(uint8_t) + 1; i++) {
+        QUEUE_PUSH(uint8_t, OUTPUT_QUEUE, (uint8_t) 128);
+    }
+    fail_unless(QUEUE_FULL(uint8_t, OUTPUT_QUEUE));
+
+    const char* message = "message";
+    sendMessage(&getConfiguration()->pipeline, (uint8_t*)message, 8,
+            MessageClass::COMMAND_RESPONSE);
+    fail_if(USB_PROCESSED);
+    fail_unless(QUEUE_FULL(uint8_t, OUTPUT_QUEUE));
+
+    process(&getConfiguration()->pipeline);
+    fail_unless(USB_PROCESSED);
+
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE)];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    ck_assert_str_eq((char*)snapshot, "message");
+}
+END_TEST
+
+START_TEST (test_full_usb_response_ahead_of_stream)
+{
+    char message[8];
+    for(int i = 0; i < 40; i++) {
+        snprintf(message, sizeof(message), "msg%04d", i);
+        sendMessage(&getConfiguration()->pipeline, (uint8_t*)message,
+                sizeof(message), MessageClass::SIMPLE);
+    }
+
+    const char* response = "diag";
+    sendMessage(&getConfiguration()->pipeline, (uint8_t*)response, 5,
+            MessageClass::DIAGNOSTIC);
+    process(&getConfiguration()->pipeline);
+
+    // The response waiting for room goes out before any newer stream messages
+    sendMessage(&getConfiguration()->pipeline, (uint8_t*)"later", 6,
+            MessageClass::CAN);
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE)];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    ck_assert_int_eq(sizeof(snapshot), 5 + 6);
+    ck_assert_str_eq((char*)snapshot, "diag");
+    ck_assert_str_eq((char*)&snapshot[5], "later");
+}
+END_TEST
+
+START_TEST (test_full_usb_stream_dropped_behind_response)
+{
+    getConfiguration()->usb.descriptor.overflowPolicy =
+            openxc::interface::OverflowPolicy::DROP_OLDEST;
+    char message[8];
+    for(int i = 0; i < 39; i++) {
+        snprintf(message, sizeof(message), "msg%04d", i);
+        sendMessage(&getConfiguration()->pipeline, (uint8_t*)message,
+                sizeof(message), MessageClass::SIMPLE);
+    }
+
+    const char* response = "diag";
+    sendMessage(&getConfiguration()->pipeline, (uint8_t*)response, 5,
+            MessageClass::DIAGNOSTIC);
+    sendMessage(&getConfiguration()->pipeline, (uint8_t*)"later", 6,
+            MessageClass::CAN);
+
+    // Stream messages don't make room for themselves while a response waits
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE)];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, snapshot, sizeof(snapshot));
+    ck_assert_int_eq(sizeof(snapshot), 39 * 8);
+    ck_assert_str_eq((char*)snapshot, "msg0000");
+    ck_assert_str_eq((char*)&snapshot[sizeof(snapshot) - 8], "msg0038");
+
+    process(&getConfiguration()->pipeline);
+    uint8_t drained[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE)];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, drained, sizeof(drained));
+    ck_assert_int_eq(sizeof(drained), 5);
+    ck_assert_str_eq((char*)drained, "diag");
+}
+END_TEST
+
+static void publishNumber(const char* name, float value) {
+    openxc_VehicleMessage message = {0};
+    message.has_type = true;
+    message.type = openxc_VehicleMessage_Type_SIMPLE;
+    message.has_simple_message = true;
+    message.simple_message.has_name = true;
+    strcpy(message.simple_message.name, name);
+    message.simple_message.has_value = true;
+    message.simple_message.value = openxc::payload::wrapNumber(value);
+    publish(&message, &getConfiguration()->pipeline);
+}
+
+static bool outputContains(const char* needle) {
+    char snapshot[QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE) + 1];
+    QUEUE_SNAPSHOT(uint8_t, OUTPUT_QUEUE, (uint8_t*)snapshot,
+            sizeof(snapshot) - 1);
+    for(size_t i = 0; i < sizeof(snapshot) - 1; i++) {
+        if(snapshot[i] == '\0') {
+            snapshot[i] = '\n';
+        }
+    }
+    snapshot[sizeof(snapshot) - 1] = '\0';
+    return strstr(snapshot, needle) != NULL;
+}
+
+START_TEST (test_coalesce_above_watermark)
+{
+    getConfiguration()->usb.descriptor.overflowPolicy =
+            openxc::interface::OverflowPolicy::COALESCE;
+    for(int i = 0; i < 250; i++) {
+        QUEUE_PUSH(uint8_t, OUTPUT_QUEUE, (uint8_t) 128);
+    }
+
+    publishNumber("foo", 1);
+    publishNumber("foo", 2);
+    publishNumber("bar", 3);
+    ck_assert_int_eq(QUEUE_LENGTH(uint8_t, OUTPUT_QUEUE), 250);
+
+    // flushing the queue makes room for the latest value of each signal
+    process(&getConfiguration()->pipeline);
+    fail_unless(outputContains("{\"name\":\"foo\",\"value\":2}"));
+    fail_unless(outputContains("{\"name\":\"bar\",\"value\":3}"));
+    fail_if(outputContains("\"value\":1}"));
+}
+END_TEST
+
+START_TEST (test_coalesce_too_large_replaces_waiting_value)
+{
+    getConfiguration()->usb.descriptor.overflowPolicy =
+            openxc::interface::OverflowPolicy::COALESCE;
+    for(int i = 0; i < 250; i++) {
+        QUEUE_PUSH(uint8_t, OUTPUT_QUEUE, (uint8_t) 128);
+    }
+
+    const char* name = "engine_coolant_temperature_at_the_radiator_outlet";
+    publishNumber(name, 1);
+    // too large to be held back, so the waiting value is out of date and must
+    // not be sent after it
+    publishNumber(name, 1234.5);
+    publishNumber("bar", 3);
+
+    process(&getConfiguration()->pipeline);
+    fail_if(outputContains("\"value\":1}"));
+    fail_unless(outputContains("{\"name\":\"bar\",\"value\":3}"));
+}
+END_TEST
+
+START_TEST (test_coalesce_below_watermark)
+{
+    getConfiguration()->usb.descriptor.overflowPolicy =
+            openxc::interface::OverflowPolicy::COALESCE;
+    publishNumber("foo", 1);
+    publishNumber("foo", 2);
+    fail_unless(outputContains("{\"name\":\"foo\",\"value\":1}"));
+    fail_unless(outputContains("{\"name\":\"foo\",\"value\":2}"));
+}
+END_TEST
+
+START_TEST (test_publish_per_interface_format)
+{
+    getConfiguration()->pipeline.uart = &getConfiguration()->uart;
+    getConfiguration()->uart.descriptor.payloadFormat = PayloadFormat::PROTOBUF;
+    publishNumber("foo", 42);
+
+    fail_unless(outputContains("\"foo\""));
+    QUEUE_TYPE(uint8_t)* uartQueue = &getConfiguration()->uart.sendQueue;
+    fail_if(QUEUE_EMPTY(uint8_t, uartQueue));
+    uint8_t snapshot[QUEUE_LENGTH(uint8_t, uartQueue)];
+    QUEUE_SNAPSHOT(uint8_t, uartQueue, snapshot, sizeof(snapshot));
+    // Protobuf messages start with a length prefix, not JSON's opening brace
+    fail_if(snapshot[0] == '{');
 }
 END_TEST
 
@@ -158,6 +382,31 @@ START_TEST (test_process_all)
 }
 END_TEST
 
+START_TEST (test_flush_latency)
+{
+    openxc::util::statistics::Histogram* latency =
+            openxc::pipeline::getFlushLatency(
+                openxc::interface::InterfaceType::USB);
+    unsigned int previousCount = latency->count;
+
+    openxc_VehicleMessage message = {0};
+    message.has_type = true;
+    message.type = openxc_VehicleMessage_Type_SIMPLE;
+    message.has_simple_message = true;
+    message.simple_message.has_name = true;
+    strcpy(message.simple_message.name, "foo");
+    message.timestamp = (uint64_t)FAKE_TIME * 1000;
+    publish(&message, &getConfiguration()->pipeline);
+    ck_assert(!QUEUE_EMPTY(uint8_t, OUTPUT_QUEUE));
+    ck_assert_int_eq(latency->count, previousCount);
+
+    FAKE_TIME += 3;
+    process(&getConfiguration()->pipeline);
+    ck_assert_int_eq(latency->count - previousCount, 1);
+    ck_assert_int_eq(latency->max, 3000);
+}
+END_TEST
+
 Suite* pipelineSuite(void) {
     Suite* s = suite_create("pipeline");
     TCase *tc_core = tcase_create("core");
@@ -165,13 +414,23 @@ Suite* pipelineSuite(void) {
     tcase_add_test(tc_core, test_only_usb);
     tcase_add_test(tc_core, test_with_uart);
     tcase_add_test(tc_core, test_with_uart_and_network);
+    tcase_add_test(tc_core, test_publish_per_interface_format);
     tcase_add_test(tc_core, test_full_usb);
+    tcase_add_test(tc_core, test_full_usb_drop_oldest);
+    tcase_add_test(tc_core, test_full_usb_drop_oldest_partially_sent);
+    tcase_add_test(tc_core, test_full_usb_command_response_waits);
+    tcase_add_test(tc_core, test_full_usb_response_ahead_of_stream);
+    tcase_add_test(tc_core, test_full_usb_stream_dropped_behind_response);
+    tcase_add_test(tc_core, test_coalesce_above_watermark);
+    tcase_add_test(tc_core, test_coalesce_below_watermark);
+    tcase_add_test(tc_core, test_coalesce_too_large_replaces_waiting_value);
     tcase_add_test(tc_core, test_full_uart);
     tcase_add_test(tc_core, test_full_network);
     tcase_add_test(tc_core, test_process_all);
     tcase_add_test(tc_core, test_process_usb_and_uart);
     tcase_add_test(tc_core, test_process_usb);
     tcase_add_test(tc_core, test_log_to_usb);
+    tcase_add_test(tc_core, test_flush_latency);
     suite_add_tcase(s, tc_core);
 
     return s;
@@ -2,3 +2,9 @@
 
 void openxc::platform::initialize() {
 }
+
+unsigned int openxc::platform::disableInterrupts() {
+    return 0;
+}
+
+void openxc::platform::restoreInterrupts(unsigned int state) { }
@@ -8,4 +8,8 @@ unsigned long openxc::util::time::systemTimeMs() {
     return FAKE_TIME;
 }
 
+uint64_t openxc::util::time::systemTimeUs() {
+    return (uint64_t)FAKE_TIME * 1000;
+}
+
 void openxc::util::time::initialize() { }
@@ -0,0 +1,197 @@
+#include <check.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <limits.h>
+#include "can/canutil.h"
+
+namespace ring = openxc::can::ring;
+
+#define STRESS_MESSAGE_COUNT 1000000
+
+CanMessageRing RING;
+
+void setup() {
+    ring::initialize(&RING);
+}
+
+static CanMessage sequencedMessage(uint32_t sequence) {
+    CanMessage message = {
+        id: sequence,
+        format: CanMessageFormat::STANDARD,
+        data: {0}
+    };
+    memcpy(message.data, &sequence, sizeof(sequence));
+    message.length = (uint8_t)(sequence % CAN_MESSAGE_SIZE);
+    return message;
+}
+
+START_TEST (test_empty)
+{
+    CanMessage message;
+    ck_assert(ring::empty(&RING));
+    ck_assert_int_eq(ring::length(&RING), 0);
+    fail_if(ring::pop(&RING, &message));
+}
+END_TEST
+
+START_TEST (test_push_pop)
+{
+    CanMessage original = sequencedMessage(42);
+    ck_assert(ring::push(&RING, &original));
+    ck_assert_int_eq(ring::length(&RING), 1);
+
+    CanMessage message;
+    ck_assert(ring::pop(&RING, &message));
+    ck_assert_int_eq(message.id, 42);
+    ck_assert_int_eq(memcmp(message.data, original.data, CAN_MESSAGE_SIZE), 0);
+    ck_assert(ring::empty(&RING));
+}
+END_TEST
+
+START_TEST (test_full)
+{
+    for(uint32_t i = 0; i < CAN_QUEUE_MAX_LENGTH; i++) {
+        CanMessage message = sequencedMessage(i);
+        ck_assert(ring::push(&RING, &message));
+    }
+    ck_assert_int_eq(ring::length(&RING), CAN_QUEUE_MAX_LENGTH);
+
+    CanMessage message = sequencedMessage(CAN_QUEUE_MAX_LENGTH);
+    fail_if(ring::push(&RING, &message));
+
+    ck_assert(ring::pop(&RING, &message));
+    ck_assert_int_eq(message.id, 0);
+    message = sequencedMessage(CAN_QUEUE_MAX_LENGTH);
+    ck_assert(ring::push(&RING, &message));
+}
+END_TEST
+
+START_TEST (test_wraps_around)
+{
+    CanMessage message;
+    for(uint32_t i = 0; i < CAN_QUEUE_MAX_LENGTH * 3 + 1; i++) {
+        message = sequencedMessage(i);
+        ck_assert(ring::push(&RING, &message));
+        ck_assert(ring::pop(&RING, &message));
+        ck_assert_int_eq(message.id, i);
+    }
+    ck_assert(ring::empty(&RING));
+}
+END_TEST
+
+START_TEST (test_counter_overflow)
+{
+    RING.head = RING.tail = UINT_MAX - 1;
+    for(uint32_t i = 0; i < 4; i++) {
+        CanMessage message = sequencedMessage(i);
+        ck_assert(ring::push(&RING, &message));
+    }
+    ck_assert_int_eq(ring::length(&RING), 4);
+
+    CanMessage messages[4];
+    ck_assert_int_eq(ring::popBulk(&RING, messages, 4), 4);
+    for(uint32_t i = 0; i < 4; i++) {
+        ck_assert_int_eq(messages[i].id, i);
+    }
+    ck_assert(ring::empty(&RING));
+}
+END_TEST
+
+START_TEST (test_pop_bulk)
+{
+    for(uint32_t i = 0; i < 3; i++) {
+        CanMessage message = sequencedMessage(i);
+        ck_assert(ring::push(&RING, &message));
+    }
+
+    CanMessage messages[CAN_QUEUE_MAX_LENGTH];
+    ck_assert_int_eq(ring::popBulk(&RING, messages, 2), 2);
+    ck_assert_int_eq(messages[0].id, 0);
+    ck_assert_int_eq(messages[1].id, 1);
+
+    ck_assert_int_eq(ring::popBulk(&RING, messages, CAN_QUEUE_MAX_LENGTH), 1);
+    ck_assert_int_eq(messages[0].id, 2);
+
+    ck_assert_int_eq(ring::popBulk(&RING, messages, CAN_QUEUE_MAX_LENGTH), 0);
+    ck_assert_int_eq(ring::popBulk(&RING, messages, 0), 0);
+}
+END_TEST
+
+static void* produce(void* arg) {
+    for(uint32_t i = 0; i < STRESS_MESSAGE_COUNT; i++) {
+        CanMessage message = sequencedMessage(i);
+        while(!ring::push(&RING, &message)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+START_TEST (test_concurrent_producer_consumer)
+{
+    pthread_t producer;
+    ck_assert_int_eq(pthread_create(&producer, NULL, produce, NULL), 0);
+
+    uint32_t expected = 0;
+    bool inOrder = true;
+    CanMessage messages[CAN_QUEUE_MAX_LENGTH];
+    while(expected < STRESS_MESSAGE_COUNT && inOrder) {
+        // Alternate between single and bulk pops to exercise both
+        int count = (expected % 2) == 0 ?
+                ring::popBulk(&RING, messages, CAN_QUEUE_MAX_LENGTH) :
+                ring::pop(&RING, &messages[0]);
+        if(count == 0) {
+            sched_yield();
+        }
+
+        for(int i = 0; i < count; i++, expected++) {
+            CanMessage expectedMessage = sequencedMessage(expected);
+            if(messages[i].id != expected || messages[i].length !=
+                    expectedMessage.length || memcmp(messages[i].data,
+                        expectedMessage.data, CAN_MESSAGE_SIZE) != 0) {
+                inOrder = false;
+                break;
+            }
+        }
+    }
+
+    pthread_join(producer, NULL);
+    ck_assert(inOrder);
+    ck_assert_int_eq(expected, STRESS_MESSAGE_COUNT);
+    ck_assert(ring::empty(&RING));
+}
+END_TEST
+
+Suite* suite(void) {
+    Suite* s = suite_create("ring");
+    TCase *tc_core = tcase_create("core");
+    tcase_add_checked_fixture(tc_core, setup, NULL);
+    tcase_add_test(tc_core, test_empty);
+    tcase_add_test(tc_core, test_push_pop);
+    tcase_add_test(tc_core, test_full);
+    tcase_add_test(tc_core, test_wraps_around);
+    tcase_add_test(tc_core, test_counter_overflow);
+    tcase_add_test(tc_core, test_pop_bulk);
+    suite_add_tcase(s, tc_core);
+
+    TCase *tc_concurrency = tcase_create("concurrency");
+    tcase_add_checked_fixture(tc_concurrency, setup, NULL);
+    tcase_set_timeout(tc_concurrency, 30);
+    tcase_add_test(tc_concurrency, test_concurrent_producer_consumer);
+    suite_add_tcase(s, tc_concurrency);
+
+    return s;
+}
+
+int main(void) {
+    int numberFailed;
+    Suite* s = suite();
+    SRunner *sr = srunner_create(s);
+    // Don't fork so we can actually use gdb
+    srunner_set_fork_status(sr, CK_NOFORK);
+    srunner_run_all(sr, CK_NORMAL);
+    numberFailed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (numberFailed == 0) ? 0 : 1;
+}
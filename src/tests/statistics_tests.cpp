@@ -5,6 +5,7 @@
 
 using openxc::util::statistics::Statistic;
 using openxc::util::statistics::DeltaStatistic;
+using openxc::util::statistics::Histogram;
 
 namespace statistics = openxc::util::statistics;
 
@@ -93,6 +94,70 @@ START_TEST (test_delta_stat_exponential_average)
 }
 END_TEST
 
+START_TEST (test_histogram_empty)
+{
+    Histogram histogram;
+    statistics::initialize(&histogram);
+    ck_assert_int_eq(histogram.count, 0);
+    ck_assert_int_eq(statistics::percentile(&histogram, 50), 0);
+    ck_assert_int_eq(statistics::maximum(&histogram), 0);
+}
+END_TEST
+
+START_TEST (test_histogram_buckets)
+{
+    Histogram histogram;
+    statistics::initialize(&histogram);
+    statistics::update(&histogram, 0);
+    statistics::update(&histogram, 1);
+    statistics::update(&histogram, 2);
+    statistics::update(&histogram, 3);
+    statistics::update(&histogram, 1000);
+    statistics::update(&histogram, 0xffffffff);
+
+    ck_assert_int_eq(histogram.count, 6);
+    ck_assert_int_eq(histogram.buckets[0], 1);
+    ck_assert_int_eq(histogram.buckets[1], 1);
+    ck_assert_int_eq(histogram.buckets[2], 2);
+    ck_assert_int_eq(histogram.buckets[10], 1);
+    ck_assert_int_eq(histogram.buckets[HISTOGRAM_BUCKET_COUNT - 1], 1);
+    ck_assert(statistics::maximum(&histogram) == 0xffffffff);
+}
+END_TEST
+
+START_TEST (test_histogram_percentiles)
+{
+    Histogram histogram;
+    statistics::initialize(&histogram);
+    for(int i = 0; i < 98; i++) {
+        statistics::update(&histogram, 100);
+    }
+    statistics::update(&histogram, 5000);
+    statistics::update(&histogram, 6000);
+
+    // 100 is in the bucket for 64 - 127
+    ck_assert_int_eq(statistics::percentile(&histogram, 50), 127);
+    ck_assert_int_eq(statistics::percentile(&histogram, 98), 127);
+    ck_assert_int_eq(statistics::percentile(&histogram, 99), 6000);
+    ck_assert_int_eq(statistics::percentile(&histogram, 100), 6000);
+    ck_assert_int_eq(statistics::maximum(&histogram), 6000);
+}
+END_TEST
+
+START_TEST (test_histogram_percentile_bucket_bound)
+{
+    Histogram histogram;
+    statistics::initialize(&histogram);
+    statistics::update(&histogram, 70);
+    statistics::update(&histogram, 100);
+    statistics::update(&histogram, 300);
+
+    ck_assert_int_eq(statistics::percentile(&histogram, 50), 127);
+    ck_assert_int_eq(statistics::percentile(&histogram, 0), 127);
+    ck_assert_int_eq(statistics::percentile(&histogram, 99), 300);
+}
+END_TEST
+
 Suite* suite(void) {
     Suite* s = suite_create("statistics");
     TCase *tc_core = tcase_create("core");
@@ -103,6 +168,10 @@ Suite* suite(void) {
     tcase_add_test(tc_core, test_delta_stat_min_max);
     tcase_add_test(tc_core, test_delta_stat_exponential_average);
     tcase_add_test(tc_core, test_average_starts_at_first_value);
+    tcase_add_test(tc_core, test_histogram_empty);
+    tcase_add_test(tc_core, test_histogram_buckets);
+    tcase_add_test(tc_core, test_histogram_percentiles);
+    tcase_add_test(tc_core, test_histogram_percentile_bucket_bound);
     suite_add_tcase(s, tc_core);
 
     return s;
@@ -52,6 +52,8 @@ test_long: test_short
 	@make binary_output_compile_test
 	@make emulator_compile_test
 	@make stats_compile_test
+	@make integer_decode_compile_test
+	@make timestamp_compile_test
 	@make debug_stats_compile_test
 	@echo "$(GREEN)All tests passed.$(COLOR_RESET)"
 
@@ -90,6 +92,8 @@ unit_tests: CXXFLAGS =  $(CXX_SUPRESSED_ERRORS) $(CXXFLAGS_STD)
 unit_tests: LDFLAGS = -lm -coverage
 unit_tests: LDLIBS = $(TEST_LIBS)
 unit_tests: INCLUDE_PATHS += -I./tests/platform/
+# The tests switch interfaces to the COALESCE policy at runtime
+unit_tests: DEFAULT_COALESCE_TABLE_SIZE = 16
 unit_tests: $(TESTS)
 	@set -o $(TEST_SET_OPTS) >/dev/null 2>&1
 	@export SHELLOPTS
@@ -102,6 +106,8 @@ $(eval $(call ALL_PLATFORMS_TEST_TEMPLATE, mapped_compile_test, DEBUG=0, mapped_
 $(eval $(call ALL_PLATFORMS_TEST_TEMPLATE, passthrough_compile_test, DEBUG=0, copy_passthrough_signals))
 $(eval $(call ALL_PLATFORMS_TEST_TEMPLATE, emulator_compile_test, DEBUG=0 DEFAULT_EMULATED_DATA_STATUS=1, , all))
 $(eval $(call ALL_PLATFORMS_TEST_TEMPLATE, stats_compile_test, DEFAULT_METRICS_STATUS=1 DEBUG=0, code_generation_test))
+$(eval $(call ALL_PLATFORMS_TEST_TEMPLATE, integer_decode_compile_test, DEFAULT_INTEGER_DECODE_STATUS=1 DEBUG=0, code_generation_test))
+$(eval $(call ALL_PLATFORMS_TEST_TEMPLATE, timestamp_compile_test, DEFAULT_MESSAGE_TIMESTAMP_STATUS=1 DEBUG=0, code_generation_test))
 $(eval $(call ALL_PLATFORMS_TEST_TEMPLATE, debug_stats_compile_test, DEBUG=1 DEFAULT_METRICS_STATUS=1, code_generation_test))
 # TODO see https://github.com/openxc/vi-firmware/issues/189
 #$(eval $(call ALL_PLATFORMS_TEST_TEMPLATE, network_compile_test, NETWORK=1, code_generation_test))
@@ -9,6 +9,7 @@
 
 namespace diagnostics = openxc::diagnostics;
 namespace usb = openxc::interface::usb;
+namespace ring = openxc::can::ring;
 
 using openxc::pipeline::Pipeline;
 using openxc::signals::getCanBuses;
@@ -44,7 +45,7 @@ CanMessage message = {
 START_TEST (test_update_data_lights_can_active)
 {
     CanBus* bus = &getCanBuses()[0];
-    QUEUE_PUSH(CanMessage, &bus->receiveQueue, message);
+    ring::push(&bus->receiveQueue, &message);
     receiveCan(&getConfiguration()->pipeline, bus);
 
     checkBusActivity();
@@ -61,7 +62,7 @@ START_TEST (test_update_data_lights_can_inactive)
                 openxc::lights::COLORS.red));
 
     CanBus* bus = &getCanBuses()[0];
-    QUEUE_PUSH(CanMessage, &bus->receiveQueue, message);
+    ring::push(&bus->receiveQueue, &message);
     receiveCan(&getConfiguration()->pipeline, bus);
 
     FAKE_TIME += (openxc::can::CAN_ACTIVE_TIMEOUT_S * 1000) * 2;
@@ -72,7 +73,7 @@ END_TEST
 START_TEST (test_update_data_lights_suspend)
 {
     CanBus* bus = &getCanBuses()[0];
-    QUEUE_PUSH(CanMessage, &bus->receiveQueue, message);
+    ring::push(&bus->receiveQueue, &message);
     receiveCan(&getConfiguration()->pipeline, bus);
 
     FAKE_TIME += (openxc::can::CAN_ACTIVE_TIMEOUT_S * 1000) * 2;
@@ -89,6 +90,57 @@ START_TEST (test_update_data_lights_suspend)
 }
 END_TEST
 
+START_TEST (test_receive_can_drains_batch)
+{
+    CanBus* bus = &getCanBuses()[0];
+    unsigned int previouslyReceived = bus->messagesReceived;
+    for(int i = 0; i < 3; i++) {
+        ring::push(&bus->receiveQueue, &message);
+    }
+    receiveCan(&getConfiguration()->pipeline, bus);
+
+    ck_assert(ring::empty(&bus->receiveQueue));
+    ck_assert_int_eq(bus->messagesReceived - previouslyReceived, 3);
+    ck_assert_int_eq(bus->receiveBatchStats.max, 3);
+}
+END_TEST
+
+START_TEST (test_receive_can_respects_batch_size)
+{
+    CanBus* bus = &getCanBuses()[0];
+    bus->receiveBatchSize = 2;
+    unsigned int previouslyReceived = bus->messagesReceived;
+    for(int i = 0; i < 3; i++) {
+        ring::push(&bus->receiveQueue, &message);
+    }
+    receiveCan(&getConfiguration()->pipeline, bus);
+
+    ck_assert_int_eq(ring::length(&bus->receiveQueue), 1);
+    ck_assert_int_eq(bus->messagesReceived - previouslyReceived, 2);
+
+    receiveCan(&getConfiguration()->pipeline, bus);
+    ck_assert(ring::empty(&bus->receiveQueue));
+    bus->receiveBatchSize = 0;
+}
+END_TEST
+
+START_TEST (test_receive_can_records_latency)
+{
+    CanBus* bus = &getCanBuses()[0];
+    unsigned int previousCount = bus->decodeLatency.count;
+    CanMessage timestamped = message;
+    timestamped.timestamp = (uint64_t)FAKE_TIME * 1000 + 1;
+    FAKE_TIME += 5;
+    ring::push(&bus->receiveQueue, &timestamped);
+    ring::push(&bus->receiveQueue, &message);
+    receiveCan(&getConfiguration()->pipeline, bus);
+
+    ck_assert_int_eq(bus->decodeLatency.count - previousCount, 1);
+    ck_assert_int_eq(bus->decodeLatency.max, 4999);
+    ck_assert_int_eq(bus->publishLatency.max, 4999);
+}
+END_TEST
+
 START_TEST (test_loop)
 {
     firmwareLoop();
@@ -102,6 +154,9 @@ Suite* suite(void) {
     tcase_add_test(tc_core, test_update_data_lights_can_active);
     tcase_add_test(tc_core, test_update_data_lights_can_inactive);
     tcase_add_test(tc_core, test_update_data_lights_suspend);
+    tcase_add_test(tc_core, test_receive_can_drains_batch);
+    tcase_add_test(tc_core, test_receive_can_respects_batch_size);
+    tcase_add_test(tc_core, test_receive_can_records_latency);
 
     tcase_add_test(tc_core, test_loop);
 
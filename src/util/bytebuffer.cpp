@@ -2,6 +2,9 @@
 #include "strutil.h"
 #include "util/log.h"
 
+#include <string.h>
+#include <sys/param.h>
+
 QUEUE_DEFINE(uint8_t)
 
 using openxc::util::log::debug;
@@ -39,12 +42,45 @@ bool openxc::util::bytebuffer::messageFits(QUEUE_TYPE(uint8_t)* queue, uint8_t*
     return queue != NULL && QUEUE_AVAILABLE(uint8_t, queue) >= messageSize + 2;
 }
 
+/* Private: Copy a block of bytes into the queue with at most two memcpy calls
+ * (the second only if it wraps around the end of the queue's storage), and then
+ * publish it all at once by advancing the tail.
+ *
+ * This works directly on the emqueue storage because it only has a per-element
+ * push. The caller must have already checked that there's room.
+ */
+static void copyIntoQueue(QUEUE_TYPE(uint8_t)* queue, const uint8_t* data,
+        int length) {
+    const int slots = sizeof(queue->elements) / sizeof(queue->elements[0]);
+    int tail = queue->tail;
+    int firstChunk = MIN(length, slots - tail);
+    memcpy(&queue->elements[tail], data, firstChunk);
+    memcpy(queue->elements, data + firstChunk, length - firstChunk);
+    queue->tail = (tail + length) % slots;
+}
+
+void openxc::util::bytebuffer::discard(QUEUE_TYPE(uint8_t)* queue,
+        int count) {
+    const int slots = sizeof(queue->elements) / sizeof(queue->elements[0]);
+    count = MIN(count, QUEUE_LENGTH(uint8_t, queue));
+    queue->head = (queue->head + count) % slots;
+}
+
+void openxc::util::bytebuffer::transfer(QUEUE_TYPE(uint8_t)* source,
+        QUEUE_TYPE(uint8_t)* destination, int count) {
+    const int slots = sizeof(source->elements) / sizeof(source->elements[0]);
+    count = MIN(count, QUEUE_LENGTH(uint8_t, source));
+    int head = source->head;
+    int firstChunk = MIN(count, slots - head);
+    copyIntoQueue(destination, &source->elements[head], firstChunk);
+    copyIntoQueue(destination, source->elements, count - firstChunk);
+    discard(source, count);
+}
+
 bool openxc::util::bytebuffer::conditionalEnqueue(QUEUE_TYPE(uint8_t)* queue, uint8_t* message,
         int messageSize) {
     if(messageFits(queue, message, messageSize)) {
-        for(int i = 0; i < messageSize; i++) {
-            QUEUE_PUSH(uint8_t, queue, (uint8_t)message[i]);
-        }
+        copyIntoQueue(queue, message, messageSize);
         return true;
     }
     return false;
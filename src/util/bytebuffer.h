@@ -33,7 +33,9 @@ typedef size_t (*IncomingMessageCallback)(uint8_t* buffer, size_t length);
  */
 bool processQueue(QUEUE_TYPE(uint8_t)* queue, IncomingMessageCallback callback);
 
-/* Public: Add the message to the byte queue if there is room.
+/* Public: Add the message to the byte queue if there is room. The message is
+ * copied in as a block, not pushed a byte at a time, so the same serialized
+ * message can be cheaply added to the queue of every output interface.
  *
  * queue - The queue to add the message.
  * message - The message to attempt to enqueue.
@@ -45,6 +47,25 @@ bool processQueue(QUEUE_TYPE(uint8_t)* queue, IncomingMessageCallback callback);
 bool conditionalEnqueue(QUEUE_TYPE(uint8_t)* queue, uint8_t* message,
         int messageSize);
 
+/* Public: Remove bytes from the front of the byte queue without reading them.
+ *
+ * queue - The queue to remove bytes from.
+ * count - The number of bytes to remove. If the queue has fewer, it's emptied.
+ */
+void discard(QUEUE_TYPE(uint8_t)* queue, int count);
+
+/* Public: Move bytes from the front of one byte queue to the back of another,
+ * copying them as a block.
+ *
+ * source - The queue to remove the bytes from.
+ * destination - The queue to add the bytes to. The caller must have already
+ *      checked that there's room.
+ * count - The number of bytes to move. If the source has fewer, all of them
+ *      are moved.
+ */
+void transfer(QUEUE_TYPE(uint8_t)* source, QUEUE_TYPE(uint8_t)* destination,
+        int count);
+
 /* Public: Check if a message plus a CRLF will fit in the byte queue.
  *
  * queue - The queue to add the message.
@@ -2,6 +2,8 @@
 
 #include <limits.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "config.h"
 
@@ -17,6 +19,12 @@ void openxc::util::statistics::initialize(Statistic* stat) {
     stat->alpha = .1;
 }
 
+void openxc::util::statistics::initialize(Histogram* histogram) {
+    memset(histogram->buckets, 0, sizeof(histogram->buckets));
+    histogram->count = 0;
+    histogram->max = 0;
+}
+
 void openxc::util::statistics::update(Statistic* stat, int newValue) {
     if(stat->min == INT_MAX && stat->max == INT_MIN) {
         stat->movingAverage = newValue;
@@ -35,6 +43,49 @@ void openxc::util::statistics::update(DeltaStatistic* stat, int newValue) {
     update(&stat->statistic, delta);
 }
 
+/* Private: Find the bucket for a value - the number of significant bits in the
+ * value, so each bucket is twice as wide as the one before it.
+ */
+static int histogramBucket(unsigned int value) {
+    int bucket = 0;
+    if(value > 0) {
+        bucket = sizeof(unsigned int) * CHAR_BIT - __builtin_clz(value);
+    }
+    return MIN(bucket, HISTOGRAM_BUCKET_COUNT - 1);
+}
+
+void openxc::util::statistics::update(Histogram* histogram,
+        unsigned int newValue) {
+    ++histogram->buckets[histogramBucket(newValue)];
+    ++histogram->count;
+    histogram->max = MAX(newValue, histogram->max);
+}
+
+unsigned int openxc::util::statistics::percentile(const Histogram* histogram,
+        unsigned int percent) {
+    if(histogram->count == 0) {
+        return 0;
+    }
+
+    // The rank of the percentile value among all observed, rounding up
+    uint64_t rank = ((uint64_t)histogram->count * MIN(percent, 100) + 99) / 100;
+    rank = MAX(rank, 1);
+
+    uint64_t observed = 0;
+    for(int i = 0; i < HISTOGRAM_BUCKET_COUNT - 1; i++) {
+        observed += histogram->buckets[i];
+        if(observed >= rank) {
+            unsigned int upperBound = i == 0 ? 0 : (1U << i) - 1;
+            return MIN(upperBound, histogram->max);
+        }
+    }
+    return histogram->max;
+}
+
+unsigned int openxc::util::statistics::maximum(const Histogram* histogram) {
+    return histogram->max;
+}
+
 float openxc::util::statistics::exponentialMovingAverage(const Statistic* stat) {
     return stat->movingAverage;
 }
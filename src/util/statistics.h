@@ -1,6 +1,10 @@
 #ifndef _STATISTICS_H_
 #define _STATISTICS_H_
 
+// The number of buckets in a Histogram. Values of
+// 2^(HISTOGRAM_BUCKET_COUNT - 2) or more all go in the last bucket.
+#define HISTOGRAM_BUCKET_COUNT 24
+
 namespace openxc {
 namespace util {
 namespace statistics {
@@ -26,6 +30,21 @@ typedef struct {
     Statistic statistic;
 } DeltaStatistic;
 
+/* Public: A fixed-size histogram of non-negative values with logarithmic
+ * buckets, for tracking the distribution of something like a latency without
+ * storing each value.
+ *
+ * buckets - the number of values observed in each bucket. Bucket 0 counts
+ *      values of 0, and bucket i counts values from 2^(i - 1) to 2^i - 1.
+ * count - the total number of values observed.
+ * max - the maximum value seen so far.
+ */
+typedef struct {
+    unsigned int buckets[HISTOGRAM_BUCKET_COUNT];
+    unsigned int count;
+    unsigned int max;
+} Histogram;
+
 /* Public: Initialize a new Statistic.
  *
  * stat - the Statistic to initialize.
@@ -34,6 +53,8 @@ void initialize(Statistic* stat);
 
 void initialize(DeltaStatistic* stat);
 
+void initialize(Histogram* histogram);
+
 /* Public: Update the statistic with a new observed value.
  *
  * stat - the Statistic object to update.
@@ -43,6 +64,19 @@ void update(Statistic* stat, int newValue);
 
 void update(DeltaStatistic* stat, int newValue);
 
+void update(Histogram* histogram, unsigned int newValue);
+
+/* Public: Estimate a percentile of the values observed by a histogram.
+ *
+ * histogram - the Histogram to examine.
+ * percent - the percentile to find, from 0 to 100 (e.g. 99 for the p99).
+ *
+ * Returns the upper bound of the bucket holding the percentile, limited to the
+ * maximum value seen - this may overestimate it by up to a factor of 2. Returns
+ * 0 if no values have been observed.
+ */
+unsigned int percentile(const Histogram* histogram, unsigned int percent);
+
 float exponentialMovingAverage(const Statistic* stat);
 
 float exponentialMovingAverage(const DeltaStatistic* stat);
@@ -55,6 +89,8 @@ int maximum(const Statistic* stat);
 
 int maximum(const DeltaStatistic* stat);
 
+unsigned int maximum(const Histogram* histogram);
+
 
 } // namespace statistics
 } // namespace util
@@ -17,3 +17,100 @@ const char *strnchr(const char *str, size_t len, char character) {
 }
 
 #endif // __USE_NETWORK__
+
+uint32_t strhash(const char *str) {
+    uint32_t hash = 2166136261U;
+    for(; *str != '\0'; str++) {
+        hash = (hash ^ (uint8_t)*str) * 16777619U;
+    }
+    return hash;
+}
+
+#define MAX_DECIMAL_PLACES 9
+
+static const uint32_t POWERS_OF_TEN[MAX_DECIMAL_PLACES + 1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+// 2^64 / 10^n, the first magnitude that can't be held in a uint64_t once
+// scaled by 10^n, so the decimal places can be reduced with comparisons only
+static const double SCALED_LIMITS[MAX_DECIMAL_PLACES + 1] = {
+    18446744073709551616.0, 1844674407370955161.6, 184467440737095516.16,
+    18446744073709551.616, 1844674407370955.1616, 184467440737095.51616,
+    18446744073709.551616, 1844674407370.9551616, 184467440737.09551616,
+    18446744073.709551616
+};
+
+/* Private: Divide a value by 10 and return the remainder, using 32-bit
+ * division when the value fits. Most scaled values do, and 32-bit division is
+ * a single instruction on ARM Cortex-M3 where 64-bit division is a library
+ * call.
+ */
+static uint8_t divideByTen(uint64_t *value) {
+    if(*value <= UINT32_MAX) {
+        uint32_t small = (uint32_t) *value;
+        *value = small / 10;
+        return small % 10;
+    }
+
+    uint8_t digit = *value % 10;
+    *value /= 10;
+    return digit;
+}
+
+size_t formatDecimal(double value, uint8_t decimalPlaces, char *buffer,
+        size_t length) {
+    // NaN isn't equal to itself, and infinity minus itself is NaN
+    if(value != value || value - value != 0) {
+        return 0;
+    }
+
+    int negative = value < 0;
+    if(negative) {
+        value = -value;
+    }
+
+    if(decimalPlaces > MAX_DECIMAL_PLACES) {
+        decimalPlaces = MAX_DECIMAL_PLACES;
+    }
+    while(decimalPlaces > 0 && value >= SCALED_LIMITS[decimalPlaces]) {
+        --decimalPlaces;
+    }
+
+    double scaledValue = value * POWERS_OF_TEN[decimalPlaces] + 0.5;
+    if(scaledValue >= SCALED_LIMITS[0]) {
+        return 0;
+    }
+
+    uint64_t scaled = (uint64_t) scaledValue;
+    negative = negative && scaled != 0;
+
+    // The digits are built from least to most significant, skipping trailing
+    // zeros after the decimal point
+    char digits[24];
+    size_t count = 0;
+    for(; decimalPlaces > 0; --decimalPlaces) {
+        uint8_t digit = divideByTen(&scaled);
+        if(digit != 0 || count > 0) {
+            digits[count++] = '0' + digit;
+        }
+    }
+    if(count > 0) {
+        digits[count++] = '.';
+    }
+    do {
+        digits[count++] = '0' + divideByTen(&scaled);
+    } while(scaled > 0);
+    if(negative) {
+        digits[count++] = '-';
+    }
+
+    if(count + 1 > length) {
+        return 0;
+    }
+    for(size_t i = 0; i < count; i++) {
+        buffer[i] = digits[count - i - 1];
+    }
+    buffer[count] = '\0';
+    return count;
+}
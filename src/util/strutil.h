@@ -6,12 +6,39 @@ extern "C" {
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 
 /*
  * Thanks to https://gist.github.com/855214.
  */
 const char *strnchr(const char *str, size_t len, char character);
 
+/* Public: Return the 32-bit FNV-1a hash of a NUL-terminated string.
+ */
+uint32_t strhash(const char *str);
+
+/* Public: Format a number in fixed-point decimal notation, rounded to at most
+ * decimalPlaces digits after the decimal point. Trailing zeros are dropped, as
+ * is the decimal point if nothing follows it, so integers have no fractional
+ * part.
+ *
+ * This is much cheaper than printf on a soft-float CPU, but not free: it costs
+ * one double multiply and add to scale the value, and one double to uint64_t
+ * conversion. The digits are built with 32-bit integer division when the
+ * scaled value fits, and 64-bit (a library call on 32-bit targets) otherwise.
+ *
+ * value - The number to format.
+ * decimalPlaces - The maximum number of digits after the decimal point (up to
+ *      9). Fewer are used if needed to fit the scaled value in 64 bits.
+ * buffer - The output buffer for the NUL-terminated string.
+ * length - The size of the buffer.
+ *
+ * Returns the length of the string, or 0 if the value isn't a finite number
+ * less than 2^64 in magnitude, or didn't fit in the buffer.
+ */
+size_t formatDecimal(double value, uint8_t decimalPlaces, char *buffer,
+        size_t length);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,6 +1,8 @@
 #ifndef __TIMER_H__
 #define __TIMER_H__
 
+#include <stdint.h>
+
 namespace openxc {
 namespace util {
 namespace time {
@@ -68,6 +70,12 @@ void delayMs(unsigned long delayInMs);
  */
 unsigned long systemTimeMs();
 
+/* Public: Return the current system time in microseconds, for timestamps that
+ * need more precision than systemTimeMs(). This is safe to call from an
+ * interrupt handler.
+ */
+uint64_t systemTimeUs();
+
 /* Public: Perform any one-time initialization required to use system times,
  * including those for system time and the delayMs function.
  */
@@ -24,6 +24,7 @@ namespace lights = openxc::lights;
 namespace can = openxc::can;
 namespace platform = openxc::platform;
 namespace time = openxc::util::time;
+namespace statistics = openxc::util::statistics;
 namespace signals = openxc::signals;
 namespace diagnostics = openxc::diagnostics;
 namespace power = openxc::power;
@@ -108,27 +109,61 @@ void initializeAllCan() {
             writable = true;
         }
         can::initialize(bus, writable, getCanBuses(), getCanBusCount());
+        can::indexMessageDefinitions(bus, getMessages(), getMessageCount());
     }
 }
 
+/* Private: Translate a single message received from CAN, pass it through to
+ * the output interfaces if requested and check it for diagnostic responses.
+ */
+static void receiveCanMessage(Pipeline* pipeline, CanBus* bus,
+        CanMessage* message) {
+    signals::decodeCanMessage(pipeline, bus, message);
+    if(bus->passthroughCanMessages) {
+        openxc::can::read::passthroughMessage(bus, message, getMessages(),
+                getMessageCount(), pipeline);
+    }
+
+    bus->lastMessageReceived = time::systemTimeMs();
+    ++bus->messagesReceived;
+
+    diagnostics::receiveCanMessage(&getConfiguration()->diagnosticsManager,
+            bus, message, pipeline);
+}
+
 /*
- * Check to see if a packet has been received. If so, read the packet and print
- * the packet payload to the uart monitor.
+ * Drain received packets from the bus's queue, translating each one. This
+ * stops when the queue is empty, after the bus's receive batch size is reached
+ * or when its receive time budget is used up, whichever comes first, so a busy
+ * bus can't starve the rest of the main loop.
  */
 void receiveCan(Pipeline* pipeline, CanBus* bus) {
-    if(!QUEUE_EMPTY(CanMessage, &bus->receiveQueue)) {
-        CanMessage message = QUEUE_POP(CanMessage, &bus->receiveQueue);
-        signals::decodeCanMessage(pipeline, bus, &message);
-        if(bus->passthroughCanMessages) {
-            openxc::can::read::passthroughMessage(bus, &message, getMessages(),
-                    getMessageCount(), pipeline);
+    const int batchSize = can::receiveBatchSize(bus);
+    const unsigned int timeBudget = can::receiveTimeBudget(bus);
+    const unsigned long startTime = time::systemTimeMs();
+
+    int received = 0;
+    CanMessage message;
+    while(received < batchSize &&
+            can::ring::pop(&bus->receiveQueue, &message)) {
+        if(message.timestamp != 0) {
+            statistics::update(&bus->decodeLatency,
+                    time::systemTimeUs() - message.timestamp);
+        }
+        receiveCanMessage(pipeline, bus, &message);
+        if(message.timestamp != 0) {
+            statistics::update(&bus->publishLatency,
+                    time::systemTimeUs() - message.timestamp);
         }
+        ++received;
 
-        bus->lastMessageReceived = time::systemTimeMs();
-        ++bus->messagesReceived;
+        if(time::systemTimeMs() - startTime >= timeBudget) {
+            break;
+        }
+    }
 
-        diagnostics::receiveCanMessage(&getConfiguration()->diagnosticsManager,
-                bus, &message, pipeline);
+    if(received > 0) {
+        statistics::update(&bus->receiveBatchStats, received);
     }
 }
 
@@ -162,6 +197,8 @@ void initializeVehicleInterface() {
     diagnostics::initialize(&getConfiguration()->diagnosticsManager,
             getCanBuses(), getCanBusCount(),
             getConfiguration()->obd2BusAddress);
+    can::indexSignals(getMessages(), getMessageCount(), getSignals(),
+            getSignalCount());
     signals::initialize(&getConfiguration()->diagnosticsManager);
     getConfiguration()->runLevel = RunLevel::CAN_ONLY;
 
@@ -181,14 +218,9 @@ void firmwareLoop() {
     }
 
     for(int i = 0; i < getCanBusCount(); i++) {
-        // In normal operation, if no output interface is enabled/attached (e.g.
-        // no USB or Bluetooth, the loop will stall here. Deep down in
-        // receiveCan when it tries to append messages to the queue it will
-        // reach a point where it tries to flush the (full) queue. Since nothing
-        // is attached, that will just keep timing out. Just be aware that if
-        // you need to modify the firmware to not use any interfaces, you'll
-        // have to change that or enable the flush functionality to write to
-        // your desired output interface.
+        // If an output interface can't keep up (or nothing is attached to
+        // it), messages for it are dropped according to its overflow policy
+        // instead of waiting for its queue to flush, so this never stalls.
         CanBus* bus = &(getCanBuses()[i]);
         receiveCan(&getConfiguration()->pipeline, bus);
         diagnostics::sendRequests(&getConfiguration()->diagnosticsManager, bus);
@@ -216,6 +248,7 @@ void firmwareLoop() {
 
     can::logBusStatistics(getCanBuses(), getCanBusCount());
     openxc::pipeline::logStatistics(&getConfiguration()->pipeline);
+    diagnostics::logStatistics(&getConfiguration()->diagnosticsManager);
 
     if(getConfiguration()->emulatedData) {
         static bool connected = false;